@@ -0,0 +1,578 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgexporter */
+#include <pgexporter_ext.h>
+#include <disk.h>
+
+/* system */
+#include <dirent.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/* Every hundredth relation has data, the others are empty like most of a catalog */
+#define BENCH_DATA_EVERY 100
+#define BENCH_DATA_SIZE  8192
+
+static int cache_bench(const char* directory, bool generated, int changes, int workers, bool io_uring);
+static int create_tree(const char* root, long files, int databases);
+static int create_file(const char* path, size_t size);
+static int remove_entry(const char* path, const struct stat* st, int flag, struct FTW* ftw);
+static unsigned long recursive_size(const char* directory, uint64_t* files);
+static double now(void);
+static int compare_hash(const void* key, const void* entry);
+static void usage(void);
+
+int
+main(int argc, char** argv)
+{
+   long files = 1000000;
+   int databases = 4;
+   int iterations = 3;
+   int workers = 0;
+   int changes = -1;
+   bool io_uring = false;
+   bool keep = false;
+   char* directory = NULL;
+   char root[] = "/tmp/pgexporter_ext_disk.XXXXXX";
+   struct disk_usage walked;
+   struct disk_root root_usage;
+   struct disk_root ring_usage;
+   unsigned long size = 0;
+   uint64_t counted = 0;
+   double start;
+   double elapsed;
+   double best_walk = 0.0;
+   double best_recursive = 0.0;
+   double best_parallel = 0.0;
+   double best_ring = 0.0;
+   int ret = 1;
+   int c;
+
+   while ((c = getopt(argc, argv, "n:b:i:w:c:d:ukh")) != -1)
+   {
+      switch (c)
+      {
+         case 'n':
+            files = atol(optarg);
+            break;
+         case 'b':
+            databases = atoi(optarg);
+            break;
+         case 'i':
+            iterations = atoi(optarg);
+            break;
+         case 'w':
+            workers = atoi(optarg);
+            break;
+         case 'c':
+            changes = atoi(optarg);
+            break;
+         case 'd':
+            directory = optarg;
+            break;
+         case 'u':
+            io_uring = true;
+            break;
+         case 'k':
+            keep = true;
+            break;
+         case 'h':
+         default:
+            usage();
+            return c == 'h' ? 0 : 1;
+      }
+   }
+
+   if (directory == NULL)
+   {
+      if (mkdtemp(root) == NULL)
+      {
+         fprintf(stderr, "Failed to create a temporary directory\n");
+         return 1;
+      }
+
+      start = now();
+      if (create_tree(root, files, databases))
+      {
+         fprintf(stderr, "Failed to create the tree in %s\n", root);
+         goto done;
+      }
+      printf("create: %ld files in %.3f s\n", files, now() - start);
+
+      directory = root;
+   }
+
+   for (int i = 0; i < iterations; i++)
+   {
+      start = now();
+      if (pgexporter_ext_disk_walk(directory, &walked))
+      {
+         fprintf(stderr, "Failed to walk %s\n", directory);
+         goto done;
+      }
+      elapsed = now() - start;
+
+      if (best_walk == 0.0 || elapsed < best_walk)
+      {
+         best_walk = elapsed;
+      }
+
+      counted = 0;
+
+      start = now();
+      size = recursive_size(directory, &counted);
+      elapsed = now() - start;
+
+      if (best_recursive == 0.0 || elapsed < best_recursive)
+      {
+         best_recursive = elapsed;
+      }
+
+      if (workers > 0)
+      {
+         memset(&root_usage, 0, sizeof(struct disk_root));
+         snprintf(root_usage.path, sizeof(root_usage.path), "%s", directory);
+
+         start = now();
+         if (pgexporter_ext_disk_walk_roots(&root_usage, 1, workers, false, NULL) || root_usage.result != 0)
+         {
+            fprintf(stderr, "Failed to walk %s\n", directory);
+            goto done;
+         }
+         elapsed = now() - start;
+
+         if (best_parallel == 0.0 || elapsed < best_parallel)
+         {
+            best_parallel = elapsed;
+         }
+      }
+
+      if (workers > 0 && io_uring)
+      {
+         memset(&ring_usage, 0, sizeof(struct disk_root));
+         snprintf(ring_usage.path, sizeof(ring_usage.path), "%s", directory);
+
+         start = now();
+         if (pgexporter_ext_disk_walk_roots(&ring_usage, 1, workers, true, NULL) || ring_usage.result != 0)
+         {
+            fprintf(stderr, "Failed to walk %s\n", directory);
+            goto done;
+         }
+         elapsed = now() - start;
+
+         if (best_ring == 0.0 || elapsed < best_ring)
+         {
+            best_ring = elapsed;
+         }
+      }
+   }
+
+   if (workers > 0 && memcmp(&root_usage.usage, &walked, sizeof(struct disk_usage)) != 0)
+   {
+      fprintf(stderr, "The parallel walk found %lu files instead of %lu\n",
+              (unsigned long)root_usage.usage.files, (unsigned long)walked.files);
+      goto done;
+   }
+
+   if (workers > 0 && io_uring && memcmp(&ring_usage.usage, &walked, sizeof(struct disk_usage)) != 0)
+   {
+      fprintf(stderr, "The io_uring walk found %lu files instead of %lu\n",
+              (unsigned long)ring_usage.usage.files, (unsigned long)walked.files);
+      goto done;
+   }
+
+   /* Only the generated tree is known to hold nothing but files and directories */
+   if (directory == root && counted != walked.files)
+   {
+      fprintf(stderr, "The walk found %lu files instead of %lu\n", (unsigned long)walked.files, (unsigned long)counted);
+      goto done;
+   }
+
+   printf("walk:      %lu files, %lu directories, %lu bytes in %.3f s, %.0f files/s\n",
+          (unsigned long)walked.files, (unsigned long)walked.directories, (unsigned long)walked.bytes,
+          best_walk, walked.files / best_walk);
+   printf("recursive: %lu files, %lu bytes in %.3f s, %.0f files/s\n",
+          (unsigned long)counted, size, best_recursive, counted / best_recursive);
+
+   if (workers > 0)
+   {
+      printf("parallel:  %lu files with %d threads in %.3f s, %.0f files/s\n",
+             (unsigned long)root_usage.usage.files, workers, best_parallel, root_usage.usage.files / best_parallel);
+   }
+
+   if (workers > 0 && io_uring)
+   {
+      printf("io_uring:  %lu files with %d threads in %.3f s, %.0f files/s\n",
+             (unsigned long)ring_usage.usage.files, workers, best_ring, ring_usage.usage.files / best_ring);
+   }
+
+   if (changes >= 0 && cache_bench(directory, directory == root, changes, workers, io_uring))
+   {
+      goto done;
+   }
+
+   ret = 0;
+
+done:
+
+   if (directory == root && !keep)
+   {
+      nftw(root, remove_entry, 64, FTW_DEPTH | FTW_PHYS);
+   }
+   else if (directory == root)
+   {
+      printf("tree: %s\n", root);
+   }
+
+   return ret;
+}
+
+static int
+cache_bench(const char* directory, bool generated, int changes, int workers, bool io_uring)
+{
+   struct disk_cache* cache = NULL;
+   struct disk_directory_usage* directories = NULL;
+   struct disk_directory_usage* found;
+   struct disk_usage walked;
+   char resolved[PATH_MAX];
+   char path[PATH_MAX + 32];
+   char* paths[1];
+   uint64_t hash = 0;
+   int lookups = 1000000;
+   int events = 0;
+   int number_of_directories;
+   int n;
+   double start;
+   int ret = 1;
+
+   if (realpath(directory, resolved) == NULL)
+   {
+      return 1;
+   }
+   paths[0] = resolved;
+
+   cache = pgexporter_ext_disk_cache_create();
+   directories = (struct disk_directory_usage*)malloc(DISK_CACHE_DIRECTORIES * sizeof(struct disk_directory_usage));
+   if (cache == NULL || directories == NULL)
+   {
+      goto done;
+   }
+
+   start = now();
+   if (pgexporter_ext_disk_cache_build(cache, paths, 1, workers > 0 ? workers : 1, io_uring, NULL) || cache->number_of_nodes == 0)
+   {
+      fprintf(stderr, "Failed to build the cache of %s\n", directory);
+      goto done;
+   }
+   printf("cache:     %lu files, %d directories in %.3f s%s\n", (unsigned long)cache->number_of_files,
+          cache->number_of_nodes, now() - start, cache->complete ? "" : ", not every directory watched");
+
+   /* What a backend does for pgexporter_ext_used_space() */
+   number_of_directories = pgexporter_ext_disk_cache_directories(cache, directories, DISK_CACHE_DIRECTORIES);
+
+   start = now();
+   for (int i = 0; i < lookups; i++)
+   {
+      hash = pgexporter_ext_disk_path_hash(resolved);
+      found = (struct disk_directory_usage*)bsearch(&hash, directories, number_of_directories,
+                                                    sizeof(struct disk_directory_usage), compare_hash);
+      if (found == NULL || found->usage.files != cache->nodes[0].usage.files)
+      {
+         fprintf(stderr, "%s isn't in the cache\n", resolved);
+         goto done;
+      }
+   }
+   printf("lookup:    %d directories, %.0f ns per lookup\n", number_of_directories, (now() - start) * 1e9 / lookups);
+
+   /* Only the generated tree is changed, and only a watched tree follows the changes */
+   if (!generated || changes == 0 || cache->fd == -1)
+   {
+      ret = 0;
+      goto done;
+   }
+
+   start = now();
+   for (int i = 0; i < changes; i++)
+   {
+      snprintf(path, sizeof(path), "%s/base/16384/t%d", resolved, i);
+      if (create_file(path, BENCH_DATA_SIZE))
+      {
+         goto done;
+      }
+
+      /* The temporary files of a query come and go */
+      if (i % 2 == 1)
+      {
+         snprintf(path, sizeof(path), "%s/base/16384/t%d", resolved, i - 1);
+         unlink(path);
+      }
+
+      if (i % 256 == 255)
+      {
+         events += pgexporter_ext_disk_cache_process(cache);
+      }
+   }
+
+   while ((n = pgexporter_ext_disk_cache_process(cache)) > 0)
+   {
+      events += n;
+   }
+   printf("events:    %d files created or removed and %d events applied in %.3f s%s\n", changes, events, now() - start,
+          cache->stale ? ", events were lost" : "");
+
+   if (pgexporter_ext_disk_walk(resolved, &walked))
+   {
+      goto done;
+   }
+
+   if (!cache->stale && memcmp(&walked, &cache->nodes[0].usage, sizeof(struct disk_usage)) != 0)
+   {
+      fprintf(stderr, "The cache has %lu files and %lu bytes instead of %lu and %lu\n",
+              (unsigned long)cache->nodes[0].usage.files, (unsigned long)cache->nodes[0].usage.bytes,
+              (unsigned long)walked.files, (unsigned long)walked.bytes);
+      goto done;
+   }
+
+   ret = 0;
+
+done:
+
+   pgexporter_ext_disk_cache_destroy(cache);
+   free(directories);
+
+   return ret;
+}
+
+static int
+create_tree(const char* root, long files, int databases)
+{
+   char path[MAX_PATH];
+   long relfilenode;
+   long created = 0;
+
+   /* A data directory puts all the relations of a database in one directory */
+   snprintf(path, sizeof(path), "%s/base", root);
+   if (mkdir(path, 0700))
+   {
+      return 1;
+   }
+
+   for (int db = 0; db < databases; db++)
+   {
+      snprintf(path, sizeof(path), "%s/base/%d", root, 16384 + db);
+      if (mkdir(path, 0700))
+      {
+         return 1;
+      }
+   }
+
+   snprintf(path, sizeof(path), "%s/global", root);
+   if (mkdir(path, 0700))
+   {
+      return 1;
+   }
+
+   /* Each relation has a main fork, a free space map and a visibility map */
+   for (relfilenode = 16384; created < files; relfilenode++)
+   {
+      static const char* forks[] = {"", "_fsm", "_vm"};
+      int db = relfilenode % (databases + 1);
+
+      for (int f = 0; f < 3 && created < files; f++)
+      {
+         if (db == databases)
+         {
+            snprintf(path, sizeof(path), "%s/global/%ld%s", root, relfilenode, forks[f]);
+         }
+         else
+         {
+            snprintf(path, sizeof(path), "%s/base/%d/%ld%s", root, 16384 + db, relfilenode, forks[f]);
+         }
+
+         if (create_file(path, f == 0 && relfilenode % BENCH_DATA_EVERY == 0 ? BENCH_DATA_SIZE : 0))
+         {
+            return 1;
+         }
+         created++;
+      }
+   }
+
+   return 0;
+}
+
+static int
+create_file(const char* path, size_t size)
+{
+   char data[BENCH_DATA_SIZE];
+   int fd;
+   int ret = 0;
+
+   fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+   if (fd == -1)
+   {
+      return 1;
+   }
+
+   if (size > 0)
+   {
+      memset(data, 'x', size);
+      ret = write(fd, data, size) != (ssize_t)size;
+   }
+
+   close(fd);
+
+   return ret;
+}
+
+static int
+remove_entry(const char* path, const struct stat* st, int flag, struct FTW* ftw)
+{
+   return remove(path);
+}
+
+/* The walk of pgexporter_get_directory_size() before the fd-relative walker */
+static unsigned long
+recursive_size(const char* directory, uint64_t* files)
+{
+   unsigned long total_size = 0;
+   DIR* dir;
+   struct dirent* entry;
+   char* p;
+   struct stat st;
+   unsigned long l;
+
+   if (!(dir = opendir(directory)))
+   {
+      return total_size;
+   }
+
+   while ((entry = readdir(dir)) != NULL)
+   {
+      if (entry->d_type == DT_DIR)
+      {
+         char path[1024];
+
+         if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+         {
+            continue;
+         }
+
+         snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+
+         total_size += recursive_size(path, files);
+      }
+      else if (entry->d_type == DT_REG || entry->d_type == DT_LNK)
+      {
+         p = (char*)malloc(strlen(directory) + strlen(entry->d_name) + 2);
+         if (p == NULL)
+         {
+            continue;
+         }
+         sprintf(p, "%s/%s", directory, entry->d_name);
+
+         (*files)++;
+
+         /* A dangling link has no st_blksize to divide by */
+         if (stat(p, &st))
+         {
+            free(p);
+            continue;
+         }
+
+         l = st.st_size / st.st_blksize;
+
+         if (st.st_size % st.st_blksize != 0)
+         {
+            l += 1;
+         }
+
+         total_size += (l * st.st_blksize);
+
+         free(p);
+      }
+   }
+
+   closedir(dir);
+
+   return total_size;
+}
+
+static double
+now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int
+compare_hash(const void* key, const void* entry)
+{
+   uint64_t hash = *(const uint64_t*)key;
+   const struct disk_directory_usage* directory = (const struct disk_directory_usage*)entry;
+
+   if (hash != directory->hash)
+   {
+      return hash < directory->hash ? -1 : 1;
+   }
+
+   return 0;
+}
+
+static void
+usage(void)
+{
+   printf("pgexporter_ext_disk_bench\n");
+   printf("  Benchmark of the directory walker\n");
+   printf("\n");
+   printf("Usage:\n");
+   printf("  pgexporter_ext_disk_bench [ -n FILES ] [ -b DATABASES ] [ -i ITERATIONS ] [ -w WORKERS ] [ -c CHANGES ] [ -d DIRECTORY ] [ -u ] [ -k ]\n");
+   printf("\n");
+   printf("Options:\n");
+   printf("  -n, Number of files of the generated tree (default 1000000)\n");
+   printf("  -b, Number of database directories of the generated tree (default 4)\n");
+   printf("  -i, Number of iterations (default 3)\n");
+   printf("  -w, Walk with pgexporter_ext_disk_walk_roots() and that many threads too\n");
+   printf("  -c, Build the disk cache too, with the -w threads, and create that many files in the generated tree while it is watched\n");
+   printf("  -d, Walk a directory instead\n");
+   printf("  -u, Walk with pgexporter_ext_disk_walk_roots() and io_uring too, with the -w threads\n");
+   printf("  -k, Keep the generated tree\n");
+   printf("  -h, Display help\n");
+}
@@ -0,0 +1,807 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgexporter */
+#include <pgexporter_ext.h>
+#include <histogram.h>
+#include <logs.h>
+#include <marks.h>
+
+/* system */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <bzlib.h>
+#include <lz4frame.h>
+#include <zlib.h>
+#include <zstd.h>
+
+/* The log_line_prefix of the generated corpus */
+#define BENCH_PREFIX "%m [%p] %q%u@%d "
+
+/* The longest statement added to an entry */
+#define BENCH_STATEMENT_SIZE 16384
+
+/** @struct corpus
+ * The shape of a generated log
+ */
+struct corpus
+{
+   size_t size;                        /**< The size in bytes */
+   int format;                         /**< The log format, LOG_FORMAT_* */
+   int weights[NUMBER_OF_SEVERITIES];  /**< The relative frequency of each severity, or all 0 for mostly LOG */
+   int min_message;                    /**< The shortest message */
+   int max_message;                    /**< The longest message */
+   int long_statements;                /**< The percentage of entries followed by a long statement over several lines */
+};
+
+static char* generate_corpus(struct corpus* shape, size_t* length, struct log_counts* expected, uint64_t* durations);
+static size_t write_entry(char* p, struct corpus* shape, int severity, const char* message, const char* statement);
+static size_t write_statement(char* p, int length);
+static int pick_severity(struct corpus* shape);
+static int parse_weights(char* mix, struct corpus* shape);
+static int parse_format(const char* name);
+static const char* format_name(int format);
+static int bench_scan(char* corpus, size_t length, struct log_counts* expected, uint64_t durations, int format,
+                      bool labeled, struct log_patterns* patterns, int iterations);
+static int bench_codecs(char* corpus, size_t length, struct log_counts* expected, int format);
+static int write_file(const char* path, const char* data, size_t length);
+static int write_gz(const char* path, const char* data, size_t length);
+static int write_bz2(const char* path, const char* data, size_t length);
+static int write_lz4(const char* path, const char* data, size_t length);
+static int write_zstd(const char* path, const char* data, size_t length);
+static double now(void);
+static void usage(void);
+
+int
+main(int argc, char** argv)
+{
+   size_t size = 256;
+   int iterations = 10;
+   int workers = 1;
+   bool codecs = false;
+   bool labeled = false;
+   int formats[3] = {LOG_FORMAT_STDERR};
+   int number_of_formats = 1;
+   struct corpus shape;
+   struct log_patterns* patterns = NULL;
+   char* corpus = NULL;
+   size_t length = 0;
+   struct log_counts expected;
+   uint64_t durations;
+   double start;
+   double elapsed;
+   int ret = 0;
+   int c;
+
+   memset(&shape, 0, sizeof(struct corpus));
+   shape.min_message = 20;
+   shape.max_message = 219;
+
+   while ((c = getopt(argc, argv, "s:i:w:clp:d:f:m:L:t:h")) != -1)
+   {
+      switch (c)
+      {
+         case 's':
+            size = strtoul(optarg, NULL, 10);
+            break;
+         case 'i':
+            iterations = atoi(optarg);
+            break;
+         case 'w':
+            workers = atoi(optarg);
+            break;
+         case 'c':
+            codecs = true;
+            break;
+         case 'l':
+            labeled = true;
+            break;
+         case 'p':
+            if (pgexporter_ext_log_patterns_compile(optarg, &patterns))
+            {
+               fprintf(stderr, "Invalid patterns %s\n", optarg);
+               return 1;
+            }
+            break;
+         case 'f':
+            if (strcmp(optarg, "all") == 0)
+            {
+               formats[0] = LOG_FORMAT_STDERR;
+               formats[1] = LOG_FORMAT_CSV;
+               formats[2] = LOG_FORMAT_JSON;
+               number_of_formats = 3;
+            }
+            else if ((formats[0] = parse_format(optarg)) < 0)
+            {
+               fprintf(stderr, "Invalid format %s\n", optarg);
+               return 1;
+            }
+            else
+            {
+               number_of_formats = 1;
+            }
+            break;
+         case 'm':
+            if (parse_weights(optarg, &shape))
+            {
+               fprintf(stderr, "Invalid severity mix %s\n", optarg);
+               return 1;
+            }
+            break;
+         case 'L':
+            if (sscanf(optarg, "%d:%d", &shape.min_message, &shape.max_message) != 2 ||
+                shape.min_message < 1 || shape.max_message < shape.min_message || shape.max_message > BENCH_STATEMENT_SIZE)
+            {
+               fprintf(stderr, "Invalid message lengths %s\n", optarg);
+               return 1;
+            }
+            break;
+         case 't':
+            shape.long_statements = atoi(optarg);
+            if (shape.long_statements < 0 || shape.long_statements > 100)
+            {
+               fprintf(stderr, "Invalid percentage of long statements %s\n", optarg);
+               return 1;
+            }
+            break;
+         case 'd':
+         {
+            struct log_counts counts;
+
+            start = now();
+            if (pgexporter_ext_log_scan_directory(optarg, workers, &counts))
+            {
+               fprintf(stderr, "Failed to scan %s\n", optarg);
+               return 1;
+            }
+            elapsed = now() - start;
+
+            for (int i = 0; i < NUMBER_OF_SEVERITIES; i++)
+            {
+               printf("%-8s %lu\n", pgexporter_ext_log_severity_name(i), (unsigned long)counts.count[i]);
+            }
+            printf("directory: %.3f s\n", elapsed);
+            return 0;
+         }
+         case 'h':
+         default:
+            usage();
+            return c == 'h' ? 0 : 1;
+      }
+   }
+
+   shape.size = size * 1024 * 1024;
+
+   for (int i = 0; ret == 0 && i < number_of_formats; i++)
+   {
+      shape.format = formats[i];
+
+      corpus = generate_corpus(&shape, &length, &expected, &durations);
+      if (corpus == NULL)
+      {
+         fprintf(stderr, "Out of memory\n");
+         ret = 1;
+         break;
+      }
+
+      ret = bench_scan(corpus, length, &expected, durations, shape.format, labeled, patterns, iterations);
+
+      if (ret == 0 && codecs)
+      {
+         ret = bench_codecs(corpus, length, &expected, shape.format);
+      }
+
+      free(corpus);
+   }
+
+   pgexporter_ext_log_patterns_destroy(patterns);
+
+   return ret;
+}
+
+static char*
+generate_corpus(struct corpus* shape, size_t* length, struct log_counts* expected, uint64_t* durations)
+{
+   char* corpus = NULL;
+   char message[BENCH_STATEMENT_SIZE + 64];
+   char statement[2 * BENCH_STATEMENT_SIZE];
+   size_t offset = 0;
+   size_t n;
+   int severity;
+   int size;
+
+   memset(expected, 0, sizeof(struct log_counts));
+   *durations = 0;
+
+   /* Room for the last entry and its statement, escaped */
+   corpus = (char*)malloc(shape->size + 4 * BENCH_STATEMENT_SIZE + 8192);
+   if (corpus == NULL)
+   {
+      return NULL;
+   }
+
+   srand(42);
+
+   while (offset < shape->size)
+   {
+      severity = pick_severity(shape);
+      size = shape->min_message + rand() % (shape->max_message - shape->min_message + 1);
+
+      /* The stderr prefix is drawn first so the default corpus doesn't change */
+      if (shape->format == LOG_FORMAT_STDERR)
+      {
+         offset += snprintf(corpus + offset, 8192, "2026-01-01 12:%02d:%02d.%03d UTC [%d] user%d@db%d %s:  ",
+                            rand() % 60, rand() % 60, rand() % 1000, rand() % 100000, rand() % 8, rand() % 4,
+                            pgexporter_ext_log_severity_name(severity));
+      }
+
+      n = 0;
+
+      /* Some statements are slow enough for log_min_duration_statement */
+      if (severity == SEVERITY_LOG && rand() % 4 == 0)
+      {
+         n = snprintf(message, sizeof(message), "duration: %d.%03d ms  statement: ", rand() % 5000, rand() % 1000);
+         (*durations)++;
+      }
+
+      for (int i = 0; i < size; i++)
+      {
+         message[n++] = 'a' + (i % 26);
+      }
+      message[n] = '\0';
+
+      statement[0] = '\0';
+      if (shape->long_statements > 0 && rand() % 100 < shape->long_statements)
+      {
+         write_statement(statement, 256 + rand() % (BENCH_STATEMENT_SIZE - 256));
+      }
+
+      offset += write_entry(corpus + offset, shape, severity, message, statement);
+
+      expected->count[severity]++;
+   }
+
+   *length = offset;
+
+   return corpus;
+}
+
+static size_t
+write_entry(char* p, struct corpus* shape, int severity, const char* message, const char* statement)
+{
+   char* start = p;
+   const char* s;
+
+   switch (shape->format)
+   {
+      case LOG_FORMAT_CSV:
+         p += sprintf(p, "2026-01-01 12:%02d:%02d.%03d UTC,\"user%d\",\"db%d\",%d,\"10.0.0.%d:5432\",6601a2b3.1f2,1,\"SELECT\","
+                      "2026-01-01 11:00:00 UTC,3/%d,0,%s,00000,\"%s\",,,,,,\"",
+                      rand() % 60, rand() % 60, rand() % 1000, rand() % 8, rand() % 4, rand() % 100000, rand() % 16,
+                      rand() % 1000, pgexporter_ext_log_severity_name(severity), message);
+
+         /* The statement is quoted, so its lines and quotes don't start a record */
+         for (s = statement; *s != '\0'; s++)
+         {
+            if (*s == '"')
+            {
+               *p++ = '"';
+            }
+            *p++ = *s;
+         }
+
+         p += sprintf(p, "\",,,\"psql\",\"client backend\",,0\n");
+         break;
+      case LOG_FORMAT_JSON:
+         p += sprintf(p, "{\"timestamp\":\"2026-01-01 12:%02d:%02d.%03d UTC\",\"user\":\"user%d\",\"dbname\":\"db%d\","
+                      "\"pid\":%d,\"remote_host\":\"10.0.0.%d\",\"error_severity\":\"%s\",\"message\":\"%s\"",
+                      rand() % 60, rand() % 60, rand() % 1000, rand() % 8, rand() % 4, rand() % 100000, rand() % 16,
+                      pgexporter_ext_log_severity_name(severity), message);
+
+         if (*statement != '\0')
+         {
+            p += sprintf(p, ",\"statement\":\"");
+            for (s = statement; *s != '\0'; s++)
+            {
+               if (*s == '\n' || *s == '\t' || *s == '"')
+               {
+                  *p++ = '\\';
+                  *p++ = *s == '\n' ? 'n' : *s == '\t' ? 't' : '"';
+               }
+               else
+               {
+                  *p++ = *s;
+               }
+            }
+            *p++ = '"';
+         }
+
+         p += sprintf(p, ",\"backend_type\":\"client backend\"}\n");
+         break;
+      default:
+         /* The prefix is already written */
+         p += sprintf(p, "%s\n", message);
+
+         /* Lines that belong to the previous entry */
+         if (rand() % 10 == 0)
+         {
+            p += sprintf(p, "2026-01-01 12:00:00.000 UTC [1] STATEMENT:  SELECT 1\n");
+         }
+         if (rand() % 20 == 0)
+         {
+            p += sprintf(p, "\tFROM pg_class\n");
+         }
+         if (*statement != '\0')
+         {
+            p += sprintf(p, "2026-01-01 12:00:00.000 UTC [1] STATEMENT:  %s\n", statement);
+         }
+         break;
+   }
+
+   return p - start;
+}
+
+static size_t
+write_statement(char* p, int length)
+{
+   char* start = p;
+   char* end = p + length;
+   int column = 0;
+
+   p += sprintf(p, "SELECT \"id\", 'x' AS \"label\"");
+
+   /* Short lines of column names, like a generated query */
+   while (p < end)
+   {
+      if (column++ % 6 == 0)
+      {
+         p += sprintf(p, "\n\t");
+      }
+      p += sprintf(p, "c%d, ", column);
+   }
+
+   p += sprintf(p, "\n\tFROM t WHERE v = 'it''s'");
+
+   return p - start;
+}
+
+static int
+pick_severity(struct corpus* shape)
+{
+   int total = 0;
+   int r;
+
+   for (int i = 0; i < NUMBER_OF_SEVERITIES; i++)
+   {
+      total += shape->weights[i];
+   }
+
+   /* Mostly LOG, like a production server */
+   if (total == 0)
+   {
+      return rand() % 100 < 80 ? SEVERITY_LOG : rand() % NUMBER_OF_SEVERITIES;
+   }
+
+   r = rand() % total;
+   for (int i = 0; i < NUMBER_OF_SEVERITIES; i++)
+   {
+      if (r < shape->weights[i])
+      {
+         return i;
+      }
+      r -= shape->weights[i];
+   }
+
+   return SEVERITY_LOG;
+}
+
+static int
+parse_weights(char* mix, struct corpus* shape)
+{
+   char* token;
+   char* value;
+   char* saveptr = NULL;
+   int severity;
+
+   memset(shape->weights, 0, sizeof(shape->weights));
+
+   for (token = strtok_r(mix, ",", &saveptr); token != NULL; token = strtok_r(NULL, ",", &saveptr))
+   {
+      value = strchr(token, '=');
+      if (value == NULL)
+      {
+         return 1;
+      }
+      *value++ = '\0';
+
+      severity = -1;
+      for (int i = 0; i < NUMBER_OF_SEVERITIES; i++)
+      {
+         if (strcasecmp(token, pgexporter_ext_log_severity_name(i)) == 0)
+         {
+            severity = i;
+         }
+      }
+
+      if (severity < 0 || atoi(value) < 0)
+      {
+         return 1;
+      }
+
+      shape->weights[severity] = atoi(value);
+   }
+
+   return 0;
+}
+
+static int
+parse_format(const char* name)
+{
+   for (int format = LOG_FORMAT_STDERR; format <= LOG_FORMAT_JSON; format++)
+   {
+      if (strcmp(name, format_name(format)) == 0)
+      {
+         return format;
+      }
+   }
+
+   return -1;
+}
+
+static const char*
+format_name(int format)
+{
+   switch (format)
+   {
+      case LOG_FORMAT_CSV:
+         return "csv";
+      case LOG_FORMAT_JSON:
+         return "json";
+      default:
+         return "stderr";
+   }
+}
+
+static int
+bench_scan(char* corpus, size_t length, struct log_counts* expected, uint64_t durations, int format,
+           bool labeled, struct log_patterns* patterns, int iterations)
+{
+   struct log_prefix prefix;
+   struct log_file* file = NULL;
+   double start;
+   double elapsed;
+   double best = 0.0;
+   int ret = 0;
+
+   file = (struct log_file*)malloc(sizeof(struct log_file));
+   if (file == NULL)
+   {
+      fprintf(stderr, "Out of memory\n");
+      return 1;
+   }
+
+   pgexporter_ext_log_prefix_compile(BENCH_PREFIX, &prefix);
+
+   for (int i = 0; i < iterations; i++)
+   {
+      memset(file, 0, sizeof(struct log_file));
+      file->format = format;
+      file->prefix = labeled ? &prefix : NULL;
+      file->patterns = patterns;
+
+      start = now();
+      for (size_t offset = 0; offset < length; offset += LOG_BLOCK_SIZE)
+      {
+         size_t n = length - offset < LOG_BLOCK_SIZE ? length - offset : LOG_BLOCK_SIZE;
+
+         pgexporter_ext_log_scan_block(file, corpus + offset, n);
+         file->offset += n;
+      }
+      elapsed = now() - start;
+
+      if (best == 0.0 || elapsed < best)
+      {
+         best = elapsed;
+      }
+
+      if (i < iterations - 1)
+      {
+         free(file->errors);
+         pgexporter_ext_log_labels_destroy(file->labels);
+         free(file->durations);
+         free(file->matches);
+         pgexporter_ext_log_marks_destroy(file->marks);
+      }
+   }
+
+   if (memcmp(&file->counts, expected, sizeof(struct log_counts)) != 0)
+   {
+      fprintf(stderr, "%s: counts differ from the corpus\n", format_name(format));
+      ret = 1;
+   }
+   else if ((file->durations != NULL ? file->durations->count : 0) != durations)
+   {
+      fprintf(stderr, "%s: %lu durations instead of %lu\n", format_name(format),
+              (unsigned long)(file->durations != NULL ? file->durations->count : 0), (unsigned long)durations);
+      ret = 1;
+   }
+   else
+   {
+      printf("scan %s%s%s: %zu MB in %.3f s, %.2f GB/s\n", format_name(format), labeled ? " by label" : "",
+             patterns != NULL ? " with patterns" : "", length / (1024 * 1024), best,
+             (double)length / best / (1024.0 * 1024.0 * 1024.0));
+
+      for (int i = 0; patterns != NULL && file->matches != NULL && i < patterns->size; i++)
+      {
+         printf("%-16s %lu\n", patterns->names[i], (unsigned long)file->matches[i]);
+      }
+   }
+
+   free(file->errors);
+   pgexporter_ext_log_labels_destroy(file->labels);
+   free(file->durations);
+   free(file->matches);
+   pgexporter_ext_log_marks_destroy(file->marks);
+   free(file);
+
+   return ret;
+}
+
+static int
+bench_codecs(char* corpus, size_t length, struct log_counts* expected, int format)
+{
+   static const struct
+   {
+      const char* name;
+      const char* suffix;
+      int (*write)(const char* path, const char* data, size_t length);
+   } codecs[] = {
+      {"plain", "", write_file},
+      {"gzip", ".gz", write_gz},
+      {"bzip2", ".bz2", write_bz2},
+      {"lz4", ".lz4", write_lz4},
+      {"zstd", ".zst", write_zstd},
+   };
+   char directory[] = "/tmp/pgexporter_ext_bench.XXXXXX";
+   char path[MAX_PATH];
+   struct log_counts counts;
+   struct stat st;
+   double start;
+   double elapsed;
+
+   if (mkdtemp(directory) == NULL)
+   {
+      fprintf(stderr, "Failed to create a temporary directory\n");
+      return 1;
+   }
+
+   for (size_t i = 0; i < sizeof(codecs) / sizeof(codecs[0]); i++)
+   {
+      /* The suffix selects both the format and the decoder */
+      snprintf(path, sizeof(path), "%s/postgresql.%s%s", directory,
+               format == LOG_FORMAT_STDERR ? "log" : format_name(format), codecs[i].suffix);
+
+      if (codecs[i].write(path, corpus, length) || stat(path, &st))
+      {
+         fprintf(stderr, "Failed to write %s\n", path);
+         goto error;
+      }
+
+      memset(&counts, 0, sizeof(struct log_counts));
+
+      start = now();
+      if (pgexporter_ext_log_scan_file(path, &counts))
+      {
+         fprintf(stderr, "Failed to scan %s\n", path);
+         goto error;
+      }
+      elapsed = now() - start;
+
+      unlink(path);
+
+      if (memcmp(&counts, expected, sizeof(struct log_counts)) != 0)
+      {
+         fprintf(stderr, "%s %s: counts differ from the corpus\n", format_name(format), codecs[i].name);
+         goto error;
+      }
+
+      printf("%-6s %-6s %8.1f MB/s %6.1f%%\n", format_name(format), codecs[i].name,
+             (double)length / elapsed / (1024.0 * 1024.0), 100.0 * st.st_size / length);
+   }
+
+   rmdir(directory);
+
+   return 0;
+
+error:
+
+   unlink(path);
+   rmdir(directory);
+
+   return 1;
+}
+
+static int
+write_file(const char* path, const char* data, size_t length)
+{
+   FILE* fp;
+   size_t n;
+
+   fp = fopen(path, "wb");
+   if (fp == NULL)
+   {
+      return 1;
+   }
+
+   n = fwrite(data, 1, length, fp);
+   fclose(fp);
+
+   return n != length;
+}
+
+static int
+write_gz(const char* path, const char* data, size_t length)
+{
+   gzFile gz;
+   size_t offset = 0;
+   unsigned int n;
+
+   gz = gzopen(path, "wb");
+   if (gz == NULL)
+   {
+      return 1;
+   }
+
+   while (offset < length)
+   {
+      n = length - offset < LOG_BLOCK_SIZE ? length - offset : LOG_BLOCK_SIZE;
+      if (gzwrite(gz, data + offset, n) != (int)n)
+      {
+         gzclose(gz);
+         return 1;
+      }
+      offset += n;
+   }
+
+   return gzclose(gz) != Z_OK;
+}
+
+static int
+write_bz2(const char* path, const char* data, size_t length)
+{
+   FILE* fp;
+   BZFILE* bz;
+   int bzerror;
+   size_t offset = 0;
+   int n;
+
+   fp = fopen(path, "wb");
+   if (fp == NULL)
+   {
+      return 1;
+   }
+
+   bz = BZ2_bzWriteOpen(&bzerror, fp, 9, 0, 0);
+   while (bzerror == BZ_OK && offset < length)
+   {
+      n = length - offset < LOG_BLOCK_SIZE ? length - offset : LOG_BLOCK_SIZE;
+      BZ2_bzWrite(&bzerror, bz, (void*)(data + offset), n);
+      offset += n;
+   }
+   BZ2_bzWriteClose(&bzerror, bz, 0, NULL, NULL);
+   fclose(fp);
+
+   return bzerror != BZ_OK;
+}
+
+static int
+write_lz4(const char* path, const char* data, size_t length)
+{
+   char* out = NULL;
+   size_t bound;
+   size_t n;
+   int ret;
+
+   bound = LZ4F_compressFrameBound(length, NULL);
+   out = (char*)malloc(bound);
+   if (out == NULL)
+   {
+      return 1;
+   }
+
+   n = LZ4F_compressFrame(out, bound, data, length, NULL);
+   ret = LZ4F_isError(n) ? 1 : write_file(path, out, n);
+
+   free(out);
+
+   return ret;
+}
+
+static int
+write_zstd(const char* path, const char* data, size_t length)
+{
+   char* out = NULL;
+   size_t bound;
+   size_t n;
+   int ret;
+
+   bound = ZSTD_compressBound(length);
+   out = (char*)malloc(bound);
+   if (out == NULL)
+   {
+      return 1;
+   }
+
+   n = ZSTD_compress(out, bound, data, length, 3);
+   ret = ZSTD_isError(n) ? 1 : write_file(path, out, n);
+
+   free(out);
+
+   return ret;
+}
+
+static double
+now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+usage(void)
+{
+   printf("pgexporter_ext_bench\n");
+   printf("  Benchmark of the log scanner\n");
+   printf("\n");
+   printf("Usage:\n");
+   printf("  pgexporter_ext_bench [ -s MB ] [ -i ITERATIONS ] [ -w WORKERS ] [ -f FORMAT ] [ -m MIX ] [ -L MIN:MAX ]\n");
+   printf("                       [ -t PERCENT ] [ -c ] [ -l ] [ -p PATTERNS ] [ -d DIRECTORY ]\n");
+   printf("\n");
+   printf("Options:\n");
+   printf("  -s, Size of the generated corpus in MB (default 256)\n");
+   printf("  -i, Number of iterations (default 10)\n");
+   printf("  -w, Number of threads for -d (default 1)\n");
+   printf("  -f, Format of the corpus: stderr, csv, json or all (default stderr)\n");
+   printf("  -m, Severity mix written as SEVERITY=weight,SEVERITY=weight (default 80%% LOG)\n");
+   printf("  -L, Shortest and longest message in bytes (default 20:219)\n");
+   printf("  -t, Percentage of entries followed by a long statement over several lines (default 0)\n");
+   printf("  -c, Benchmark the decoding of each compression format, and check its counts\n");
+   printf("  -l, Count the lines by database and user too\n");
+   printf("  -p, Count the messages matching patterns written as name=text;name=text too\n");
+   printf("  -d, Scan the log files in a directory instead\n");
+   printf("  -h, Display help\n");
+}
@@ -0,0 +1,183 @@
+-- The counters of the hook are since startup, so they can pass 2^31
+DROP FUNCTION pgexporter_ext_log_debug5();
+DROP FUNCTION pgexporter_ext_log_debug4();
+DROP FUNCTION pgexporter_ext_log_debug3();
+DROP FUNCTION pgexporter_ext_log_debug2();
+DROP FUNCTION pgexporter_ext_log_debug1();
+DROP FUNCTION pgexporter_ext_log_info();
+DROP FUNCTION pgexporter_ext_log_notice();
+DROP FUNCTION pgexporter_ext_log_warning();
+DROP FUNCTION pgexporter_ext_log_error();
+DROP FUNCTION pgexporter_ext_log_log();
+DROP FUNCTION pgexporter_ext_log_fatal();
+DROP FUNCTION pgexporter_ext_log_panic();
+
+CREATE FUNCTION pgexporter_ext_log_debug5() RETURNS bigint
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION pgexporter_ext_log_debug4() RETURNS bigint
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION pgexporter_ext_log_debug3() RETURNS bigint
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION pgexporter_ext_log_debug2() RETURNS bigint
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION pgexporter_ext_log_debug1() RETURNS bigint
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION pgexporter_ext_log_info() RETURNS bigint
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION pgexporter_ext_log_notice() RETURNS bigint
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION pgexporter_ext_log_warning() RETURNS bigint
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION pgexporter_ext_log_error() RETURNS bigint
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION pgexporter_ext_log_log() RETURNS bigint
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION pgexporter_ext_log_fatal() RETURNS bigint
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION pgexporter_ext_log_panic() RETURNS bigint
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+
+REVOKE ALL ON FUNCTION pgexporter_ext_log_debug5() FROM PUBLIC;
+REVOKE ALL ON FUNCTION pgexporter_ext_log_debug4() FROM PUBLIC;
+REVOKE ALL ON FUNCTION pgexporter_ext_log_debug3() FROM PUBLIC;
+REVOKE ALL ON FUNCTION pgexporter_ext_log_debug2() FROM PUBLIC;
+REVOKE ALL ON FUNCTION pgexporter_ext_log_debug1() FROM PUBLIC;
+REVOKE ALL ON FUNCTION pgexporter_ext_log_info() FROM PUBLIC;
+REVOKE ALL ON FUNCTION pgexporter_ext_log_notice() FROM PUBLIC;
+REVOKE ALL ON FUNCTION pgexporter_ext_log_warning() FROM PUBLIC;
+REVOKE ALL ON FUNCTION pgexporter_ext_log_error() FROM PUBLIC;
+REVOKE ALL ON FUNCTION pgexporter_ext_log_log() FROM PUBLIC;
+REVOKE ALL ON FUNCTION pgexporter_ext_log_fatal() FROM PUBLIC;
+REVOKE ALL ON FUNCTION pgexporter_ext_log_panic() FROM PUBLIC;
+
+GRANT EXECUTE ON FUNCTION pgexporter_ext_log_debug5() TO pg_monitor;
+GRANT EXECUTE ON FUNCTION pgexporter_ext_log_debug4() TO pg_monitor;
+GRANT EXECUTE ON FUNCTION pgexporter_ext_log_debug3() TO pg_monitor;
+GRANT EXECUTE ON FUNCTION pgexporter_ext_log_debug2() TO pg_monitor;
+GRANT EXECUTE ON FUNCTION pgexporter_ext_log_debug1() TO pg_monitor;
+GRANT EXECUTE ON FUNCTION pgexporter_ext_log_info() TO pg_monitor;
+GRANT EXECUTE ON FUNCTION pgexporter_ext_log_notice() TO pg_monitor;
+GRANT EXECUTE ON FUNCTION pgexporter_ext_log_warning() TO pg_monitor;
+GRANT EXECUTE ON FUNCTION pgexporter_ext_log_error() TO pg_monitor;
+GRANT EXECUTE ON FUNCTION pgexporter_ext_log_log() TO pg_monitor;
+GRANT EXECUTE ON FUNCTION pgexporter_ext_log_fatal() TO pg_monitor;
+GRANT EXECUTE ON FUNCTION pgexporter_ext_log_panic() TO pg_monitor;
+
+CREATE FUNCTION pgexporter_ext_log_counts(OUT severity text, OUT count bigint)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+
+REVOKE ALL ON FUNCTION pgexporter_ext_log_counts FROM PUBLIC;
+GRANT EXECUTE ON FUNCTION pgexporter_ext_log_counts TO pg_monitor;
+
+CREATE FUNCTION pgexporter_ext_log_rate(IN span interval DEFAULT '5 minutes', OUT severity text, OUT count bigint, OUT rate float8)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+
+REVOKE ALL ON FUNCTION pgexporter_ext_log_rate FROM PUBLIC;
+GRANT EXECUTE ON FUNCTION pgexporter_ext_log_rate TO pg_monitor;
+
+CREATE FUNCTION pgexporter_ext_log_top_errors(IN k integer DEFAULT 10, OUT fingerprint text, OUT sqlstate text, OUT message text, OUT count bigint, OUT error bigint)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+
+REVOKE ALL ON FUNCTION pgexporter_ext_log_top_errors FROM PUBLIC;
+GRANT EXECUTE ON FUNCTION pgexporter_ext_log_top_errors TO pg_monitor;
+
+CREATE FUNCTION pgexporter_ext_log_counts_by_label(OUT database text, OUT username text, OUT application_name text, OUT remote_host text, OUT severity text, OUT count bigint)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+
+REVOKE ALL ON FUNCTION pgexporter_ext_log_counts_by_label FROM PUBLIC;
+GRANT EXECUTE ON FUNCTION pgexporter_ext_log_counts_by_label TO pg_monitor;
+
+CREATE FUNCTION pgexporter_ext_log_durations(OUT count bigint, OUT sum double precision, OUT p50 double precision, OUT p95 double precision, OUT p99 double precision, OUT max double precision)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+
+REVOKE ALL ON FUNCTION pgexporter_ext_log_durations FROM PUBLIC;
+GRANT EXECUTE ON FUNCTION pgexporter_ext_log_durations TO pg_monitor;
+
+CREATE FUNCTION pgexporter_ext_log_pattern_counts(OUT name text, OUT pattern text, OUT count bigint)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+
+REVOKE ALL ON FUNCTION pgexporter_ext_log_pattern_counts FROM PUBLIC;
+GRANT EXECUTE ON FUNCTION pgexporter_ext_log_pattern_counts TO pg_monitor;
+
+CREATE FUNCTION pgexporter_ext_recent_errors(IN n integer DEFAULT 10, OUT file text, OUT severity text, OUT line text)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+
+REVOKE ALL ON FUNCTION pgexporter_ext_recent_errors FROM PUBLIC;
+GRANT EXECUTE ON FUNCTION pgexporter_ext_recent_errors TO pg_monitor;
+
+CREATE FUNCTION pgexporter_ext_log_counts_between(IN from_time timestamptz, IN to_time timestamptz, OUT severity text, OUT count bigint)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+
+REVOKE ALL ON FUNCTION pgexporter_ext_log_counts_between FROM PUBLIC;
+GRANT EXECUTE ON FUNCTION pgexporter_ext_log_counts_between TO pg_monitor;
+
+CREATE FUNCTION pgexporter_ext_log_scan_status(OUT stale boolean, OUT bytes bigint, OUT elapsed bigint)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+
+REVOKE ALL ON FUNCTION pgexporter_ext_log_scan_status FROM PUBLIC;
+GRANT EXECUTE ON FUNCTION pgexporter_ext_log_scan_status TO pg_monitor;
+
+CREATE FUNCTION pgexporter_ext_disk_usage(OUT name text, OUT oid oid, OUT path text, OUT bytes bigint, OUT files bigint, OUT directories bigint)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+
+REVOKE ALL ON FUNCTION pgexporter_ext_disk_usage FROM PUBLIC;
+GRANT EXECUTE ON FUNCTION pgexporter_ext_disk_usage TO pg_monitor;
+
+CREATE FUNCTION pgexporter_ext_data_directory_breakdown(OUT name text, OUT database oid, OUT tablespace oid, OUT path text, OUT bytes bigint, OUT files bigint, OUT directories bigint)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+
+REVOKE ALL ON FUNCTION pgexporter_ext_data_directory_breakdown FROM PUBLIC;
+GRANT EXECUTE ON FUNCTION pgexporter_ext_data_directory_breakdown TO pg_monitor;
+
+CREATE FUNCTION pgexporter_ext_filesystems(OUT mount_point text, OUT device text, OUT type text, OUT source text, OUT directories text[], OUT total bigint, OUT free bigint, OUT available bigint, OUT inodes bigint, OUT inodes_free bigint, OUT inodes_available bigint)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+
+REVOKE ALL ON FUNCTION pgexporter_ext_filesystems FROM PUBLIC;
+GRANT EXECUTE ON FUNCTION pgexporter_ext_filesystems TO pg_monitor;
@@ -0,0 +1,284 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGEXPORTER_EXT_DISK_H
+#define PGEXPORTER_EXT_DISK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pgexporter_ext.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define DISK_STACK_SIZE   64
+#define DISK_BATCH_NAMES  512
+#define DISK_BATCH_SIZE   16384
+#define DISK_NAME_SIZE    64
+
+#define MAX_DISK_WORKERS  64
+
+#define DISK_CACHE_DIRECTORIES 4096
+
+#define DISK_MOUNTINFO    "/proc/self/mountinfo"
+#define DISK_TYPE_SIZE    64
+
+/** @struct disk_usage
+ * The space used by a directory tree
+ */
+struct disk_usage
+{
+   uint64_t bytes;         /**< The allocated bytes, from st_blocks */
+   uint64_t files;         /**< The number of files, symbolic links included */
+   uint64_t directories;   /**< The number of directories, the root included */
+};
+
+/** @struct disk_root
+ * A directory tree walked by pgexporter_ext_disk_walk_roots()
+ */
+struct disk_root
+{
+   char name[DISK_NAME_SIZE];   /**< The name, f.ex. data_directory */
+   unsigned int oid;            /**< The OID of a tablespace, or 0 */
+   unsigned int database;       /**< The OID of a database, or 0 */
+   char path[MAX_PATH];         /**< The path */
+   char skip[DISK_NAME_SIZE];   /**< An entry of the root that is walked as a root of its own, or empty */
+   struct disk_usage usage;     /**< The resulting usage */
+   int result;                  /**< 0 if the root was walked, otherwise 1 */
+};
+
+/** @struct disk_directory_usage
+ * The usage of a directory tree, keyed by the hash of its path
+ */
+struct disk_directory_usage
+{
+   uint64_t hash;            /**< The hash of the path */
+   struct disk_usage usage;  /**< The usage of the tree */
+};
+
+/** @struct disk_node
+ * A directory of a cache
+ */
+struct disk_node
+{
+   int parent;               /**< The parent, or -1 for a root */
+   int wd;                   /**< The inotify watch, or -1 */
+   int depth;                /**< The depth below the root */
+   bool used;                /**< Is the directory still in the tree */
+   bool changed;             /**< Were entries added or removed since it was stat'ed */
+   uint64_t hash;            /**< The hash of the path */
+   uint64_t blocks;          /**< The allocated 512 byte blocks of the directory itself */
+   char* name;               /**< The name, or the path of a root */
+   struct disk_usage usage;  /**< The usage of the tree below it */
+};
+
+/** @struct disk_file
+ * A file of a cache
+ */
+struct disk_file
+{
+   uint64_t key;             /**< The hash of the directory and the name, or 0 for a free slot */
+   int node;                 /**< The directory */
+   uint64_t blocks;          /**< The allocated 512 byte blocks */
+};
+
+/** @struct disk_cache
+ * The usage of directory trees kept up to date from inotify events. Every
+ * directory is watched, and every file is remembered with its size, so an
+ * event only stats the entry it names and adds the difference to the
+ * directories above it
+ */
+struct disk_cache
+{
+   int fd;                    /**< The inotify descriptor, or -1 when the trees aren't watched */
+   struct disk_node* nodes;   /**< The directories, a parent always before its children */
+   int number_of_nodes;       /**< The number of directories */
+   int nodes_capacity;        /**< The capacity of the directories */
+   int* watches;              /**< The directory of each watch descriptor, or -1 */
+   int watches_capacity;      /**< The capacity of the watches */
+   struct disk_file* files;   /**< The files, an open addressing table */
+   size_t number_of_files;    /**< The number of files */
+   size_t files_capacity;     /**< The capacity of the files, a power of two */
+   bool complete;             /**< Is every directory watched */
+   bool stale;                /**< Were events lost, so the trees must be walked again */
+   bool attached;             /**< Was a directory added by an event during the build */
+   bool (*interrupted)(void); /**< Is the build to be stopped, or NULL */
+};
+
+/** @struct disk_mount
+ * A mount of /proc/self/mountinfo
+ */
+struct disk_mount
+{
+   unsigned int major;          /**< The major number of the device */
+   unsigned int minor;          /**< The minor number of the device */
+   char mount_point[MAX_PATH];  /**< The mount point */
+   char type[DISK_TYPE_SIZE];   /**< The type of the file system */
+   char source[MAX_PATH];       /**< The source, f.ex. /dev/sda1 */
+};
+
+/** @struct disk_filesystem
+ * The space and inodes of a file system, and the directories on it
+ */
+struct disk_filesystem
+{
+   unsigned long device;        /**< The device, from st_dev */
+   bool mounted;                /**< Was its mount found */
+   struct disk_mount mount;     /**< The mount */
+   uint64_t total;              /**< The size in bytes */
+   uint64_t free;               /**< The free bytes */
+   uint64_t available;          /**< The bytes available to unprivileged users */
+   uint64_t inodes;             /**< The number of inodes */
+   uint64_t inodes_free;        /**< The free inodes */
+   uint64_t inodes_available;   /**< The inodes available to unprivileged users */
+   int result;                  /**< 0 if statvfs() succeeded, otherwise 1 */
+   int number_of_names;         /**< The number of directories */
+   char** names;                /**< The names of the directories, f.ex. pg_wal */
+};
+
+/**
+ * Walk a directory tree and add up the space allocated to it, like du.
+ * Symbolic links are counted but not followed, and entries removed during
+ * the walk are skipped
+ * @param path The root of the tree
+ * @param usage The resulting usage
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_ext_disk_walk(const char* path, struct disk_usage* usage);
+
+/**
+ * Walk several directory trees at the same time with up to workers threads.
+ * The entries of each directory are split in batches of DISK_BATCH_NAMES, and a
+ * thread without batches steals them from the others, so even a single large
+ * directory is stat'ed by all threads. With io_uring each thread stats a batch
+ * with a single io_uring_enter(), and falls back to fstatat() when the kernel
+ * doesn't allow it or the ring fails. A root that can't be opened gets a result of 1
+ * @param roots The roots
+ * @param number_of_roots The number of roots
+ * @param workers The maximum number of threads
+ * @param io_uring Stat the entries with io_uring when it is available
+ * @param interrupted Is the walk to be stopped, called from the walking threads, or NULL
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_ext_disk_walk_roots(struct disk_root* roots, int number_of_roots, int workers, bool io_uring, bool (*interrupted)(void));
+
+/**
+ * Hash a path the way the directories of a cache are keyed
+ * @param path The path, without a trailing /
+ * @return The hash
+ */
+uint64_t
+pgexporter_ext_disk_path_hash(const char* path);
+
+/**
+ * Create a cache
+ * @return The cache, or NULL upon failure
+ */
+struct disk_cache*
+pgexporter_ext_disk_cache_create(void);
+
+/**
+ * Walk directory trees into a cache and watch their directories,
+ * replacing what the cache had. A root that can't be opened is left out.
+ * The trees are walked by threads like pgexporter_ext_disk_walk_roots(),
+ * which apply the events of the directories already watched as they go.
+ * A stopped build leaves the cache stale
+ * @param cache The cache
+ * @param paths The roots, resolved with realpath()
+ * @param number_of_paths The number of roots
+ * @param workers The maximum number of threads
+ * @param io_uring Stat the entries with io_uring when it is available
+ * @param interrupted Is the build to be stopped, called from the walking threads, or NULL
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_ext_disk_cache_build(struct disk_cache* cache, char** paths, int number_of_paths, int workers, bool io_uring,
+                                bool (*interrupted)(void));
+
+/**
+ * Apply the pending events to a cache without blocking. When events
+ * were lost the cache is marked stale
+ * @param cache The cache
+ * @return The number of events read
+ */
+int
+pgexporter_ext_disk_cache_process(struct disk_cache* cache);
+
+/**
+ * Get the usage of the directories of a cache sorted by hash. When there
+ * are more than max directories the deepest ones are left out
+ * @param cache The cache
+ * @param directories The resulting directories
+ * @param max The room in directories
+ * @return The number of directories
+ */
+int
+pgexporter_ext_disk_cache_directories(struct disk_cache* cache, struct disk_directory_usage* directories, int max);
+
+/**
+ * Destroy a cache
+ * @param cache The cache
+ */
+void
+pgexporter_ext_disk_cache_destroy(struct disk_cache* cache);
+
+/**
+ * Read the mounts of a mountinfo file. The escapes of the mount points, f.ex.
+ * \040 for a space, are decoded
+ * @param mountinfo The file, f.ex. DISK_MOUNTINFO
+ * @param mounts The resulting mounts, allocated with malloc
+ * @param number_of_mounts The resulting number of mounts
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_ext_disk_mounts(const char* mountinfo, struct disk_mount** mounts, int* number_of_mounts);
+
+/**
+ * Find the mount of a path: the longest mount point holding it, preferably
+ * of the device of the path. When a mount point is mounted over, the last
+ * mount wins
+ * @param mounts The mounts
+ * @param number_of_mounts The number of mounts
+ * @param path The path, with links resolved
+ * @param major The major number of the device of the path
+ * @param minor The minor number of the device of the path
+ * @return The index of the mount, or -1
+ */
+int
+pgexporter_ext_disk_mount(struct disk_mount* mounts, int number_of_mounts, const char* path, unsigned int major, unsigned int minor);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGEXPORTER_EXT_HISTOGRAM_H
+#define PGEXPORTER_EXT_HISTOGRAM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pgexporter_ext.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define HISTOGRAM_SUB_BITS  5
+#define HISTOGRAM_MAX_BITS  40
+#define HISTOGRAM_BUCKETS   ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+
+/** @struct log_histogram
+ * A log-linear histogram of durations in microseconds. Each power of two is
+ * split into 32 buckets, so a quantile is within 1.6% of the exact value
+ */
+struct log_histogram
+{
+   uint64_t count;                        /**< The number of values */
+   uint64_t sum;                          /**< The sum of the values */
+   uint64_t min;                          /**< The smallest value */
+   uint64_t max;                          /**< The largest value */
+   uint64_t buckets[HISTOGRAM_BUCKETS];   /**< The counts per bucket */
+};
+
+/**
+ * Add a value to a histogram. Values from 2^40 microseconds, about 12 days,
+ * share the last bucket
+ * @param histogram The histogram
+ * @param value The value
+ */
+void
+pgexporter_ext_histogram_add(struct log_histogram* histogram, uint64_t value);
+
+/**
+ * Merge a histogram into another
+ * @param histogram The histogram to merge into
+ * @param other The histogram to merge
+ */
+void
+pgexporter_ext_histogram_merge(struct log_histogram* histogram, struct log_histogram* other);
+
+/**
+ * Get a quantile of a histogram
+ * @param histogram The histogram
+ * @param quantile The quantile, between 0 and 1
+ * @return The value, or 0 for an empty histogram
+ */
+uint64_t
+pgexporter_ext_histogram_quantile(struct log_histogram* histogram, double quantile);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
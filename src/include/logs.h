@@ -0,0 +1,509 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGEXPORTER_EXT_LOGS_H
+#define PGEXPORTER_EXT_LOGS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pgexporter_ext.h>
+#include <histogram.h>
+#include <patterns.h>
+#include <topk.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/types.h>
+
+#define SEVERITY_DEBUG5   0
+#define SEVERITY_DEBUG4   1
+#define SEVERITY_DEBUG3   2
+#define SEVERITY_DEBUG2   3
+#define SEVERITY_DEBUG1   4
+#define SEVERITY_INFO     5
+#define SEVERITY_NOTICE   6
+#define SEVERITY_WARNING  7
+#define SEVERITY_ERROR    8
+#define SEVERITY_LOG      9
+#define SEVERITY_FATAL    10
+#define SEVERITY_PANIC    11
+
+#define NUMBER_OF_SEVERITIES 12
+
+#define LOG_BLOCK_SIZE    (256 * 1024)
+#define LOG_BUFFER_SIZE   (2 * LOG_BLOCK_SIZE)
+#define LOG_PARTIAL_SIZE  8192
+#define LOG_MAP_SIZE      (16 * 1024 * 1024)
+
+#define MAX_SCAN_WORKERS  64
+
+#define LOG_INDEX_FILE    "pgexporter_ext.index"
+
+#define LOG_FORMAT_STDERR 0
+#define LOG_FORMAT_CSV    1
+#define LOG_FORMAT_JSON   2
+
+#define CSV_USER_FIELD        1
+#define CSV_DATABASE_FIELD    2
+#define CSV_HOST_FIELD        4
+#define CSV_SEVERITY_FIELD    11
+#define CSV_SQLSTATE_FIELD    12
+#define CSV_MESSAGE_FIELD     13
+#define CSV_APPLICATION_FIELD 22
+
+#define LOG_LABEL_DATABASE    0
+#define LOG_LABEL_USER        1
+#define LOG_LABEL_APPLICATION 2
+#define LOG_LABEL_HOST        3
+#define LOG_FIELD_SQLSTATE    4
+
+#define NUMBER_OF_LABELS      4
+#define NUMBER_OF_FIELDS      5
+
+#define LOG_LABEL_SIZE        64
+#define LOG_LABELS_MAX        1024
+#define LOG_LABEL_OTHER       "[other]"
+
+#define LOG_PREFIX_STEPS      32
+#define LOG_PREFIX_TEXT_SIZE  32
+
+#define LOG_DURATION_SIZE     32
+
+#define LOG_RECENT_MAX        1000
+#define LOG_RECENT_BYTES      (64 * 1024 * 1024)
+#define LOG_ENTRY_SIZE        1024
+#define LOG_FILE_NAME_SIZE    256
+
+#define LOG_PREFIX_TEXT       -1
+#define LOG_PREFIX_SKIP       -2
+
+/** @struct log_counts
+ * The number of log lines per severity
+ */
+struct log_counts
+{
+   uint64_t count[NUMBER_OF_SEVERITIES]; /**< The count indexed by severity */
+};
+
+/** @struct log_prefix_step
+ * A step of a compiled log_line_prefix
+ */
+struct log_prefix_step
+{
+   int kind;                        /**< LOG_PREFIX_TEXT, LOG_PREFIX_SKIP or the LOG_LABEL_* or LOG_FIELD_* of an escape */
+   bool padded;                     /**< Is the escape padded with spaces */
+   char text[LOG_PREFIX_TEXT_SIZE]; /**< The literal text */
+   size_t length;                   /**< The length of the literal text */
+   size_t anchor;                   /**< The character of the text searched for */
+};
+
+/** @struct log_prefix
+ * A log_line_prefix compiled into the steps that extract the labels and the SQLSTATE of a line
+ */
+struct log_prefix
+{
+   int size;                                     /**< The number of steps */
+   bool labeled;                                 /**< Does the prefix contain any label */
+   bool sqlstate;                                /**< Does the prefix contain the SQLSTATE */
+   int forward;                                  /**< The steps matched from the start of a line */
+   int backward;                                 /**< The first step matched from the end of the prefix */
+   struct log_prefix_step steps[LOG_PREFIX_STEPS]; /**< The steps */
+};
+
+/** @struct log_label_key
+ * The values of the labels of a line, and of the other fields extracted from its prefix
+ */
+struct log_label_key
+{
+   const char* values[NUMBER_OF_FIELDS]; /**< The values indexed by LOG_LABEL_* and LOG_FIELD_* */
+   size_t lengths[NUMBER_OF_FIELDS];     /**< The lengths of the values, at most LOG_LABEL_SIZE - 1 */
+};
+
+/** @struct log_label
+ * The counts of a combination of labels
+ */
+struct log_label
+{
+   uint64_t hash;                                   /**< The hash of the values, 0 for a free slot */
+   char values[NUMBER_OF_LABELS][LOG_LABEL_SIZE];   /**< The values indexed by LOG_LABEL_*, empty when unknown */
+   struct log_counts counts;                        /**< The counts */
+};
+
+/** @struct log_labels
+ * A hash table of label combinations
+ */
+struct log_labels
+{
+   int size;                   /**< The number of combinations */
+   int capacity;               /**< The number of slots, a power of two */
+   struct log_label* entries;  /**< The slots */
+};
+
+/** @struct log_entry
+ * A log entry found by a search for the most recent errors
+ */
+struct log_entry
+{
+   int severity;                  /**< The severity */
+   char file[LOG_FILE_NAME_SIZE]; /**< The name of the log file */
+   char line[LOG_ENTRY_SIZE];     /**< The first line of the entry, truncated */
+};
+
+/** @struct log_file
+ * The scan cursor of a log file
+ */
+struct log_file
+{
+   dev_t device;                  /**< The device */
+   ino_t inode;                   /**< The inode */
+   off_t size;                    /**< The size at the last scan */
+   time_t mtime;                  /**< The modification time at the last scan */
+   off_t offset;                  /**< The number of bytes consumed */
+   bool compressed;               /**< Is the file compressed */
+   int format;                    /**< The log format, LOG_FORMAT_* */
+   bool seen;                     /**< Was the file seen in the current scan */
+   char partial[LOG_PARTIAL_SIZE]; /**< The start of an incomplete trailing line */
+   size_t partial_length;         /**< The length of the incomplete trailing line */
+   bool quoted;                   /**< Is the csvlog scan inside a quoted field */
+   bool closed;                   /**< Did the last csvlog character close a quoted field */
+   int field;                     /**< The csvlog field of the current record */
+   char token[16];                /**< The csvlog severity read so far */
+   size_t token_length;           /**< The length of the csvlog severity read so far */
+   bool error;                    /**< Is the current csvlog record an error */
+   char sqlstate[SQLSTATE_SIZE];  /**< The SQLSTATE of the current csvlog record */
+   struct log_fingerprint fingerprint; /**< The message of the current csvlog record */
+   int severity;                  /**< The severity of the current csvlog record, or -1 */
+   char values[NUMBER_OF_LABELS][LOG_LABEL_SIZE]; /**< The labels of the current csvlog record */
+   char duration[LOG_DURATION_SIZE]; /**< The start of the message of the current csvlog LOG record */
+   size_t duration_length;        /**< The length of the start of the message */
+   const struct log_prefix* prefix; /**< The compiled log_line_prefix, or NULL */
+   bool labeled;                  /**< Are the lines counted by label */
+   const struct log_patterns* patterns; /**< The patterns counted in the messages, or NULL */
+   int pattern_state;             /**< The automaton state in the message of the current csvlog record */
+   uint64_t pattern_found;        /**< The patterns found in the message of the current csvlog record */
+   struct log_counts counts;      /**< The counts of the file */
+   struct log_topk* errors;       /**< The most frequent errors of the file, or NULL */
+   struct log_labels* labels;     /**< The counts by label of the file, or NULL */
+   struct log_histogram* durations; /**< The statement durations of the file, or NULL */
+   uint64_t* matches;             /**< The number of messages matching each pattern, or NULL */
+   struct log_marks* marks;       /**< The sparse index of the entry times, or NULL */
+   int64_t next_mark;             /**< The decoded offset from which the next mark is placed */
+   bool midline;                  /**< Does the next block continue a line */
+   int64_t frame_input;           /**< The offset in the file of the frame being decoded */
+   int64_t frame_output;          /**< The decoded offset of the frame being decoded */
+   struct log_stream* stream;     /**< The decoder of a compressed file whose scan was stopped, or NULL */
+   struct log_file* next;         /**< The next file */
+};
+
+/** @struct log_state
+ * The scan state of a log directory
+ */
+struct log_state
+{
+   struct log_file* files; /**< The known files */
+   char* buffer;           /**< The decoded block followed by the compressed input */
+   int workers;            /**< The maximum number of threads scanning files */
+   char index[MAX_PATH];   /**< The index of the compressed files, or empty */
+   bool index_loaded;      /**< Was the index loaded */
+   bool index_dirty;       /**< Does the index need to be written */
+   bool labeled;           /**< Are the lines counted by label */
+   struct log_prefix prefix; /**< The compiled log_line_prefix */
+   struct log_patterns* patterns; /**< The patterns counted in the messages, or NULL */
+   uint64_t patterns_hash;  /**< The hash of the list of patterns */
+   int64_t max_bytes;       /**< The number of bytes read after which a scan stops, or 0 */
+   int64_t max_time;        /**< The number of milliseconds after which a scan stops, or 0 */
+   bool (*interrupted)(void); /**< Is the scan to be stopped, called from the scanning threads, or NULL */
+   bool stale;              /**< Did the last scan stop before the end of the files */
+   int64_t scanned;         /**< The number of bytes read by the last scan */
+   int64_t elapsed;         /**< The duration of the last scan in milliseconds */
+};
+
+/**
+ * Get the name of a severity
+ * @param severity The severity
+ * @return The name, or NULL
+ */
+const char*
+pgexporter_ext_log_severity_name(int severity);
+
+/**
+ * Classify a log line
+ * @param line The line
+ * @param length The length of the line
+ * @return The severity, or -1 if the line doesn't start a log entry
+ */
+int
+pgexporter_ext_log_classify(const char* line, size_t length);
+
+/**
+ * Classify a jsonlog line
+ * @param line The line
+ * @param length The length of the line
+ * @return The severity, or -1 if the line has none
+ */
+int
+pgexporter_ext_log_classify_json(const char* line, size_t length);
+
+/**
+ * Get a severity from its name
+ * @param token The name
+ * @param length The length of the name
+ * @return The severity, or -1 if the name isn't one
+ */
+int
+pgexporter_ext_log_severity(const char* token, size_t length);
+
+/**
+ * Classify a log line and find its message
+ * @param line The line
+ * @param length The length of the line
+ * @param message The resulting start of the message, or NULL
+ * @return The severity, or -1 if the line doesn't start a log entry
+ */
+int
+pgexporter_ext_log_classify_message(const char* line, size_t length, const char** message);
+
+/**
+ * Get the log format of a file from its suffix, ignoring a compression suffix
+ * @param path The path
+ * @return The format
+ */
+int
+pgexporter_ext_log_format(const char* path);
+
+/**
+ * Classify all complete lines or csvlog records in a block, keeping an
+ * incomplete trailing line or record for the next block
+ * @param file The file
+ * @param buffer The block
+ * @param length The length of the block
+ */
+void
+pgexporter_ext_log_scan_block(struct log_file* file, const char* buffer, size_t length);
+
+/**
+ * Count the trailing line or csvlog record of a complete file
+ * @param file The file
+ */
+void
+pgexporter_ext_log_finish_file(struct log_file* file);
+
+/**
+ * Create a scan state
+ * @return The state, or NULL
+ */
+struct log_state*
+pgexporter_ext_log_state_create(void);
+
+/**
+ * Destroy a scan state
+ * @param state The state
+ */
+void
+pgexporter_ext_log_state_destroy(struct log_state* state);
+
+/**
+ * Scan the new content of all log files in a directory. Plain files are read
+ * from their last offset, compressed files only when they changed. Up to
+ * state->workers files are scanned concurrently. When state->index is set the
+ * counts of compressed files are kept in that file between processes.
+ * The scan stops after state->max_bytes or state->max_time, or when
+ * state->interrupted returns true, and sets state->stale. The next scan
+ * continues every file from where it stopped, compressed ones included
+ * @param state The state
+ * @param directory The directory
+ * @param counts The resulting counts
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_ext_log_state_scan(struct log_state* state, const char* directory, struct log_counts* counts);
+
+/**
+ * Get the most frequent errors of the files seen by the last scan
+ * @param state The state
+ * @param topk The resulting sketch
+ */
+void
+pgexporter_ext_log_state_errors(struct log_state* state, struct log_topk* topk);
+
+/**
+ * Get the counts by label of the files seen by the last scan
+ * @param state The state
+ * @return The labels, or NULL
+ */
+struct log_labels*
+pgexporter_ext_log_state_labels(struct log_state* state);
+
+/**
+ * Get the statement durations of the files seen by the last scan
+ * @param state The state
+ * @param histogram The resulting histogram
+ */
+void
+pgexporter_ext_log_state_durations(struct log_state* state, struct log_histogram* histogram);
+
+/**
+ * Set the patterns counted in the messages. When they change all files are
+ * scanned again
+ * @param state The state
+ * @param spec The patterns as "name=text;name=text", or NULL
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_ext_log_state_patterns(struct log_state* state, const char* spec);
+
+/**
+ * Get the number of messages matching each pattern in the files seen by the last scan
+ * @param state The state
+ * @param matches The resulting counts, room for LOG_PATTERNS_MAX
+ */
+void
+pgexporter_ext_log_state_matches(struct log_state* state, uint64_t* matches);
+
+/**
+ * Get the number of log lines per severity written in a time range by the
+ * files of a scanned state. Only the segments between two marks holding
+ * the start or the end of the range are read again, and a compressed file
+ * made of several frames is decoded from the frame holding the segment
+ * @param state The state
+ * @param directory The directory
+ * @param from The start of the range, in milliseconds since the epoch as written in the log
+ * @param to The end of the range, excluded
+ * @param counts The resulting counts
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_ext_log_state_counts_between(struct log_state* state, const char* directory, int64_t from, int64_t to, struct log_counts* counts);
+
+/**
+ * Parse the duration of a "duration: 1.234 ms" message
+ * @param message The message
+ * @param end The end of the message
+ * @param duration The resulting duration in microseconds
+ * @return true if the message starts with a duration, otherwise false
+ */
+bool
+pgexporter_ext_log_duration(const char* message, const char* end, uint64_t* duration);
+
+/**
+ * Compile a log_line_prefix. Text between two escapes is needed to tell their
+ * values apart, and the labels after two adjacent escapes are left empty
+ * @param format The log_line_prefix
+ * @param prefix The resulting prefix
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_ext_log_prefix_compile(const char* format, struct log_prefix* prefix);
+
+/**
+ * Extract the labels and the SQLSTATE of a line
+ * @param prefix The compiled log_line_prefix
+ * @param line The line
+ * @param end The end of the prefix of the line
+ * @param key The resulting values pointing into the line, empty when unknown
+ */
+void
+pgexporter_ext_log_prefix_extract(const struct log_prefix* prefix, const char* line, const char* end,
+                                  struct log_label_key* key);
+
+/**
+ * Create a table of label combinations
+ * @return The table, or NULL
+ */
+struct log_labels*
+pgexporter_ext_log_labels_create(void);
+
+/**
+ * Destroy a table of label combinations
+ * @param labels The table
+ */
+void
+pgexporter_ext_log_labels_destroy(struct log_labels* labels);
+
+/**
+ * Find a combination of labels, adding it when it is new. Beyond LOG_LABELS_MAX
+ * combinations the new ones are counted as LOG_LABEL_OTHER
+ * @param labels The table
+ * @param key The values
+ * @return The combination, or NULL
+ */
+struct log_label*
+pgexporter_ext_log_labels_find(struct log_labels* labels, struct log_label_key* key);
+
+/**
+ * Add the counts of a table to another
+ * @param labels The table to add to
+ * @param other The table to add
+ */
+void
+pgexporter_ext_log_labels_merge(struct log_labels* labels, struct log_labels* other);
+
+/**
+ * Scan a log file, plain or compressed
+ * @param path The path of the file
+ * @param counts The counts to add to
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_ext_log_scan_file(const char* path, struct log_counts* counts);
+
+/**
+ * Find the most recent ERROR, FATAL and PANIC entries of the log files in a
+ * directory, newest first. The newest file is read backwards block by block,
+ * and older files only while more entries are needed. The search stops after
+ * max_bytes, so the entries may be fewer than wanted. Compressed files are
+ * decoded from the start, and left out when max_bytes is reached in them
+ * @param directory The directory
+ * @param n The number of entries wanted
+ * @param max_bytes The number of bytes after which the search stops
+ * @param entries The resulting entries, room for n
+ * @param count The number of entries found
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_ext_log_recent_errors(const char* directory, int n, size_t max_bytes, struct log_entry* entries, int* count);
+
+/**
+ * Scan all log files in a directory in one pass without keeping state
+ * @param directory The directory
+ * @param workers The maximum number of threads
+ * @param counts The resulting counts
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_ext_log_scan_directory(const char* directory, int workers, struct log_counts* counts);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGEXPORTER_EXT_MARKS_H
+#define PGEXPORTER_EXT_MARKS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pgexporter_ext.h>
+#include <logs.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define LOG_MARK_INTERVAL     (4 * 1024 * 1024)
+#define LOG_MARK_TRIES        64
+#define LOG_MARKS_MAX         (1024 * 1024)
+
+/** @struct log_mark
+ * An entry of the sparse index of the times of a log file. The counts
+ * of the file up to the mark let a time range skip the whole segments
+ * between two marks
+ */
+struct log_mark
+{
+   int64_t time;             /**< The time of the entry, in milliseconds since the epoch as written in the log */
+   int64_t offset;           /**< The decoded offset of the entry */
+   int64_t input;            /**< The offset in the file of the frame holding the entry */
+   int64_t frame;            /**< The decoded offset of the frame holding the entry */
+   struct log_counts counts; /**< The counts of the file before the entry */
+};
+
+/** @struct log_marks
+ * The marks of a log file, or the time range followed by a scan of one of its segments
+ */
+struct log_marks
+{
+   int size;                  /**< The number of marks */
+   int capacity;              /**< The room for marks */
+   struct log_mark* entries;  /**< The marks by offset */
+   struct log_range* range;   /**< The time range counted by a scan of a segment, or NULL */
+};
+
+/** @struct log_range
+ * A time range counted by a scan of a segment
+ */
+struct log_range
+{
+   int64_t from;              /**< The start of the range */
+   int64_t to;                /**< The end of the range, excluded */
+   bool started;              /**< Was an entry at or after the start seen */
+   bool ended;                /**< Was an entry at or after the end seen */
+   struct log_counts before;  /**< The counts before the first entry at or after the start */
+   struct log_counts until;   /**< The counts before the first entry at or after the end */
+};
+
+/**
+ * Create the marks of a file
+ * @param capacity The room for marks
+ * @return The marks, or NULL
+ */
+struct log_marks*
+pgexporter_ext_log_marks_create(int capacity);
+
+/**
+ * Destroy the marks of a file
+ * @param marks The marks, or NULL
+ */
+void
+pgexporter_ext_log_marks_destroy(struct log_marks* marks);
+
+/**
+ * Find the next entry of a block at which a mark is placed. Only the first
+ * LOG_MARK_TRIES lines after file->next_mark are searched for a time, except
+ * by a scan of a segment which needs the time of every entry
+ * @param file The file
+ * @param buffer The block
+ * @param p The position in the block from which to search
+ * @param end The end of the block
+ * @param time The resulting time of the entry
+ * @return The start of the entry, or NULL
+ */
+const char*
+pgexporter_ext_log_marks_find(struct log_file* file, const char* buffer, const char* p, const char* end, int64_t* time);
+
+/**
+ * Place a mark with the counts of the file before an entry, or follow the
+ * range of a scan of a segment
+ * @param file The file
+ * @param offset The decoded offset of the entry
+ * @param time The time of the entry
+ */
+void
+pgexporter_ext_log_marks_add(struct log_file* file, int64_t offset, int64_t time);
+
+/**
+ * Add the number of log lines per severity written in a time range by a file.
+ * The segments between two marks inside the range are counted from the marks,
+ * and only those holding the start or the end of the range are read again
+ * @param path The path of the file
+ * @param file The file
+ * @param from The start of the range, in milliseconds since the epoch as written in the log
+ * @param to The end of the range, excluded
+ * @param counts The counts to add to
+ * @param buffer A buffer of LOG_BUFFER_SIZE
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_ext_log_marks_count(const char* path, struct log_file* file, int64_t from, int64_t to, struct log_counts* counts, char* buffer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGEXPORTER_EXT_PATTERNS_H
+#define PGEXPORTER_EXT_PATTERNS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pgexporter_ext.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define LOG_PATTERNS_MAX       64
+#define LOG_PATTERN_NAME_SIZE  64
+#define LOG_PATTERN_SIZE       128
+
+#define LOG_PATTERN_PAIRS      8
+
+#define LOG_PATTERN_FOUND      0x80000000U
+
+/** @struct log_patterns
+ * Named patterns compiled into one Aho-Corasick automaton. The transitions
+ * are complete, so matching takes one lookup per byte whatever the number
+ * of patterns. A transition is the offset of the row of the next state,
+ * flagged with LOG_PATTERN_FOUND when that state ends a pattern
+ */
+struct log_patterns
+{
+   int size;                                           /**< The number of patterns */
+   char names[LOG_PATTERNS_MAX][LOG_PATTERN_NAME_SIZE]; /**< The names of the patterns */
+   char texts[LOG_PATTERNS_MAX][LOG_PATTERN_SIZE];      /**< The texts of the patterns */
+   int states;                                         /**< The number of states, 0 is the start */
+   int classes;                                        /**< The number of byte classes */
+   unsigned char byte_classes[256];                    /**< The class of each byte, 0 for bytes in no pattern */
+   bool starts[256];                                   /**< Does a pattern start with the byte */
+   int pairs;                                          /**< The number of different first two bytes, 0 if too many */
+   unsigned char pair_bytes[LOG_PATTERN_PAIRS][2];     /**< The first two bytes of the patterns */
+   uint32_t* transitions;                              /**< The next row by row and class */
+   uint64_t* outputs;                                  /**< The patterns found by state, one bit per pattern */
+};
+
+/**
+ * Compile a list of patterns written as "name=text;name=text"
+ * @param spec The list
+ * @param patterns The resulting patterns, NULL for an empty list
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_ext_log_patterns_compile(const char* spec, struct log_patterns** patterns);
+
+/**
+ * Destroy compiled patterns
+ * @param patterns The patterns
+ */
+void
+pgexporter_ext_log_patterns_destroy(struct log_patterns* patterns);
+
+/**
+ * Feed a piece of a message to the automaton
+ * @param patterns The patterns
+ * @param state The row of the state after the previous piece, 0 at the start of a message
+ * @param data The data
+ * @param length The length of the data
+ * @param found The patterns found so far, one bit per pattern
+ * @return The row of the state after the piece
+ */
+int
+pgexporter_ext_log_patterns_feed(const struct log_patterns* patterns, int state, const char* data, size_t length,
+                                 uint64_t* found);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
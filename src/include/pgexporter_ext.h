@@ -33,11 +33,29 @@
 extern "C" {
 #endif
 
-#define VERSION "0.3.1"
+#include <stdbool.h>
+
+#define VERSION "0.4.0"
 
 #define PGEXPORTER_EXT_HOMEPAGE "https://pgexporter.github.io/"
 #define PGEXPORTER_EXT_ISSUES "https://github.com/pgexporter/pgexporter_ext/issues"
 
+#define MAX_PATH 1024
+
+#define LOG_SOURCE_HOOK  0
+#define LOG_SOURCE_FILES 1
+
+/* Settings */
+extern int pgexporter_ext_cache_refresh_interval;
+extern int pgexporter_ext_log_source;
+extern int pgexporter_ext_max_scan_workers;
+extern int pgexporter_ext_log_scan_max_time;
+extern int pgexporter_ext_log_scan_max_bytes;
+extern int pgexporter_ext_max_disk_workers;
+extern int pgexporter_ext_disk_cache_refresh_interval;
+extern bool pgexporter_ext_disk_io_uring;
+extern char* pgexporter_ext_log_patterns;
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGEXPORTER_EXT_SHMEM_H
+#define PGEXPORTER_EXT_SHMEM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pgexporter_ext.h>
+#include <disk.h>
+#include <logs.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#define LOG_RATE_MINUTES 1440
+
+typedef struct
+{
+   char level[16];
+   int64_t count;
+   time_t last_updated;
+} LogCacheEntry;
+
+/**
+ * Request the shared memory and install the hooks. Must be called
+ * from _PG_init() while the shared preload libraries are loaded
+ */
+void
+pgexporter_ext_shmem_init(void);
+
+/**
+ * Is the shared memory available
+ * @return True if the library was preloaded, otherwise false
+ */
+bool
+pgexporter_ext_shmem_available(void);
+
+/**
+ * Get the number of messages written to the server log for a severity
+ * since the server started
+ * @param severity The severity
+ * @return The count
+ */
+uint64_t
+pgexporter_ext_shmem_log_count(int severity);
+
+/**
+ * Get the number of messages written to the server log per severity
+ * in the current minute and the minutes before it
+ * @param minutes The number of minutes, at most LOG_RATE_MINUTES
+ * @param counts The resulting counts
+ * @param started The resulting time the counting started, after a restart or a crash
+ * @return True if the counts are available, otherwise false
+ */
+bool
+pgexporter_ext_shmem_log_window(int minutes, struct log_counts* counts, time_t* started);
+
+/**
+ * Get the log file counts published by the log worker
+ * @param entries The resulting entries, one per severity
+ * @return True if the worker published counts, otherwise false
+ */
+bool
+pgexporter_ext_shmem_log_cache(LogCacheEntry* entries);
+
+/**
+ * Publish the log file counts
+ * @param counts The counts
+ */
+void
+pgexporter_ext_shmem_log_cache_update(struct log_counts* counts);
+
+/**
+ * Withdraw the log file counts, so the backends read the files themselves
+ */
+void
+pgexporter_ext_shmem_log_cache_clear(void);
+
+/**
+ * Get the usage of a directory published by the disk worker
+ * @param path The directory, resolved with realpath()
+ * @param usage The resulting usage
+ * @return True if the directory is in the cache, otherwise false
+ */
+bool
+pgexporter_ext_shmem_disk_usage(const char* path, struct disk_usage* usage);
+
+/**
+ * Publish the usage of the directories of the disk cache
+ * @param directories The directories sorted by hash
+ * @param number_of_directories The number of directories, 0 to empty the cache
+ */
+void
+pgexporter_ext_shmem_disk_cache_update(struct disk_directory_usage* directories, int number_of_directories);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
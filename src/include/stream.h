@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGEXPORTER_EXT_STREAM_H
+#define PGEXPORTER_EXT_STREAM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pgexporter_ext.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <zlib.h>
+#include <bzlib.h>
+#include <lz4frame.h>
+#include <zstd.h>
+
+/** @struct log_stream
+ * A compressed file being decoded
+ */
+struct log_stream
+{
+   FILE* fp;          /**< The compressed file */
+   char* input;       /**< The compressed input */
+   size_t position;   /**< The position of the unconsumed input */
+   size_t length;     /**< The length of the input */
+   bool eof;          /**< Was the end of the file reached */
+   gzFile gz;         /**< The zlib state */
+   bz_stream bz;      /**< The bzip2 state */
+   bool bz_active;    /**< Is the bzip2 state initialized */
+   LZ4F_dctx* lz4;    /**< The LZ4 frame state */
+   ZSTD_DCtx* zstd;   /**< The Zstandard state */
+   int64_t base;         /**< The offset in the file of the input */
+   int64_t decoded;      /**< The number of decoded bytes */
+   int64_t frame_input;  /**< The offset in the file of the frame of the last output */
+   int64_t frame_output; /**< The decoded offset of the frame of the last output */
+   bool frame_end;       /**< Did the last output end a frame */
+   const struct log_decoder* decoder; /**< The decoder of a stream kept by a file, or NULL */
+};
+
+/** @struct log_decoder
+ * A streaming decoder of a compression format
+ */
+struct log_decoder
+{
+   const char* suffix;                                                  /**< The file suffix */
+   int (*open)(struct log_stream* stream, const char* path);            /**< Open a file */
+   ssize_t (*read)(struct log_stream* stream, char* out, size_t size);  /**< Decode up to size bytes, 0 at the end, -1 on error */
+   void (*close)(struct log_stream* stream);                            /**< Close the file */
+};
+
+/**
+ * Get the decoder of a compressed file from its suffix
+ * @param path The path
+ * @return The decoder, or NULL if the file isn't compressed
+ */
+const struct log_decoder*
+pgexporter_ext_log_decoder(const char* path);
+
+/**
+ * Continue an opened stream from the start of a frame. Only the decoders
+ * reading the file themselves can do so
+ * @param stream The stream
+ * @param input The offset in the file of the frame
+ * @param output The decoded offset of the frame
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_ext_log_stream_seek(struct log_stream* stream, int64_t input, int64_t output);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGEXPORTER_EXT_TOPK_H
+#define PGEXPORTER_EXT_TOPK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pgexporter_ext.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define TOPK_CAPACITY       64
+#define TOPK_SAMPLE_SIZE    128
+#define SQLSTATE_SIZE       6
+
+/** @struct log_fingerprint
+ * A message being normalized and hashed, fed in pieces
+ */
+struct log_fingerprint
+{
+   uint64_t hash;                   /**< The hash of the complete words of the normalized message */
+   uint64_t word;                   /**< The bytes of the incomplete word */
+   int word_length;                 /**< The number of bytes in the incomplete word */
+   char sample[TOPK_SAMPLE_SIZE];   /**< The start of the normalized message */
+   size_t sample_length;            /**< The length of the sample */
+   char quote;                      /**< The quote of the literal being skipped, or 0 */
+   bool closed;                     /**< Was a literal closed by the last character */
+   bool number;                     /**< Is a number being skipped */
+   char last;                       /**< The last character added */
+};
+
+/** @struct log_error
+ * An error message of a sketch
+ */
+struct log_error
+{
+   uint64_t fingerprint;            /**< The fingerprint */
+   char sqlstate[SQLSTATE_SIZE];    /**< The SQLSTATE, or empty */
+   uint64_t count;                  /**< The estimated count */
+   uint64_t error;                  /**< The maximum overestimation of the count */
+   char sample[TOPK_SAMPLE_SIZE];   /**< The normalized message */
+};
+
+/** @struct log_topk
+ * A Space-Saving sketch of the most frequent error messages. The columns
+ * are kept apart so the lookups only touch the fingerprints and counts
+ */
+struct log_topk
+{
+   int size;                                       /**< The number of entries */
+   uint64_t fingerprints[TOPK_CAPACITY];           /**< The fingerprints */
+   uint64_t counts[TOPK_CAPACITY];                 /**< The estimated counts */
+   uint64_t errors[TOPK_CAPACITY];                 /**< The maximum overestimations of the counts */
+   char sqlstates[TOPK_CAPACITY][SQLSTATE_SIZE];   /**< The SQLSTATEs, or empty */
+   char samples[TOPK_CAPACITY][TOPK_SAMPLE_SIZE];  /**< The normalized messages */
+};
+
+/**
+ * Start a fingerprint
+ * @param fingerprint The fingerprint
+ */
+void
+pgexporter_ext_fingerprint_init(struct log_fingerprint* fingerprint);
+
+/**
+ * Feed a piece of a message to a fingerprint. String literals, quoted
+ * identifiers and numbers are replaced by '?'
+ * @param fingerprint The fingerprint
+ * @param data The data
+ * @param length The length of the data
+ */
+void
+pgexporter_ext_fingerprint_feed(struct log_fingerprint* fingerprint, const char* data, size_t length);
+
+/**
+ * Get the value of a fingerprint
+ * @param fingerprint The fingerprint
+ * @return The value
+ */
+uint64_t
+pgexporter_ext_fingerprint_value(struct log_fingerprint* fingerprint);
+
+/**
+ * Add an error to a sketch
+ * @param topk The sketch
+ * @param fingerprint The fingerprint of the message
+ * @param sqlstate The SQLSTATE, or NULL
+ * @param count The number of occurrences
+ */
+void
+pgexporter_ext_topk_add(struct log_topk* topk, struct log_fingerprint* fingerprint, const char* sqlstate, uint64_t count);
+
+/**
+ * Add an error of another sketch to a sketch
+ * @param topk The sketch
+ * @param error The error
+ */
+void
+pgexporter_ext_topk_add_error(struct log_topk* topk, struct log_error* error);
+
+/**
+ * Merge a sketch into another
+ * @param topk The sketch to merge into
+ * @param other The sketch to merge
+ */
+void
+pgexporter_ext_topk_merge(struct log_topk* topk, struct log_topk* other);
+
+/**
+ * Get the errors of a sketch by descending count
+ * @param topk The sketch
+ * @param errors The resulting errors, room for TOPK_CAPACITY
+ * @return The number of errors
+ */
+int
+pgexporter_ext_topk_errors(struct log_topk* topk, struct log_error* errors);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
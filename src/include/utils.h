@@ -34,6 +34,8 @@ extern "C" {
 #endif
 
 #include <pgexporter_ext.h>
+#include <disk.h>
+#include <logs.h>
 
 #include <stdlib.h>
 #include <stdbool.h>
@@ -46,6 +48,52 @@ extern "C" {
 unsigned long
 pgexporter_get_directory_size(char* path);
 
+/**
+ * Find the data directory, pg_wal and every tablespace. When pg_wal isn't a link
+ * it is the skip of the data directory
+ * @param roots The resulting roots, allocated with palloc
+ * @param number_of_roots The resulting number of roots
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_ext_disk_roots(struct disk_root** roots, int* number_of_roots);
+
+/**
+ * Get the usage of the data directory, pg_wal and every tablespace. The roots the
+ * disk worker doesn't have are walked at the same time with up to
+ * pgexporter.max_disk_workers threads. pg_wal is only walked as a root of its own
+ * @param roots The resulting roots, allocated with palloc
+ * @param number_of_roots The resulting number of roots
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_ext_disk_usage_roots(struct disk_root** roots, int* number_of_roots);
+
+/**
+ * Get the usage of each database directory of each tablespace, global, pg_wal,
+ * pg_xact, pg_multixact, pg_stat_tmp and the pgsql_tmp directory of each tablespace.
+ * The directories the disk worker doesn't have are walked together, like
+ * pgexporter_ext_disk_usage_roots(). The database directories have the OID of
+ * their database and tablespace, and directories that don't exist are left out
+ * @param roots The resulting roots, allocated with palloc
+ * @param number_of_roots The resulting number of roots
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_ext_disk_breakdown_roots(struct disk_root** roots, int* number_of_roots);
+
+/**
+ * Get the file systems of the data directory, pg_wal, the tablespaces and
+ * log_directory. The directories are grouped by device, and each file system
+ * is matched to its mount of /proc/self/mountinfo, read once, and stat'ed once
+ * with statvfs()
+ * @param filesystems The resulting file systems, allocated with palloc
+ * @param number_of_filesystems The resulting number of file systems
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_ext_disk_filesystems(struct disk_filesystem** filesystems, int* number_of_filesystems);
+
 /**
  * Get the free space for a path
  * @param path The path
@@ -80,12 +128,80 @@ bool
 pgexporter_ext_ends_with(char* str, char* suffix);
 
 /**
- * Parse the log files
- * @param level The log level
- * @return The result
+ * Parse the new content of the log files in log_directory in one pass
+ * @param counts The resulting counts per severity
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_ext_parse_log_files(struct log_counts* counts);
+
+/**
+ * Parse the new content of the log files in log_directory and get the most
+ * frequent errors of all of the log files
+ * @param topk The resulting sketch
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_ext_parse_log_errors(struct log_topk* topk);
+
+/**
+ * Parse the new content of the log files in log_directory and get the counts
+ * by database, user, application and host of all of the log files
+ * @param labels The resulting counts, to be destroyed by the caller
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_ext_parse_log_labels(struct log_labels** labels);
+
+/**
+ * Parse the new content of the log files in log_directory and get the statement
+ * durations of all of the log files
+ * @param histogram The resulting histogram
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_ext_parse_log_durations(struct log_histogram* histogram);
+
+/**
+ * Parse the new content of the log files in log_directory and get the number
+ * of messages matching each pattern of pgexporter.log_patterns
+ * @param patterns The resulting patterns, valid until the next scan, or NULL
+ * @param matches The resulting counts, room for LOG_PATTERNS_MAX
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_ext_parse_log_patterns(const struct log_patterns** patterns, uint64_t* matches);
+
+/**
+ * Parse the new content of the log files in log_directory and get the number
+ * of messages per severity written in a time range
+ * @param from The start of the range, in milliseconds since the epoch in log_timezone
+ * @param to The end of the range, excluded
+ * @param counts The resulting counts
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_ext_parse_log_counts_between(int64_t from, int64_t to, struct log_counts* counts);
+
+/**
+ * Get the status of the last scan of the log files by this backend
+ * @param stale The resulting flag telling if the scan stopped before the end of the files
+ * @param bytes The resulting number of bytes read
+ * @param elapsed The resulting duration in milliseconds
+ */
+void
+pgexporter_ext_log_scan_status_get(bool* stale, int64_t* bytes, int64_t* elapsed);
+
+/**
+ * Read the most recent ERROR, FATAL and PANIC entries of the log files in log_directory,
+ * newest first. At most LOG_RECENT_BYTES are read
+ * @param n The number of entries wanted
+ * @param entries The resulting entries, room for n
+ * @param count The resulting number of entries
+ * @return 0 upon success, otherwise 1
  */
 int
-pgexporter_ext_parse_log_files(const char* level);
+pgexporter_ext_read_recent_errors(int n, struct log_entry* entries, int* count);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,2309 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgexporter */
+#include <pgexporter_ext.h>
+#include <disk.h>
+
+/* system */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef HAVE_LINUX
+#include <sys/inotify.h>
+#endif
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#define HASH_SEED  0xcbf29ce484222325ULL
+#define HASH_PRIME 0x100000001b3ULL
+
+#define DISK_CACHE_FILES   1024
+#define DISK_EVENTS_SIZE   16384
+#define DISK_EVENT_READS   64
+#define DISK_STAT_PENDING  1
+
+#ifdef HAVE_LINUX
+#define DISK_WATCH_EVENTS (IN_CREATE | IN_DELETE | IN_MODIFY | IN_MOVED_FROM | IN_MOVED_TO | \
+                           IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK)
+#endif
+
+/** @struct disk_directory
+ * An open directory, shared by the batches of its entries
+ */
+struct disk_directory
+{
+   DIR* dir;               /**< The directory */
+   int root;               /**< The root it belongs to */
+   bool top;               /**< Is it the root itself */
+   int node;               /**< Its node when walked into a cache, or -1 */
+   char* path;             /**< Its path when walked into a cache, or NULL */
+   atomic_int references;  /**< The number of batches and readers using it */
+};
+
+/** @struct disk_batch
+ * Entries of a directory to stat
+ */
+struct disk_batch
+{
+   struct disk_directory* directory;  /**< The directory */
+   int count;                         /**< The number of names */
+   size_t length;                     /**< The length of the names */
+   char names[DISK_BATCH_SIZE];       /**< The names, each ending with a NUL */
+};
+
+/** @struct disk_queue
+ * The batches of a thread. The thread takes the newest one, and the
+ * others steal the oldest one
+ */
+struct disk_queue
+{
+   pthread_mutex_t lock;        /**< The lock */
+   struct disk_batch** batches; /**< The batches */
+   int head;                    /**< The oldest batch */
+   int tail;                    /**< One past the newest batch */
+   int capacity;                /**< The capacity */
+};
+
+#ifdef HAVE_IO_URING
+/** @struct disk_ring
+ * An io_uring stat'ing the entries of a batch with one system call
+ */
+struct disk_ring
+{
+   int fd;                               /**< The ring */
+   bool supported;                       /**< Does the kernel have IORING_OP_STATX */
+   unsigned* sq_tail;                    /**< The tail of the submission queue */
+   unsigned* sq_mask;                    /**< The mask of the submission queue */
+   unsigned* sq_array;                   /**< The submitted entries */
+   struct io_uring_sqe* sqes;            /**< The submission entries */
+   unsigned* cq_head;                    /**< The head of the completion queue */
+   unsigned* cq_tail;                    /**< The tail of the completion queue */
+   unsigned* cq_mask;                    /**< The mask of the completion queue */
+   struct io_uring_cqe* cqes;            /**< The completion entries */
+   void* sq_ring;                        /**< The mapping of the submission queue */
+   size_t sq_ring_size;                  /**< The size of the submission queue mapping */
+   void* cq_ring;                        /**< The mapping of the completion queue */
+   size_t cq_ring_size;                  /**< The size of the completion queue mapping */
+   size_t sqes_size;                     /**< The size of the submission entries */
+   int results[DISK_BATCH_NAMES];        /**< The result of each statx */
+   struct statx stats[DISK_BATCH_NAMES]; /**< The stat of each entry */
+};
+#endif
+
+/** @struct disk_frame
+ * A directory being read by a walk into a cache
+ */
+struct disk_frame
+{
+   DIR* dir;       /**< The directory */
+   int node;       /**< Its node */
+   size_t length;  /**< The length of its path */
+};
+
+/** @struct disk_pool
+ * The state of a walk shared by the threads
+ */
+struct disk_pool
+{
+   struct disk_root* roots;                  /**< The roots */
+   int number_of_roots;                      /**< The number of roots */
+   int workers;                              /**< The number of threads */
+   struct disk_queue queues[MAX_DISK_WORKERS]; /**< The batches of each thread */
+   atomic_long pending;                      /**< The number of batches queued or being stat'ed */
+   bool (*interrupted)(void);                /**< Is the walk to be stopped, or NULL */
+   atomic_bool stopped;                      /**< Was the walk stopped or did it fail */
+   bool io_uring;                            /**< Do the threads stat with io_uring */
+   struct disk_cache* cache;                 /**< The cache walked into, or NULL */
+   pthread_mutex_t lock;                     /**< The lock of the cache */
+   atomic_uint events;                       /**< The number of polls that applied events to the cache */
+};
+
+/** @struct disk_worker
+ * A thread of a walk
+ */
+struct disk_worker
+{
+   struct disk_pool* pool;    /**< The pool */
+   int id;                    /**< The index of its queue */
+   struct disk_usage* usage;  /**< The usage it found per root */
+   struct disk_ring* ring;    /**< Its io_uring, or NULL to stat with fstatat() */
+   unsigned int events;       /**< The polls of the pool before its batch was stat'ed */
+};
+
+static int open_directory(int parent, const char* name, struct disk_usage* usage);
+static void add_entry(struct stat* st, struct disk_usage* usage);
+static int walk_pool(struct disk_root* roots, int number_of_roots, int workers, bool io_uring, bool (*interrupted)(void), struct disk_cache* cache);
+static void* walk_worker(void* arg);
+static void walk_batches(struct disk_worker* worker);
+static void stat_batch(struct disk_worker* worker, struct disk_batch* batch);
+static void add_stat(struct disk_worker* worker, struct disk_directory* directory, const char* name, mode_t mode, uint64_t blocks);
+static void cache_file(struct disk_worker* worker, struct disk_directory* directory, const char* name, uint64_t blocks);
+static int cache_directory(struct disk_worker* worker, struct disk_directory* parent, struct disk_directory* directory, const char* name);
+static void poll_events(struct disk_pool* pool);
+static bool stat_ring(struct disk_worker* worker, struct disk_directory* directory, const char** names, int count);
+static struct disk_ring* ring_create(void);
+static void ring_destroy(struct disk_ring* ring);
+static void read_directory(struct disk_worker* worker, struct disk_directory* directory);
+static struct disk_directory* new_directory(int fd, int root, bool top);
+static void release_directory(struct disk_directory* directory);
+static bool push_batch(struct disk_pool* pool, int id, struct disk_batch* batch);
+static struct disk_batch* take_batch(struct disk_pool* pool, int id);
+static void clear_cache(struct disk_cache* cache);
+static int read_events(struct disk_cache* cache);
+static int add_tree(struct disk_cache* cache, int parent, const char* name, const char* path, int* top);
+static int new_node(struct disk_cache* cache, int parent, const char* name, const char* path, int fd);
+static void drop_node(struct disk_cache* cache, int node);
+static int node_path(struct disk_cache* cache, int node, const char* name, char* path, size_t size);
+static int find_child(struct disk_cache* cache, int node, const char* name);
+static int attach_tree(struct disk_cache* cache, int parent, const char* name);
+static void remove_tree(struct disk_cache* cache, int node);
+static void update_file(struct disk_cache* cache, int node, const char* name);
+static void update_directories(struct disk_cache* cache);
+static void compact_nodes(struct disk_cache* cache);
+static uint64_t file_key(struct disk_cache* cache, int node, const char* name);
+static size_t find_file(struct disk_cache* cache, uint64_t key, int node);
+static int set_file(struct disk_cache* cache, int node, const char* name, uint64_t blocks, struct disk_usage* delta);
+static void remove_file(struct disk_cache* cache, int node, const char* name, struct disk_usage* delta);
+static int rehash_files(struct disk_cache* cache, size_t capacity);
+static void add_up(struct disk_cache* cache, int node, struct disk_usage* delta);
+static void add_usage(struct disk_usage* usage, struct disk_usage* delta);
+static int compare_directories(const void* a, const void* b);
+static void unescape(char* s);
+static bool is_under(const char* path, const char* mount_point);
+#ifdef HAVE_LINUX
+static void apply_event(struct disk_cache* cache, struct inotify_event* event);
+#endif
+
+int
+pgexporter_ext_disk_walk(const char* path, struct disk_usage* usage)
+{
+   DIR* stack[DISK_STACK_SIZE];
+   DIR** frames = stack;
+   DIR** grown = NULL;
+   int capacity = DISK_STACK_SIZE;
+   int depth = 0;
+   struct dirent* entry;
+   struct stat st;
+   int fd;
+
+   memset(usage, 0, sizeof(struct disk_usage));
+
+   fd = open_directory(AT_FDCWD, path, usage);
+   if (fd == -1 || (frames[0] = fdopendir(fd)) == NULL)
+   {
+      if (fd != -1)
+      {
+         close(fd);
+      }
+      goto error;
+   }
+   depth = 1;
+
+   /* One open directory per level, so the memory only grows with the depth of the tree */
+   while (depth > 0)
+   {
+      entry = readdir(frames[depth - 1]);
+      if (entry == NULL)
+      {
+         closedir(frames[--depth]);
+         continue;
+      }
+
+      if (entry->d_name[0] == '.' &&
+          (entry->d_name[1] == '\0' || (entry->d_name[1] == '.' && entry->d_name[2] == '\0')))
+      {
+         continue;
+      }
+
+      if (entry->d_type != DT_DIR && entry->d_type != DT_UNKNOWN)
+      {
+         if (fstatat(dirfd(frames[depth - 1]), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0)
+         {
+            add_entry(&st, usage);
+         }
+         continue;
+      }
+
+      fd = open_directory(dirfd(frames[depth - 1]), entry->d_name, usage);
+      if (fd == -1)
+      {
+         continue;
+      }
+
+      if (depth == capacity)
+      {
+         grown = (DIR**)malloc(2 * capacity * sizeof(DIR*));
+         if (grown == NULL)
+         {
+            close(fd);
+            goto error;
+         }
+
+         memcpy(grown, frames, depth * sizeof(DIR*));
+         if (frames != stack)
+         {
+            free(frames);
+         }
+         frames = grown;
+         capacity *= 2;
+      }
+
+      frames[depth] = fdopendir(fd);
+      if (frames[depth] == NULL)
+      {
+         close(fd);
+         continue;
+      }
+      depth++;
+   }
+
+   if (frames != stack)
+   {
+      free(frames);
+   }
+
+   return 0;
+
+error:
+
+   while (depth > 0)
+   {
+      closedir(frames[--depth]);
+   }
+
+   if (frames != stack)
+   {
+      free(frames);
+   }
+
+   return 1;
+}
+
+static int
+open_directory(int parent, const char* name, struct disk_usage* usage)
+{
+   struct stat st;
+   int fd;
+
+   fd = openat(parent, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+   if (fd == -1)
+   {
+      /* A symbolic link or a file when d_type didn't tell */
+      if (parent != AT_FDCWD && fstatat(parent, name, &st, AT_SYMLINK_NOFOLLOW) == 0 && !S_ISDIR(st.st_mode))
+      {
+         add_entry(&st, usage);
+      }
+      return -1;
+   }
+
+   if (fstat(fd, &st) == 0)
+   {
+      usage->bytes += (uint64_t)st.st_blocks * 512;
+   }
+   usage->directories++;
+
+   return fd;
+}
+
+static void
+add_entry(struct stat* st, struct disk_usage* usage)
+{
+   usage->bytes += (uint64_t)st->st_blocks * 512;
+   usage->files++;
+}
+
+int
+pgexporter_ext_disk_walk_roots(struct disk_root* roots, int number_of_roots, int workers, bool io_uring, bool (*interrupted)(void))
+{
+   return walk_pool(roots, number_of_roots, workers, io_uring, interrupted, NULL);
+}
+
+static int
+walk_pool(struct disk_root* roots, int number_of_roots, int workers, bool io_uring, bool (*interrupted)(void), struct disk_cache* cache)
+{
+   struct disk_pool* pool = NULL;
+   struct disk_worker contexts[MAX_DISK_WORKERS];
+   pthread_t threads[MAX_DISK_WORKERS];
+   struct disk_directory* directory;
+   struct stat st;
+   int started = 0;
+   int node = -1;
+   sigset_t all;
+   sigset_t old;
+   int fd;
+   int ret = 1;
+
+   if (workers < 1)
+   {
+      workers = 1;
+   }
+
+   if (workers > MAX_DISK_WORKERS)
+   {
+      workers = MAX_DISK_WORKERS;
+   }
+
+   memset(contexts, 0, sizeof(contexts));
+
+   pool = (struct disk_pool*)malloc(sizeof(struct disk_pool));
+   if (pool == NULL)
+   {
+      return 1;
+   }
+
+   memset(pool, 0, sizeof(struct disk_pool));
+   pool->roots = roots;
+   pool->number_of_roots = number_of_roots;
+   pool->workers = workers;
+   pool->interrupted = interrupted;
+   pool->io_uring = io_uring;
+   pool->cache = cache;
+   pthread_mutex_init(&pool->lock, NULL);
+   atomic_init(&pool->pending, 0);
+   atomic_init(&pool->stopped, false);
+   atomic_init(&pool->events, 0);
+
+   for (int i = 0; i < workers; i++)
+   {
+      pthread_mutex_init(&pool->queues[i].lock, NULL);
+
+      contexts[i].pool = pool;
+      contexts[i].id = i;
+      contexts[i].usage = (struct disk_usage*)calloc(number_of_roots > 0 ? number_of_roots : 1, sizeof(struct disk_usage));
+      if (contexts[i].usage == NULL)
+      {
+         goto done;
+      }
+   }
+
+   /* The roots are listed by the calling thread, and their entries spread from there */
+   for (int i = 0; i < number_of_roots; i++)
+   {
+      roots[i].result = 1;
+      memset(&roots[i].usage, 0, sizeof(struct disk_usage));
+
+      fd = open(roots[i].path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+      if (fd == -1)
+      {
+         continue;
+      }
+
+      /* The threads aren't started yet, so the roots of a cache are added without the lock */
+      if (cache != NULL)
+      {
+         node = new_node(cache, -1, roots[i].path, roots[i].path, fd);
+         if (node == -1)
+         {
+            close(fd);
+            atomic_store(&pool->stopped, true);
+            break;
+         }
+      }
+
+      if (fstat(fd, &st) == 0)
+      {
+         contexts[0].usage[i].bytes += (uint64_t)st.st_blocks * 512;
+      }
+      contexts[0].usage[i].directories++;
+
+      directory = new_directory(fd, i, true);
+      if (directory == NULL)
+      {
+         close(fd);
+         continue;
+      }
+
+      if (cache != NULL)
+      {
+         directory->node = node;
+         directory->path = strdup(roots[i].path);
+         if (directory->path == NULL)
+         {
+            release_directory(directory);
+            atomic_store(&pool->stopped, true);
+            break;
+         }
+      }
+
+      roots[i].result = 0;
+      read_directory(&contexts[0], directory);
+   }
+
+   if (workers > 1)
+   {
+      /* The threads only stat files, so keep every signal on the calling thread */
+      sigfillset(&all);
+      pthread_sigmask(SIG_SETMASK, &all, &old);
+
+      for (int i = 1; i < workers; i++)
+      {
+         if (pthread_create(&threads[started], NULL, walk_worker, &contexts[i]) != 0)
+         {
+            break;
+         }
+         started++;
+      }
+
+      pthread_sigmask(SIG_SETMASK, &old, NULL);
+   }
+
+   walk_batches(&contexts[0]);
+
+   for (int i = 0; i < started; i++)
+   {
+      pthread_join(threads[i], NULL);
+   }
+
+   for (int i = 0; i < workers; i++)
+   {
+      for (int r = 0; r < number_of_roots; r++)
+      {
+         roots[r].usage.bytes += contexts[i].usage[r].bytes;
+         roots[r].usage.files += contexts[i].usage[r].files;
+         roots[r].usage.directories += contexts[i].usage[r].directories;
+      }
+   }
+
+   ret = atomic_load(&pool->stopped) ? 1 : 0;
+
+done:
+
+   for (int i = 0; i < workers; i++)
+   {
+      free(contexts[i].usage);
+      free(pool->queues[i].batches);
+      pthread_mutex_destroy(&pool->queues[i].lock);
+   }
+
+   pthread_mutex_destroy(&pool->lock);
+   free(pool);
+
+   return ret;
+}
+
+static void*
+walk_worker(void* arg)
+{
+   walk_batches((struct disk_worker*)arg);
+
+   return NULL;
+}
+
+static void
+walk_batches(struct disk_worker* worker)
+{
+   struct disk_pool* pool = worker->pool;
+   struct disk_batch* batch;
+   struct timespec pause = {0, 100000};
+
+   /* Without a ring the thread stats synchronously */
+   if (pool->io_uring)
+   {
+      worker->ring = ring_create();
+   }
+
+   while (true)
+   {
+      batch = take_batch(pool, worker->id);
+      if (batch != NULL)
+      {
+         if (!atomic_load(&pool->stopped) && pool->interrupted != NULL && pool->interrupted())
+         {
+            atomic_store(&pool->stopped, true);
+         }
+
+         stat_batch(worker, batch);
+         atomic_fetch_sub(&pool->pending, 1);
+
+         /* The events of the directories already watched are applied during the
+          * walk, so their queue doesn't overflow and leave the cache stale */
+         if (pool->cache != NULL)
+         {
+            poll_events(pool);
+         }
+         continue;
+      }
+
+      /* Another thread may still be reading a large directory */
+      if (atomic_load(&pool->pending) == 0)
+      {
+         break;
+      }
+
+      nanosleep(&pause, NULL);
+   }
+
+   ring_destroy(worker->ring);
+   worker->ring = NULL;
+}
+
+static void
+stat_batch(struct disk_worker* worker, struct disk_batch* batch)
+{
+   struct disk_directory* directory = batch->directory;
+   const char* skip = worker->pool->roots[directory->root].skip;
+   const char* names[DISK_BATCH_NAMES];
+   const char* name = batch->names;
+   struct stat st;
+   int count = 0;
+
+   worker->events = atomic_load(&worker->pool->events);
+
+   for (int i = 0; i < batch->count; i++, name += strlen(name) + 1)
+   {
+      if (directory->top && skip[0] != '\0' && strcmp(name, skip) == 0)
+      {
+         continue;
+      }
+
+      names[count++] = name;
+   }
+
+   /* A ring stats the whole batch with one system call */
+   if (worker->ring == NULL || !stat_ring(worker, directory, names, count))
+   {
+      for (int i = 0; i < count && !atomic_load(&worker->pool->stopped); i++)
+      {
+         if (fstatat(dirfd(directory->dir), names[i], &st, AT_SYMLINK_NOFOLLOW) == 0)
+         {
+            add_stat(worker, directory, names[i], st.st_mode, (uint64_t)st.st_blocks);
+         }
+      }
+   }
+
+   release_directory(directory);
+   free(batch);
+}
+
+static void
+add_stat(struct disk_worker* worker, struct disk_directory* directory, const char* name, mode_t mode, uint64_t blocks)
+{
+   struct disk_usage* usage = &worker->usage[directory->root];
+   struct disk_directory* child;
+   int fd;
+
+   usage->bytes += blocks * 512;
+
+   if (!S_ISDIR(mode))
+   {
+      usage->files++;
+
+      if (worker->pool->cache != NULL)
+      {
+         cache_file(worker, directory, name, blocks);
+      }
+      return;
+   }
+
+   usage->directories++;
+
+   fd = openat(dirfd(directory->dir), name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+   if (fd == -1)
+   {
+      return;
+   }
+
+   child = new_directory(fd, directory->root, false);
+   if (child == NULL)
+   {
+      close(fd);
+      atomic_store(&worker->pool->stopped, true);
+      return;
+   }
+
+   /* A directory of a cache is watched before it is read, so an entry created
+    * in between is seen by both, which set_file() makes harmless */
+   if (worker->pool->cache != NULL && cache_directory(worker, directory, child, name))
+   {
+      release_directory(child);
+      return;
+   }
+
+   read_directory(worker, child);
+}
+
+static void
+cache_file(struct disk_worker* worker, struct disk_directory* directory, const char* name, uint64_t blocks)
+{
+   struct disk_pool* pool = worker->pool;
+   struct disk_cache* cache = pool->cache;
+   struct disk_usage delta;
+   struct stat st;
+
+   pthread_mutex_lock(&pool->lock);
+
+   /* An event applied since the stat may be older than the file, so it is stat'ed again */
+   if (atomic_load(&pool->events) != worker->events)
+   {
+      if (fstatat(dirfd(directory->dir), name, &st, AT_SYMLINK_NOFOLLOW) != 0 || S_ISDIR(st.st_mode))
+      {
+         pthread_mutex_unlock(&pool->lock);
+         return;
+      }
+      blocks = (uint64_t)st.st_blocks;
+   }
+
+   /* The directory may have been removed by an event since it was read */
+   if (cache->nodes[directory->node].used)
+   {
+      if (set_file(cache, directory->node, name, blocks, &delta))
+      {
+         atomic_store(&pool->stopped, true);
+      }
+      else
+      {
+         add_up(cache, directory->node, &delta);
+      }
+   }
+
+   pthread_mutex_unlock(&pool->lock);
+}
+
+static int
+cache_directory(struct disk_worker* worker, struct disk_directory* parent, struct disk_directory* directory, const char* name)
+{
+   struct disk_pool* pool = worker->pool;
+   struct disk_cache* cache = pool->cache;
+   size_t length = strlen(parent->path);
+   size_t n = strlen(name);
+   struct stat st;
+   int node = -1;
+
+   if (length + 1 + n >= PATH_MAX)
+   {
+      return 1;
+   }
+
+   directory->path = (char*)malloc(length + 1 + n + 1);
+   if (directory->path == NULL)
+   {
+      atomic_store(&pool->stopped, true);
+      return 1;
+   }
+
+   memcpy(directory->path, parent->path, length);
+   directory->path[length] = '/';
+   memcpy(directory->path + length + 1, name, n + 1);
+
+   pthread_mutex_lock(&pool->lock);
+
+   /* An event may have removed the parent, or the directory after it was opened,
+    * or added the directory before the walk got to it */
+   if (cache->nodes[parent->node].used &&
+       (atomic_load(&pool->events) == worker->events ||
+        (fstatat(dirfd(parent->dir), name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode))) &&
+       (!cache->attached || find_child(cache, parent->node, name) == -1))
+   {
+      node = new_node(cache, parent->node, name, directory->path, dirfd(directory->dir));
+      if (node == -1)
+      {
+         atomic_store(&pool->stopped, true);
+      }
+      else
+      {
+         add_up(cache, parent->node, &cache->nodes[node].usage);
+      }
+   }
+
+   pthread_mutex_unlock(&pool->lock);
+
+   directory->node = node;
+
+   return node == -1 ? 1 : 0;
+}
+
+static void
+poll_events(struct disk_pool* pool)
+{
+   pthread_mutex_lock(&pool->lock);
+   if (read_events(pool->cache) > 0)
+   {
+      atomic_fetch_add(&pool->events, 1);
+   }
+   pthread_mutex_unlock(&pool->lock);
+}
+
+static bool
+stat_ring(struct disk_worker* worker, struct disk_directory* directory, const char** names, int count)
+{
+#ifdef HAVE_IO_URING
+   struct disk_ring* ring = worker->ring;
+   struct io_uring_sqe* sqe;
+   struct io_uring_cqe* cqe;
+   struct stat st;
+   unsigned tail;
+   unsigned head;
+   int submitted = 0;
+   int completed = 0;
+   int ret;
+
+   if (!ring->supported || count == 0)
+   {
+      return false;
+   }
+
+   tail = *ring->sq_tail;
+   for (int i = 0; i < count; i++)
+   {
+      sqe = &ring->sqes[i];
+      memset(sqe, 0, sizeof(struct io_uring_sqe));
+      sqe->opcode = IORING_OP_STATX;
+      sqe->fd = dirfd(directory->dir);
+      sqe->addr = (uint64_t)(uintptr_t)names[i];
+      sqe->len = STATX_TYPE | STATX_BLOCKS;
+      sqe->off = (uint64_t)(uintptr_t)&ring->stats[i];
+      sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+      sqe->user_data = i;
+
+      /* statx returns 0 or -errno, so the entries not completed are told apart */
+      ring->results[i] = DISK_STAT_PENDING;
+
+      ring->sq_array[tail & *ring->sq_mask] = i;
+      tail++;
+   }
+   __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+
+   while (completed < count)
+   {
+      ret = syscall(__NR_io_uring_enter, ring->fd, count - submitted, count - completed, IORING_ENTER_GETEVENTS, NULL, 0);
+      if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+      {
+         /* The ring is left with the entries not submitted or still in flight, and
+          * isn't used again. The entries not completed and the next batches are
+          * stat'ed with fstatat(), and ring->stats is only freed with the thread */
+         ring->supported = false;
+         break;
+      }
+      submitted += ret > 0 ? ret : 0;
+
+      head = *ring->cq_head;
+      while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+      {
+         cqe = &ring->cqes[head & *ring->cq_mask];
+         ring->results[cqe->user_data] = cqe->res;
+         head++;
+         completed++;
+      }
+      __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+   }
+
+   /* A kernel before 5.6 has io_uring but not statx in it, and then the
+    * whole batch is stat'ed again with fstatat() before anything is counted */
+   for (int i = 0; i < count; i++)
+   {
+      if (ring->results[i] == -EINVAL || ring->results[i] == -EOPNOTSUPP)
+      {
+         ring->supported = false;
+         return false;
+      }
+   }
+
+   for (int i = 0; i < count && !atomic_load(&worker->pool->stopped); i++)
+   {
+      if (ring->results[i] == 0)
+      {
+         add_stat(worker, directory, names[i], ring->stats[i].stx_mode, ring->stats[i].stx_blocks);
+      }
+      else if (ring->results[i] == DISK_STAT_PENDING &&
+               fstatat(dirfd(directory->dir), names[i], &st, AT_SYMLINK_NOFOLLOW) == 0)
+      {
+         add_stat(worker, directory, names[i], st.st_mode, (uint64_t)st.st_blocks);
+      }
+   }
+
+   return true;
+#else
+   return false;
+#endif
+}
+
+static struct disk_ring*
+ring_create(void)
+{
+#ifdef HAVE_IO_URING
+   struct io_uring_params params;
+   struct disk_ring* ring;
+
+   ring = (struct disk_ring*)calloc(1, sizeof(struct disk_ring));
+   if (ring == NULL)
+   {
+      return NULL;
+   }
+
+   memset(&params, 0, sizeof(struct io_uring_params));
+
+   /* Fails with ENOSYS, or EPERM when kernel.io_uring_disabled or seccomp forbid it */
+   ring->fd = syscall(__NR_io_uring_setup, DISK_BATCH_NAMES, &params);
+   if (ring->fd < 0)
+   {
+      free(ring);
+      return NULL;
+   }
+
+   ring->supported = true;
+   ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+   ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+   ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+   if (params.features & IORING_FEAT_SINGLE_MMAP)
+   {
+      if (ring->cq_ring_size > ring->sq_ring_size)
+      {
+         ring->sq_ring_size = ring->cq_ring_size;
+      }
+      ring->cq_ring_size = ring->sq_ring_size;
+   }
+
+   ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+   if (ring->sq_ring == MAP_FAILED)
+   {
+      ring->sq_ring = NULL;
+      goto error;
+   }
+
+   if (params.features & IORING_FEAT_SINGLE_MMAP)
+   {
+      ring->cq_ring = ring->sq_ring;
+   }
+   else
+   {
+      ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+      if (ring->cq_ring == MAP_FAILED)
+      {
+         ring->cq_ring = NULL;
+         goto error;
+      }
+   }
+
+   ring->sqes = (struct io_uring_sqe*)mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+   if (ring->sqes == MAP_FAILED)
+   {
+      ring->sqes = NULL;
+      goto error;
+   }
+
+   ring->sq_tail = (unsigned*)((char*)ring->sq_ring + params.sq_off.tail);
+   ring->sq_mask = (unsigned*)((char*)ring->sq_ring + params.sq_off.ring_mask);
+   ring->sq_array = (unsigned*)((char*)ring->sq_ring + params.sq_off.array);
+   ring->cq_head = (unsigned*)((char*)ring->cq_ring + params.cq_off.head);
+   ring->cq_tail = (unsigned*)((char*)ring->cq_ring + params.cq_off.tail);
+   ring->cq_mask = (unsigned*)((char*)ring->cq_ring + params.cq_off.ring_mask);
+   ring->cqes = (struct io_uring_cqe*)((char*)ring->cq_ring + params.cq_off.cqes);
+
+   return ring;
+
+error:
+
+   ring_destroy(ring);
+
+   return NULL;
+#else
+   return NULL;
+#endif
+}
+
+static void
+ring_destroy(struct disk_ring* ring)
+{
+#ifdef HAVE_IO_URING
+   if (ring == NULL)
+   {
+      return;
+   }
+
+   if (ring->sqes != NULL)
+   {
+      munmap(ring->sqes, ring->sqes_size);
+   }
+
+   if (ring->cq_ring != NULL && ring->cq_ring != ring->sq_ring)
+   {
+      munmap(ring->cq_ring, ring->cq_ring_size);
+   }
+
+   if (ring->sq_ring != NULL)
+   {
+      munmap(ring->sq_ring, ring->sq_ring_size);
+   }
+
+   close(ring->fd);
+   free(ring);
+#else
+   (void)ring;
+#endif
+}
+
+static void
+read_directory(struct disk_worker* worker, struct disk_directory* directory)
+{
+   struct disk_batch* batch = NULL;
+   struct dirent* entry;
+   size_t length;
+
+   while ((entry = readdir(directory->dir)) != NULL)
+   {
+      if (entry->d_name[0] == '.' &&
+          (entry->d_name[1] == '\0' || (entry->d_name[1] == '.' && entry->d_name[2] == '\0')))
+      {
+         continue;
+      }
+
+      length = strlen(entry->d_name) + 1;
+
+      if (batch != NULL && (batch->count == DISK_BATCH_NAMES || batch->length + length > DISK_BATCH_SIZE))
+      {
+         if (!push_batch(worker->pool, worker->id, batch))
+         {
+            break;
+         }
+         batch = NULL;
+      }
+
+      if (batch == NULL)
+      {
+         batch = (struct disk_batch*)malloc(sizeof(struct disk_batch));
+         if (batch == NULL)
+         {
+            atomic_store(&worker->pool->stopped, true);
+            break;
+         }
+
+         batch->directory = directory;
+         batch->count = 0;
+         batch->length = 0;
+         atomic_fetch_add(&directory->references, 1);
+      }
+
+      memcpy(batch->names + batch->length, entry->d_name, length);
+      batch->length += length;
+      batch->count++;
+   }
+
+   if (batch != NULL && (batch->count == 0 || !push_batch(worker->pool, worker->id, batch)))
+   {
+      release_directory(directory);
+      free(batch);
+   }
+
+   /* The reader's reference */
+   release_directory(directory);
+}
+
+static struct disk_directory*
+new_directory(int fd, int root, bool top)
+{
+   struct disk_directory* directory;
+
+   directory = (struct disk_directory*)malloc(sizeof(struct disk_directory));
+   if (directory == NULL)
+   {
+      return NULL;
+   }
+
+   directory->dir = fdopendir(fd);
+   if (directory->dir == NULL)
+   {
+      free(directory);
+      return NULL;
+   }
+
+   directory->root = root;
+   directory->top = top;
+   directory->node = -1;
+   directory->path = NULL;
+   atomic_init(&directory->references, 1);
+
+   return directory;
+}
+
+static void
+release_directory(struct disk_directory* directory)
+{
+   if (atomic_fetch_sub(&directory->references, 1) == 1)
+   {
+      closedir(directory->dir);
+      free(directory->path);
+      free(directory);
+   }
+}
+
+static bool
+push_batch(struct disk_pool* pool, int id, struct disk_batch* batch)
+{
+   struct disk_queue* queue = &pool->queues[id];
+   struct disk_batch** batches;
+   int capacity;
+
+   pthread_mutex_lock(&queue->lock);
+
+   if (queue->tail == queue->capacity)
+   {
+      /* Reuse the room of the stolen batches before growing */
+      if (queue->head > 0)
+      {
+         memmove(queue->batches, queue->batches + queue->head, (queue->tail - queue->head) * sizeof(struct disk_batch*));
+         queue->tail -= queue->head;
+         queue->head = 0;
+      }
+      else
+      {
+         capacity = queue->capacity == 0 ? 64 : queue->capacity * 2;
+         batches = (struct disk_batch**)realloc(queue->batches, capacity * sizeof(struct disk_batch*));
+         if (batches == NULL)
+         {
+            pthread_mutex_unlock(&queue->lock);
+            atomic_store(&pool->stopped, true);
+            return false;
+         }
+
+         queue->batches = batches;
+         queue->capacity = capacity;
+      }
+   }
+
+   queue->batches[queue->tail++] = batch;
+   atomic_fetch_add(&pool->pending, 1);
+
+   pthread_mutex_unlock(&queue->lock);
+
+   return true;
+}
+
+static struct disk_batch*
+take_batch(struct disk_pool* pool, int id)
+{
+   struct disk_queue* queue;
+   struct disk_batch* batch = NULL;
+
+   /* The newest batch of its own queue, whose directory was just read */
+   queue = &pool->queues[id];
+   pthread_mutex_lock(&queue->lock);
+   if (queue->tail > queue->head)
+   {
+      batch = queue->batches[--queue->tail];
+   }
+   pthread_mutex_unlock(&queue->lock);
+
+   /* Otherwise the oldest batch of another queue */
+   for (int i = 1; batch == NULL && i < pool->workers; i++)
+   {
+      queue = &pool->queues[(id + i) % pool->workers];
+
+      pthread_mutex_lock(&queue->lock);
+      if (queue->tail > queue->head)
+      {
+         batch = queue->batches[queue->head++];
+      }
+      pthread_mutex_unlock(&queue->lock);
+   }
+
+   return batch;
+}
+
+uint64_t
+pgexporter_ext_disk_path_hash(const char* path)
+{
+   uint64_t hash = HASH_SEED;
+
+   for (const char* p = path; *p != '\0'; p++)
+   {
+      hash = (hash ^ (unsigned char)*p) * HASH_PRIME;
+   }
+
+   return hash;
+}
+
+struct disk_cache*
+pgexporter_ext_disk_cache_create(void)
+{
+   struct disk_cache* cache;
+
+   cache = (struct disk_cache*)calloc(1, sizeof(struct disk_cache));
+   if (cache == NULL)
+   {
+      return NULL;
+   }
+
+   cache->fd = -1;
+   cache->files_capacity = DISK_CACHE_FILES;
+   cache->files = (struct disk_file*)calloc(cache->files_capacity, sizeof(struct disk_file));
+   if (cache->files == NULL)
+   {
+      free(cache);
+      return NULL;
+   }
+
+   return cache;
+}
+
+int
+pgexporter_ext_disk_cache_build(struct disk_cache* cache, char** paths, int number_of_paths, int workers, bool io_uring,
+                                bool (*interrupted)(void))
+{
+   struct disk_root* roots;
+   int n = 0;
+   int ret = 0;
+
+   clear_cache(cache);
+
+#ifdef HAVE_LINUX
+   /* A new descriptor drops the watches of the previous build at once */
+   cache->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+
+   cache->complete = cache->fd != -1;
+   cache->stale = false;
+   cache->attached = false;
+
+   if (number_of_paths == 0)
+   {
+      return 0;
+   }
+
+   roots = (struct disk_root*)calloc(number_of_paths, sizeof(struct disk_root));
+   if (roots == NULL)
+   {
+      cache->stale = true;
+      return 1;
+   }
+
+   for (int i = 0; i < number_of_paths; i++)
+   {
+      if (strlen(paths[i]) < sizeof(roots[n].path))
+      {
+         memcpy(roots[n].path, paths[i], strlen(paths[i]) + 1);
+         n++;
+      }
+   }
+
+   /* Only the build is stopped, the trees added for the events are small */
+   cache->interrupted = interrupted;
+
+   if (walk_pool(roots, n, workers, io_uring, interrupted, cache))
+   {
+      cache->stale = true;
+      ret = 1;
+   }
+
+   cache->interrupted = NULL;
+
+   free(roots);
+
+   return ret;
+}
+
+int
+pgexporter_ext_disk_cache_process(struct disk_cache* cache)
+{
+   int count;
+
+   count = read_events(cache);
+
+   update_directories(cache);
+   compact_nodes(cache);
+
+   return count;
+}
+
+int
+pgexporter_ext_disk_cache_directories(struct disk_cache* cache, struct disk_directory_usage* directories, int max)
+{
+   int n = 0;
+   bool deeper = true;
+
+   /* The shallowest directories first, as they are the ones asked for */
+   for (int depth = 0; deeper && n < max; depth++)
+   {
+      deeper = false;
+
+      for (int i = 0; i < cache->number_of_nodes && n < max; i++)
+      {
+         if (!cache->nodes[i].used)
+         {
+            continue;
+         }
+
+         if (cache->nodes[i].depth == depth)
+         {
+            directories[n].hash = cache->nodes[i].hash;
+            directories[n].usage = cache->nodes[i].usage;
+            n++;
+         }
+         else if (cache->nodes[i].depth > depth)
+         {
+            deeper = true;
+         }
+      }
+   }
+
+   qsort(directories, n, sizeof(struct disk_directory_usage), compare_directories);
+
+   return n;
+}
+
+void
+pgexporter_ext_disk_cache_destroy(struct disk_cache* cache)
+{
+   if (cache == NULL)
+   {
+      return;
+   }
+
+   clear_cache(cache);
+
+   free(cache->nodes);
+   free(cache->watches);
+   free(cache->files);
+   free(cache);
+}
+
+int
+pgexporter_ext_disk_mounts(const char* mountinfo, struct disk_mount** mounts, int* number_of_mounts)
+{
+   struct disk_mount* result = NULL;
+   struct disk_mount* m;
+   int capacity = 0;
+   int n = 0;
+   FILE* file;
+   char line[4 * MAX_PATH];
+   char* fields[6];
+   char* saveptr;
+   char* token;
+   int c;
+   int i;
+
+   *mounts = NULL;
+   *number_of_mounts = 0;
+
+   file = fopen(mountinfo, "r");
+   if (file == NULL)
+   {
+      return 1;
+   }
+
+   while (fgets(line, sizeof(line), file) != NULL)
+   {
+      /* Skip what is left of a line too long for the buffer */
+      if (strchr(line, '\n') == NULL)
+      {
+         while ((c = fgetc(file)) != EOF && c != '\n')
+         {
+         }
+         continue;
+      }
+
+      /* 36 35 98:0 /mnt1 /mnt2 rw,noatime master:1 - ext3 /dev/root rw,errors=continue */
+      i = 0;
+      token = strtok_r(line, " \n", &saveptr);
+      while (token != NULL && i < 5)
+      {
+         fields[i++] = token;
+         token = strtok_r(NULL, " \n", &saveptr);
+      }
+
+      /* The optional fields end with a - before the type */
+      while (token != NULL && strcmp(token, "-") != 0)
+      {
+         token = strtok_r(NULL, " \n", &saveptr);
+      }
+
+      if (token != NULL)
+      {
+         token = strtok_r(NULL, " \n", &saveptr);
+      }
+
+      if (i < 5 || token == NULL)
+      {
+         continue;
+      }
+      fields[5] = token;
+
+      if (n == capacity)
+      {
+         capacity = capacity == 0 ? 64 : capacity * 2;
+         m = (struct disk_mount*)realloc(result, capacity * sizeof(struct disk_mount));
+         if (m == NULL)
+         {
+            goto error;
+         }
+         result = m;
+      }
+
+      m = &result[n];
+      memset(m, 0, sizeof(struct disk_mount));
+
+      if (sscanf(fields[2], "%u:%u", &m->major, &m->minor) != 2)
+      {
+         continue;
+      }
+
+      unescape(fields[4]);
+      snprintf(m->mount_point, sizeof(m->mount_point), "%s", fields[4]);
+      snprintf(m->type, sizeof(m->type), "%s", fields[5]);
+
+      token = strtok_r(NULL, " \n", &saveptr);
+      if (token != NULL)
+      {
+         unescape(token);
+         snprintf(m->source, sizeof(m->source), "%s", token);
+      }
+
+      n++;
+   }
+
+   fclose(file);
+
+   *mounts = result;
+   *number_of_mounts = n;
+
+   return 0;
+
+error:
+
+   fclose(file);
+   free(result);
+
+   return 1;
+}
+
+int
+pgexporter_ext_disk_mount(struct disk_mount* mounts, int number_of_mounts, const char* path, unsigned int major, unsigned int minor)
+{
+   int best = -1;
+   size_t best_length = 0;
+   size_t length;
+
+   /* A bind mount or an overlay may show a path under a mount of another device */
+   for (int pass = 0; best == -1 && pass < 2; pass++)
+   {
+      for (int i = 0; i < number_of_mounts; i++)
+      {
+         if (pass == 0 && (mounts[i].major != major || mounts[i].minor != minor))
+         {
+            continue;
+         }
+
+         if (!is_under(path, mounts[i].mount_point))
+         {
+            continue;
+         }
+
+         length = strlen(mounts[i].mount_point);
+         if (best == -1 || length >= best_length)
+         {
+            best = i;
+            best_length = length;
+         }
+      }
+   }
+
+   return best;
+}
+
+static void
+clear_cache(struct disk_cache* cache)
+{
+#ifdef HAVE_LINUX
+   if (cache->fd != -1)
+   {
+      close(cache->fd);
+   }
+#endif
+   cache->fd = -1;
+
+   for (int i = 0; i < cache->number_of_nodes; i++)
+   {
+      free(cache->nodes[i].name);
+   }
+   cache->number_of_nodes = 0;
+
+   for (int i = 0; i < cache->watches_capacity; i++)
+   {
+      cache->watches[i] = -1;
+   }
+
+   memset(cache->files, 0, cache->files_capacity * sizeof(struct disk_file));
+   cache->number_of_files = 0;
+}
+
+static int
+read_events(struct disk_cache* cache)
+{
+#ifdef HAVE_LINUX
+   char buffer[DISK_EVENTS_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+   struct inotify_event* event;
+   ssize_t length;
+   int count = 0;
+
+   if (cache->fd == -1)
+   {
+      return 0;
+   }
+
+   /* Bounded, so a steady stream of writes can't keep the caller here */
+   for (int i = 0; i < DISK_EVENT_READS; i++)
+   {
+      length = read(cache->fd, buffer, sizeof(buffer));
+      if (length <= 0)
+      {
+         break;
+      }
+
+      for (char* p = buffer; p < buffer + length; p += sizeof(struct inotify_event) + event->len)
+      {
+         event = (struct inotify_event*)p;
+         apply_event(cache, event);
+         count++;
+      }
+   }
+
+   return count;
+#else
+   (void)cache;
+   return 0;
+#endif
+}
+
+static int
+add_tree(struct disk_cache* cache, int parent, const char* name, const char* path, int* top)
+{
+   struct disk_frame stack[DISK_STACK_SIZE];
+   struct disk_frame* frames = stack;
+   struct disk_frame* grown = NULL;
+   int capacity = DISK_STACK_SIZE;
+   int depth = 0;
+   char buffer[PATH_MAX];
+   size_t length;
+   struct dirent* entry;
+   struct disk_usage delta;
+   struct stat st;
+   int node;
+   int fd;
+
+   *top = -1;
+
+   length = strlen(path);
+   if (length >= sizeof(buffer))
+   {
+      return 0;
+   }
+   memcpy(buffer, path, length + 1);
+
+   fd = open(buffer, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+   if (fd == -1)
+   {
+      return 0;
+   }
+
+   node = new_node(cache, parent, name, buffer, fd);
+   if (node == -1 || (frames[0].dir = fdopendir(fd)) == NULL)
+   {
+      close(fd);
+      return 1;
+   }
+   frames[0].node = node;
+   frames[0].length = length;
+   depth = 1;
+   *top = node;
+
+   /* The directory is watched before it is read, so an entry created in
+    * between is seen by both, which set_file() makes harmless */
+   while (depth > 0)
+   {
+      if (cache->interrupted != NULL && cache->interrupted())
+      {
+         goto error;
+      }
+
+      entry = readdir(frames[depth - 1].dir);
+      if (entry == NULL)
+      {
+         closedir(frames[--depth].dir);
+         if (depth > 0)
+         {
+            add_usage(&cache->nodes[frames[depth - 1].node].usage, &cache->nodes[frames[depth].node].usage);
+         }
+         continue;
+      }
+
+      if (entry->d_name[0] == '.' &&
+          (entry->d_name[1] == '\0' || (entry->d_name[1] == '.' && entry->d_name[2] == '\0')))
+      {
+         continue;
+      }
+
+      length = frames[depth - 1].length;
+      if (length + 1 + strlen(entry->d_name) >= sizeof(buffer))
+      {
+         continue;
+      }
+      buffer[length] = '/';
+      strcpy(buffer + length + 1, entry->d_name);
+
+      if (entry->d_type == DT_DIR || entry->d_type == DT_UNKNOWN)
+      {
+         fd = openat(dirfd(frames[depth - 1].dir), entry->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+         if (fd != -1)
+         {
+            if (depth == capacity)
+            {
+               grown = (struct disk_frame*)malloc(2 * capacity * sizeof(struct disk_frame));
+               if (grown == NULL)
+               {
+                  close(fd);
+                  goto error;
+               }
+
+               memcpy(grown, frames, depth * sizeof(struct disk_frame));
+               if (frames != stack)
+               {
+                  free(frames);
+               }
+               frames = grown;
+               capacity *= 2;
+            }
+
+            node = new_node(cache, frames[depth - 1].node, entry->d_name, buffer, fd);
+            if (node == -1 || (frames[depth].dir = fdopendir(fd)) == NULL)
+            {
+               close(fd);
+               goto error;
+            }
+            frames[depth].node = node;
+            frames[depth].length = strlen(buffer);
+            depth++;
+            continue;
+         }
+      }
+
+      if (fstatat(dirfd(frames[depth - 1].dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 && !S_ISDIR(st.st_mode))
+      {
+         if (set_file(cache, frames[depth - 1].node, entry->d_name, (uint64_t)st.st_blocks, &delta))
+         {
+            goto error;
+         }
+         add_usage(&cache->nodes[frames[depth - 1].node].usage, &delta);
+      }
+   }
+
+   if (frames != stack)
+   {
+      free(frames);
+   }
+
+   return 0;
+
+error:
+
+   while (depth > 0)
+   {
+      closedir(frames[--depth].dir);
+   }
+
+   if (frames != stack)
+   {
+      free(frames);
+   }
+
+   return 1;
+}
+
+static int
+new_node(struct disk_cache* cache, int parent, const char* name, const char* path, int fd)
+{
+   struct disk_node* nodes;
+   struct disk_node* node;
+   struct stat st;
+   int capacity;
+   int* watches;
+   int wd;
+   int n;
+
+   if (cache->number_of_nodes == cache->nodes_capacity)
+   {
+      capacity = cache->nodes_capacity == 0 ? 64 : 2 * cache->nodes_capacity;
+      nodes = (struct disk_node*)realloc(cache->nodes, capacity * sizeof(struct disk_node));
+      if (nodes == NULL)
+      {
+         return -1;
+      }
+
+      cache->nodes = nodes;
+      cache->nodes_capacity = capacity;
+   }
+
+   n = cache->number_of_nodes;
+   node = &cache->nodes[n];
+
+   memset(node, 0, sizeof(struct disk_node));
+   node->name = strdup(name);
+   if (node->name == NULL)
+   {
+      return -1;
+   }
+
+   node->parent = parent;
+   node->depth = parent == -1 ? 0 : cache->nodes[parent].depth + 1;
+   node->used = true;
+   node->hash = pgexporter_ext_disk_path_hash(path);
+   node->wd = -1;
+
+   if (fstat(fd, &st) == 0)
+   {
+      node->blocks = (uint64_t)st.st_blocks;
+   }
+   node->usage.bytes = node->blocks * 512;
+   node->usage.directories = 1;
+
+   cache->number_of_nodes++;
+
+#ifdef HAVE_LINUX
+   if (cache->fd != -1)
+   {
+      wd = inotify_add_watch(cache->fd, path, DISK_WATCH_EVENTS);
+      if (wd == -1)
+      {
+         /* Most likely fs.inotify.max_user_watches */
+         cache->complete = false;
+         return n;
+      }
+
+      if (wd >= cache->watches_capacity)
+      {
+         capacity = cache->watches_capacity == 0 ? 64 : cache->watches_capacity;
+         while (wd >= capacity)
+         {
+            capacity *= 2;
+         }
+
+         watches = (int*)realloc(cache->watches, capacity * sizeof(int));
+         if (watches == NULL)
+         {
+            inotify_rm_watch(cache->fd, wd);
+            cache->complete = false;
+            return n;
+         }
+
+         for (int i = cache->watches_capacity; i < capacity; i++)
+         {
+            watches[i] = -1;
+         }
+
+         cache->watches = watches;
+         cache->watches_capacity = capacity;
+      }
+
+      cache->watches[wd] = n;
+      node->wd = wd;
+   }
+#else
+   (void)path;
+   (void)watches;
+   (void)wd;
+#endif
+
+   return n;
+}
+
+static void
+drop_node(struct disk_cache* cache, int node)
+{
+#ifdef HAVE_LINUX
+   if (cache->nodes[node].wd != -1)
+   {
+      inotify_rm_watch(cache->fd, cache->nodes[node].wd);
+      cache->watches[cache->nodes[node].wd] = -1;
+   }
+#endif
+
+   free(cache->nodes[node].name);
+   cache->nodes[node].name = NULL;
+   cache->nodes[node].wd = -1;
+   cache->nodes[node].used = false;
+}
+
+static int
+node_path(struct disk_cache* cache, int node, const char* name, char* path, size_t size)
+{
+   size_t length = 0;
+   size_t n;
+
+   if (cache->nodes[node].parent != -1)
+   {
+      if (node_path(cache, cache->nodes[node].parent, cache->nodes[node].name, path, size))
+      {
+         return 1;
+      }
+   }
+   else
+   {
+      n = strlen(cache->nodes[node].name);
+      if (n >= size)
+      {
+         return 1;
+      }
+      memcpy(path, cache->nodes[node].name, n + 1);
+   }
+
+   if (name == NULL)
+   {
+      return 0;
+   }
+
+   length = strlen(path);
+   n = strlen(name);
+   if (length + 1 + n >= size)
+   {
+      return 1;
+   }
+
+   path[length] = '/';
+   memcpy(path + length + 1, name, n + 1);
+
+   return 0;
+}
+
+static int
+find_child(struct disk_cache* cache, int node, const char* name)
+{
+   /* Children always come after their parent */
+   for (int i = node + 1; i < cache->number_of_nodes; i++)
+   {
+      if (cache->nodes[i].used && cache->nodes[i].parent == node && strcmp(cache->nodes[i].name, name) == 0)
+      {
+         return i;
+      }
+   }
+
+   return -1;
+}
+
+static int
+attach_tree(struct disk_cache* cache, int parent, const char* name)
+{
+   char path[PATH_MAX];
+   int node;
+
+   if (node_path(cache, parent, name, path, sizeof(path)))
+   {
+      return 0;
+   }
+
+   if (add_tree(cache, parent, name, path, &node))
+   {
+      return 1;
+   }
+
+   if (node != -1)
+   {
+      add_up(cache, parent, &cache->nodes[node].usage);
+      cache->attached = true;
+   }
+
+   return 0;
+}
+
+static void
+remove_tree(struct disk_cache* cache, int node)
+{
+   struct disk_usage delta;
+   int parent;
+
+   delta.bytes = 0 - cache->nodes[node].usage.bytes;
+   delta.files = 0 - cache->nodes[node].usage.files;
+   delta.directories = 0 - cache->nodes[node].usage.directories;
+   add_up(cache, cache->nodes[node].parent, &delta);
+
+   /* A node whose parent was dropped before it is part of the tree, as
+    * nothing is ever added below a dropped node */
+   drop_node(cache, node);
+   for (int i = node + 1; i < cache->number_of_nodes; i++)
+   {
+      parent = cache->nodes[i].parent;
+      if (cache->nodes[i].used && parent >= node && !cache->nodes[parent].used)
+      {
+         drop_node(cache, i);
+      }
+   }
+
+   /* The files of a directory moved out of the trees stay in the table
+    * until the nodes are compacted, but they can't be found anymore */
+}
+
+static void
+update_file(struct disk_cache* cache, int node, const char* name)
+{
+   char path[PATH_MAX];
+   struct disk_usage delta;
+   struct stat st;
+
+   if (node_path(cache, node, name, path, sizeof(path)))
+   {
+      return;
+   }
+
+   if (lstat(path, &st) != 0)
+   {
+      if (errno == ENOENT || errno == ENOTDIR)
+      {
+         remove_file(cache, node, name, &delta);
+         add_up(cache, node, &delta);
+      }
+      return;
+   }
+
+   /* A new directory has its own event */
+   if (S_ISDIR(st.st_mode))
+   {
+      return;
+   }
+
+   if (set_file(cache, node, name, (uint64_t)st.st_blocks, &delta))
+   {
+      cache->stale = true;
+      return;
+   }
+
+   add_up(cache, node, &delta);
+}
+
+static void
+update_directories(struct disk_cache* cache)
+{
+   char path[PATH_MAX];
+   struct disk_usage delta;
+   struct stat st;
+
+   /* A directory grows with its entries, once per batch of events */
+   for (int i = 0; i < cache->number_of_nodes; i++)
+   {
+      if (!cache->nodes[i].used || !cache->nodes[i].changed)
+      {
+         continue;
+      }
+
+      cache->nodes[i].changed = false;
+
+      if (node_path(cache, i, NULL, path, sizeof(path)) || lstat(path, &st) != 0)
+      {
+         continue;
+      }
+
+      memset(&delta, 0, sizeof(struct disk_usage));
+      delta.bytes = ((uint64_t)st.st_blocks - cache->nodes[i].blocks) * 512;
+      cache->nodes[i].blocks = (uint64_t)st.st_blocks;
+      add_up(cache, i, &delta);
+   }
+}
+
+#ifdef HAVE_LINUX
+static void
+apply_event(struct disk_cache* cache, struct inotify_event* event)
+{
+   struct disk_usage delta;
+   int node;
+   int child;
+
+   if (event->mask & IN_Q_OVERFLOW)
+   {
+      cache->stale = true;
+      return;
+   }
+
+   if (event->wd < 0 || event->wd >= cache->watches_capacity || (node = cache->watches[event->wd]) == -1)
+   {
+      return;
+   }
+
+   if (event->mask & IN_IGNORED)
+   {
+      cache->watches[event->wd] = -1;
+      cache->nodes[node].wd = -1;
+
+      /* A directory below a root is dropped by the event of its parent */
+      if (cache->nodes[node].used && cache->nodes[node].parent == -1)
+      {
+         cache->stale = true;
+      }
+      return;
+   }
+
+   if (!cache->nodes[node].used)
+   {
+      return;
+   }
+
+   if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+   {
+      if (cache->nodes[node].parent == -1)
+      {
+         cache->stale = true;
+      }
+      return;
+   }
+
+   if (event->len == 0)
+   {
+      return;
+   }
+
+   if (event->mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO))
+   {
+      cache->nodes[node].changed = true;
+   }
+
+   if (event->mask & IN_ISDIR)
+   {
+      child = find_child(cache, node, event->name);
+
+      if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+      {
+         if (child != -1)
+         {
+            remove_tree(cache, child);
+         }
+      }
+      else if (event->mask & (IN_CREATE | IN_MOVED_TO))
+      {
+         if (child == -1 && attach_tree(cache, node, event->name))
+         {
+            cache->stale = true;
+         }
+      }
+      return;
+   }
+
+   if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+   {
+      remove_file(cache, node, event->name, &delta);
+      add_up(cache, node, &delta);
+   }
+   else
+   {
+      update_file(cache, node, event->name);
+   }
+}
+#endif
+
+static void
+compact_nodes(struct disk_cache* cache)
+{
+   int* map;
+   int used = 0;
+   int n = 0;
+
+   for (int i = 0; i < cache->number_of_nodes; i++)
+   {
+      used += cache->nodes[i].used ? 1 : 0;
+   }
+
+   /* Directories come and go, f.ex. the temporary file sets of parallel queries */
+   if (cache->number_of_nodes < 64 || used > cache->number_of_nodes / 2)
+   {
+      return;
+   }
+
+   map = (int*)malloc(cache->number_of_nodes * sizeof(int));
+   if (map == NULL)
+   {
+      return;
+   }
+
+   /* The order is kept, so a parent still comes before its children */
+   for (int i = 0; i < cache->number_of_nodes; i++)
+   {
+      map[i] = -1;
+      if (!cache->nodes[i].used)
+      {
+         continue;
+      }
+
+      map[i] = n;
+      cache->nodes[n] = cache->nodes[i];
+      if (cache->nodes[n].parent != -1)
+      {
+         cache->nodes[n].parent = map[cache->nodes[n].parent];
+      }
+      if (cache->nodes[n].wd != -1)
+      {
+         cache->watches[cache->nodes[n].wd] = n;
+      }
+      n++;
+   }
+   cache->number_of_nodes = n;
+
+   for (size_t i = 0; i < cache->files_capacity; i++)
+   {
+      if (cache->files[i].key != 0)
+      {
+         cache->files[i].node = map[cache->files[i].node];
+      }
+   }
+
+   free(map);
+
+   /* Drops the files of the directories that were moved out */
+   if (rehash_files(cache, cache->files_capacity))
+   {
+      cache->stale = true;
+   }
+}
+
+static uint64_t
+file_key(struct disk_cache* cache, int node, const char* name)
+{
+   uint64_t hash = cache->nodes[node].hash;
+
+   for (const char* p = name; *p != '\0'; p++)
+   {
+      hash = (hash ^ (unsigned char)*p) * HASH_PRIME;
+   }
+
+   /* 0 marks a free slot */
+   return hash == 0 ? 1 : hash;
+}
+
+static size_t
+find_file(struct disk_cache* cache, uint64_t key, int node)
+{
+   size_t mask = cache->files_capacity - 1;
+   size_t i = key & mask;
+
+   while (cache->files[i].key != 0)
+   {
+      if (cache->files[i].key == key && cache->files[i].node == node)
+      {
+         break;
+      }
+      i = (i + 1) & mask;
+   }
+
+   return i;
+}
+
+static int
+set_file(struct disk_cache* cache, int node, const char* name, uint64_t blocks, struct disk_usage* delta)
+{
+   uint64_t key;
+   size_t i;
+
+   memset(delta, 0, sizeof(struct disk_usage));
+
+   if ((cache->number_of_files + 1) * 4 > cache->files_capacity * 3)
+   {
+      if (rehash_files(cache, 2 * cache->files_capacity))
+      {
+         return 1;
+      }
+   }
+
+   key = file_key(cache, node, name);
+   i = find_file(cache, key, node);
+
+   /* The differences wrap around, so adding them subtracts when a file shrinks */
+   if (cache->files[i].key == 0)
+   {
+      cache->files[i].key = key;
+      cache->files[i].node = node;
+      cache->files[i].blocks = blocks;
+      cache->number_of_files++;
+
+      delta->bytes = blocks * 512;
+      delta->files = 1;
+   }
+   else
+   {
+      delta->bytes = (blocks - cache->files[i].blocks) * 512;
+      cache->files[i].blocks = blocks;
+   }
+
+   return 0;
+}
+
+static void
+remove_file(struct disk_cache* cache, int node, const char* name, struct disk_usage* delta)
+{
+   size_t mask = cache->files_capacity - 1;
+   size_t i;
+   size_t j;
+   size_t home;
+   bool between;
+
+   memset(delta, 0, sizeof(struct disk_usage));
+
+   i = find_file(cache, file_key(cache, node, name), node);
+   if (cache->files[i].key == 0)
+   {
+      return;
+   }
+
+   delta->bytes = 0 - cache->files[i].blocks * 512;
+   delta->files = 0 - (uint64_t)1;
+   cache->number_of_files--;
+
+   /* Shift the following entries back instead of leaving a tombstone */
+   j = i;
+   for (;;)
+   {
+      j = (j + 1) & mask;
+      if (cache->files[j].key == 0)
+      {
+         break;
+      }
+
+      home = cache->files[j].key & mask;
+      between = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+      if (!between)
+      {
+         cache->files[i] = cache->files[j];
+         i = j;
+      }
+   }
+
+   cache->files[i].key = 0;
+}
+
+static int
+rehash_files(struct disk_cache* cache, size_t capacity)
+{
+   struct disk_file* old = cache->files;
+   size_t old_capacity = cache->files_capacity;
+   size_t i;
+
+   cache->files = (struct disk_file*)calloc(capacity, sizeof(struct disk_file));
+   if (cache->files == NULL)
+   {
+      cache->files = old;
+      return 1;
+   }
+
+   cache->files_capacity = capacity;
+   cache->number_of_files = 0;
+
+   for (size_t j = 0; j < old_capacity; j++)
+   {
+      if (old[j].key == 0 || old[j].node == -1 || !cache->nodes[old[j].node].used)
+      {
+         continue;
+      }
+
+      i = find_file(cache, old[j].key, old[j].node);
+      cache->files[i] = old[j];
+      cache->number_of_files++;
+   }
+
+   free(old);
+
+   return 0;
+}
+
+static void
+add_up(struct disk_cache* cache, int node, struct disk_usage* delta)
+{
+   while (node != -1)
+   {
+      add_usage(&cache->nodes[node].usage, delta);
+      node = cache->nodes[node].parent;
+   }
+}
+
+static void
+add_usage(struct disk_usage* usage, struct disk_usage* delta)
+{
+   usage->bytes += delta->bytes;
+   usage->files += delta->files;
+   usage->directories += delta->directories;
+}
+
+static int
+compare_directories(const void* a, const void* b)
+{
+   const struct disk_directory_usage* da = (const struct disk_directory_usage*)a;
+   const struct disk_directory_usage* db = (const struct disk_directory_usage*)b;
+
+   if (da->hash != db->hash)
+   {
+      return da->hash < db->hash ? -1 : 1;
+   }
+
+   return 0;
+}
+
+static void
+unescape(char* s)
+{
+   char* from = s;
+   char* to = s;
+
+   while (*from != '\0')
+   {
+      if (from[0] == '\\' &&
+          from[1] >= '0' && from[1] <= '3' &&
+          from[2] >= '0' && from[2] <= '7' &&
+          from[3] >= '0' && from[3] <= '7')
+      {
+         *to++ = (char)(((from[1] - '0') << 6) | ((from[2] - '0') << 3) | (from[3] - '0'));
+         from += 4;
+      }
+      else
+      {
+         *to++ = *from++;
+      }
+   }
+
+   *to = '\0';
+}
+
+static bool
+is_under(const char* path, const char* mount_point)
+{
+   size_t length = strlen(mount_point);
+
+   if (strcmp(mount_point, "/") == 0)
+   {
+      return path[0] == '/';
+   }
+
+   return strncmp(path, mount_point, length) == 0 && (path[length] == '\0' || path[length] == '/');
+}
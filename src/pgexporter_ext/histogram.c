@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgexporter */
+#include <pgexporter_ext.h>
+#include <histogram.h>
+
+/* system */
+#include <string.h>
+
+#define SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+
+static int bucket_index(uint64_t value);
+static uint64_t bucket_value(int index);
+
+void
+pgexporter_ext_histogram_add(struct log_histogram* histogram, uint64_t value)
+{
+   if (histogram->count == 0 || value < histogram->min)
+   {
+      histogram->min = value;
+   }
+
+   if (value > histogram->max)
+   {
+      histogram->max = value;
+   }
+
+   histogram->count++;
+   histogram->sum += value;
+   histogram->buckets[bucket_index(value)]++;
+}
+
+void
+pgexporter_ext_histogram_merge(struct log_histogram* histogram, struct log_histogram* other)
+{
+   if (other->count == 0)
+   {
+      return;
+   }
+
+   if (histogram->count == 0 || other->min < histogram->min)
+   {
+      histogram->min = other->min;
+   }
+
+   if (other->max > histogram->max)
+   {
+      histogram->max = other->max;
+   }
+
+   histogram->count += other->count;
+   histogram->sum += other->sum;
+
+   for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+   {
+      histogram->buckets[i] += other->buckets[i];
+   }
+}
+
+uint64_t
+pgexporter_ext_histogram_quantile(struct log_histogram* histogram, double quantile)
+{
+   uint64_t rank;
+   uint64_t seen = 0;
+   uint64_t value;
+
+   if (histogram->count == 0)
+   {
+      return 0;
+   }
+
+   /* The smallest value with at least that share of the values at or below it */
+   rank = (uint64_t)(quantile * histogram->count);
+   if (rank < quantile * histogram->count || rank < 1)
+   {
+      rank++;
+   }
+
+   for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+   {
+      seen += histogram->buckets[i];
+
+      if (seen >= rank)
+      {
+         /* The exact extremes are known, so stay within them */
+         value = bucket_value(i);
+         if (value < histogram->min)
+         {
+            value = histogram->min;
+         }
+         if (value > histogram->max)
+         {
+            value = histogram->max;
+         }
+
+         return value;
+      }
+   }
+
+   return histogram->max;
+}
+
+static int
+bucket_index(uint64_t value)
+{
+   int bits;
+
+   if (value < SUB_BUCKETS)
+   {
+      return (int)value;
+   }
+
+   bits = 63 - __builtin_clzll(value);
+   if (bits >= HISTOGRAM_MAX_BITS)
+   {
+      return HISTOGRAM_BUCKETS - 1;
+   }
+
+   /* The position of the leading bit picks the group, the next bits the bucket in it */
+   return ((bits - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS) +
+          (int)((value >> (bits - HISTOGRAM_SUB_BITS)) & (SUB_BUCKETS - 1));
+}
+
+static uint64_t
+bucket_value(int index)
+{
+   int group = index >> HISTOGRAM_SUB_BITS;
+   uint64_t sub = index & (SUB_BUCKETS - 1);
+
+   if (group == 0)
+   {
+      return sub;
+   }
+
+   /* The middle of the bucket */
+   return ((SUB_BUCKETS + sub) << (group - 1)) + ((1ULL << (group - 1)) >> 1);
+}
@@ -0,0 +1,606 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgexporter */
+#include <pgexporter_ext.h>
+#include <logs.h>
+
+/* system */
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LABELS_INITIAL_CAPACITY 16
+
+#define HASH_SEED  0xcbf29ce484222325ULL
+#define HASH_PRIME 0x100000001b3ULL
+
+static int escape_label(char escape);
+static bool match_text(const char* p, const char* text, size_t length);
+static const char* find_text(const char* p, const char* end, const struct log_prefix_step* step);
+static const char* find_text_backward(const char* start, const char* p, const struct log_prefix_step* step);
+static void set_value(struct log_label_key* key, int label, const char* start, const char* end, bool padded);
+static void key_of(struct log_label* label, struct log_label_key* key);
+static uint64_t hash_key(struct log_label_key* key);
+static int lookup(struct log_labels* labels, uint64_t hash);
+static int grow(struct log_labels* labels);
+
+int
+pgexporter_ext_log_prefix_compile(const char* format, struct log_prefix* prefix)
+{
+   struct log_prefix_step* step = NULL;
+   const char* p = format;
+   bool padded;
+   char c;
+
+   memset(prefix, 0, sizeof(struct log_prefix));
+
+   while (*p != '\0')
+   {
+      if (*p == '%' && *(p + 1) != '%')
+      {
+         p++;
+         padded = false;
+
+         if (*p == '-')
+         {
+            p++;
+         }
+         while (isdigit((unsigned char)*p))
+         {
+            p++;
+            padded = true;
+         }
+
+         if (*p == '\0')
+         {
+            break;
+         }
+
+         /* %q only ends the prefix of processes without a session, which then
+          * simply don't match the rest of the steps */
+         if (*p == 'q')
+         {
+            p++;
+            continue;
+         }
+
+         if (prefix->size == LOG_PREFIX_STEPS)
+         {
+            goto error;
+         }
+
+         step = &prefix->steps[prefix->size++];
+         step->kind = escape_label(*p);
+         step->padded = padded;
+
+         if (step->kind == LOG_FIELD_SQLSTATE)
+         {
+            prefix->sqlstate = true;
+         }
+         else if (step->kind >= 0)
+         {
+            prefix->labeled = true;
+         }
+
+         step = NULL;
+         p++;
+         continue;
+      }
+
+      c = *p;
+      p += *p == '%' ? 2 : 1;
+
+      if (step == NULL || step->length == LOG_PREFIX_TEXT_SIZE)
+      {
+         if (prefix->size == LOG_PREFIX_STEPS)
+         {
+            goto error;
+         }
+
+         step = &prefix->steps[prefix->size++];
+         step->kind = LOG_PREFIX_TEXT;
+      }
+
+      step->text[step->length++] = c;
+   }
+
+   /* Only the labels up to the last other escape need the steps from the start */
+   prefix->backward = 0;
+   prefix->forward = 0;
+
+   for (int i = 0; i < prefix->size; i++)
+   {
+      if (prefix->steps[i].kind == LOG_PREFIX_SKIP)
+      {
+         prefix->backward = i + 1;
+      }
+   }
+
+   for (int i = 0; i < prefix->backward; i++)
+   {
+      if (prefix->steps[i].kind >= 0)
+      {
+         prefix->forward = i + 1;
+      }
+   }
+
+   /* Search the texts for their least common character, a punctuation character if there is one */
+   for (int i = 0; i < prefix->size; i++)
+   {
+      step = &prefix->steps[i];
+
+      for (size_t j = 0; step->kind == LOG_PREFIX_TEXT && j < step->length; j++)
+      {
+         if (ispunct((unsigned char)step->text[j]))
+         {
+            step->anchor = j;
+            break;
+         }
+      }
+   }
+
+   return 0;
+
+error:
+
+   memset(prefix, 0, sizeof(struct log_prefix));
+
+   return 1;
+}
+
+void
+pgexporter_ext_log_prefix_extract(const struct log_prefix* prefix, const char* line, const char* end,
+                                  struct log_label_key* key)
+{
+   const struct log_prefix_step* step;
+   const struct log_prefix_step* next;
+   const char* p = line;
+   const char* q;
+   const char* start;
+
+   memset(key, 0, sizeof(struct log_label_key));
+
+   for (int i = 0; i < prefix->forward; i++)
+   {
+      step = &prefix->steps[i];
+
+      if (step->kind == LOG_PREFIX_TEXT)
+      {
+         if ((size_t)(end - p) < step->length || !match_text(p, step->text, step->length))
+         {
+            return;
+         }
+
+         p += step->length;
+         continue;
+      }
+
+      /* An escape runs until the text of the next step */
+      next = i + 1 < prefix->size ? &prefix->steps[i + 1] : NULL;
+      if (next == NULL)
+      {
+         q = end;
+      }
+      else if (next->kind == LOG_PREFIX_TEXT)
+      {
+         q = find_text(p, end, next);
+         if (q == NULL)
+         {
+            return;
+         }
+      }
+      else
+      {
+         return;
+      }
+
+      if (step->kind >= 0)
+      {
+         set_value(key, step->kind, p, q, step->padded);
+      }
+
+      p = q;
+   }
+
+   /* The labels after the last other escape are matched from the end, so
+    * f.ex. a timestamp before them is never looked at */
+   q = end;
+
+   for (int i = prefix->size - 1; i >= prefix->backward; i--)
+   {
+      step = &prefix->steps[i];
+
+      if (step->kind == LOG_PREFIX_TEXT)
+      {
+         if ((size_t)(q - p) < step->length || !match_text(q - step->length, step->text, step->length))
+         {
+            return;
+         }
+
+         q -= step->length;
+         continue;
+      }
+
+      /* A label starts after the text of the previous step */
+      next = i > 0 ? &prefix->steps[i - 1] : NULL;
+      if (next == NULL)
+      {
+         start = p;
+      }
+      else if (next->kind == LOG_PREFIX_TEXT)
+      {
+         start = find_text_backward(p, q, next);
+         if (start == NULL)
+         {
+            return;
+         }
+
+         start += next->length;
+      }
+      else
+      {
+         return;
+      }
+
+      set_value(key, step->kind, start, q, step->padded);
+
+      q = start;
+   }
+}
+
+struct log_labels*
+pgexporter_ext_log_labels_create(void)
+{
+   struct log_labels* labels = NULL;
+
+   labels = (struct log_labels*)malloc(sizeof(struct log_labels));
+   if (labels == NULL)
+   {
+      goto error;
+   }
+
+   labels->size = 0;
+   labels->capacity = LABELS_INITIAL_CAPACITY;
+   labels->entries = (struct log_label*)calloc(labels->capacity, sizeof(struct log_label));
+   if (labels->entries == NULL)
+   {
+      goto error;
+   }
+
+   return labels;
+
+error:
+
+   free(labels);
+
+   return NULL;
+}
+
+void
+pgexporter_ext_log_labels_destroy(struct log_labels* labels)
+{
+   if (labels == NULL)
+   {
+      return;
+   }
+
+   free(labels->entries);
+   free(labels);
+}
+
+struct log_label*
+pgexporter_ext_log_labels_find(struct log_labels* labels, struct log_label_key* key)
+{
+   struct log_label_key other;
+   struct log_label* label;
+   uint64_t hash;
+   int slot;
+
+   /* Like the error fingerprints the combinations are told apart by their hash */
+   hash = hash_key(key);
+   slot = lookup(labels, hash);
+
+   if (labels->entries[slot].hash == 0 && labels->size >= LOG_LABELS_MAX)
+   {
+      for (int i = 0; i < NUMBER_OF_LABELS; i++)
+      {
+         other.values[i] = LOG_LABEL_OTHER;
+         other.lengths[i] = sizeof(LOG_LABEL_OTHER) - 1;
+      }
+
+      key = &other;
+      hash = hash_key(key);
+      slot = lookup(labels, hash);
+   }
+
+   if (labels->entries[slot].hash == 0)
+   {
+      if ((labels->size + 1) * 4 > labels->capacity * 3)
+      {
+         if (grow(labels))
+         {
+            return NULL;
+         }
+
+         slot = lookup(labels, hash);
+      }
+
+      label = &labels->entries[slot];
+      memset(label, 0, sizeof(struct log_label));
+      label->hash = hash;
+      for (int i = 0; i < NUMBER_OF_LABELS; i++)
+      {
+         if (key->lengths[i] > 0)
+         {
+            memcpy(label->values[i], key->values[i], key->lengths[i]);
+         }
+      }
+      labels->size++;
+   }
+
+   return &labels->entries[slot];
+}
+
+void
+pgexporter_ext_log_labels_merge(struct log_labels* labels, struct log_labels* other)
+{
+   struct log_label_key key;
+   struct log_label* label;
+
+   for (int i = 0; i < other->capacity; i++)
+   {
+      if (other->entries[i].hash == 0)
+      {
+         continue;
+      }
+
+      key_of(&other->entries[i], &key);
+
+      label = pgexporter_ext_log_labels_find(labels, &key);
+      if (label == NULL)
+      {
+         return;
+      }
+
+      for (int j = 0; j < NUMBER_OF_SEVERITIES; j++)
+      {
+         label->counts.count[j] += other->entries[i].counts.count[j];
+      }
+   }
+}
+
+static int
+escape_label(char escape)
+{
+   switch (escape)
+   {
+      case 'd':
+         return LOG_LABEL_DATABASE;
+      case 'u':
+         return LOG_LABEL_USER;
+      case 'a':
+         return LOG_LABEL_APPLICATION;
+      case 'h':
+         return LOG_LABEL_HOST;
+      case 'e':
+         return LOG_FIELD_SQLSTATE;
+      default:
+         return LOG_PREFIX_SKIP;
+   }
+}
+
+static bool
+match_text(const char* p, const char* text, size_t length)
+{
+   /* The texts of a prefix are a few characters, too short for memcmp() */
+   for (size_t i = 0; i < length; i++)
+   {
+      if (p[i] != text[i])
+      {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+static const char*
+find_text(const char* p, const char* end, const struct log_prefix_step* step)
+{
+   const char* last = end - step->length + step->anchor;
+   char c = step->text[step->anchor];
+
+   /* Look for the anchor, so f.ex. the spaces of a timestamp don't stop the search of " [" */
+   for (p += step->anchor;; p++)
+   {
+      while (p <= last && *p != c)
+      {
+         p++;
+      }
+
+      if (p > last)
+      {
+         return NULL;
+      }
+
+      if (match_text(p - step->anchor, step->text, step->length))
+      {
+         return p - step->anchor;
+      }
+   }
+}
+
+static const char*
+find_text_backward(const char* start, const char* p, const struct log_prefix_step* step)
+{
+   const char* first = start + step->anchor;
+   char c = step->text[step->anchor];
+
+   for (p = p - step->length + step->anchor;; p--)
+   {
+      while (p >= first && *p != c)
+      {
+         p--;
+      }
+
+      if (p < first)
+      {
+         return NULL;
+      }
+
+      if (match_text(p - step->anchor, step->text, step->length))
+      {
+         return p - step->anchor;
+      }
+   }
+}
+
+static void
+set_value(struct log_label_key* key, int label, const char* start, const char* end, bool padded)
+{
+   if (padded)
+   {
+      while (start < end && *start == ' ')
+      {
+         start++;
+      }
+      while (end > start && *(end - 1) == ' ')
+      {
+         end--;
+      }
+   }
+
+   key->values[label] = start;
+   key->lengths[label] = end - start < LOG_LABEL_SIZE - 1 ? (size_t)(end - start) : LOG_LABEL_SIZE - 1;
+}
+
+static void
+key_of(struct log_label* label, struct log_label_key* key)
+{
+   for (int i = 0; i < NUMBER_OF_LABELS; i++)
+   {
+      key->values[i] = label->values[i];
+      key->lengths[i] = strlen(label->values[i]);
+   }
+}
+
+static uint64_t
+hash_key(struct log_label_key* key)
+{
+   uint64_t hash = HASH_SEED;
+   uint64_t word;
+   const char* value;
+   size_t length;
+
+   for (int i = 0; i < NUMBER_OF_LABELS; i++)
+   {
+      value = key->values[i];
+      length = key->lengths[i];
+
+      hash = (hash ^ length) * HASH_PRIME;
+
+      while (length >= 8)
+      {
+         memcpy(&word, value, 8);
+         hash = (hash ^ word) * HASH_PRIME;
+         value += 8;
+         length -= 8;
+      }
+
+      if (length > 0)
+      {
+         word = 0;
+         for (size_t j = 0; j < length; j++)
+         {
+            word |= (uint64_t)(unsigned char)value[j] << (8 * j);
+         }
+         hash = (hash ^ word) * HASH_PRIME;
+      }
+   }
+
+   /* Mix the high bits into the low ones */
+   hash ^= hash >> 33;
+   hash *= 0xff51afd7ed558ccdULL;
+   hash ^= hash >> 33;
+
+   /* 0 marks a free slot */
+   return hash | 1;
+}
+
+static int
+lookup(struct log_labels* labels, uint64_t hash)
+{
+   int mask = labels->capacity - 1;
+   int slot = (int)hash & mask;
+
+   while (labels->entries[slot].hash != 0 && labels->entries[slot].hash != hash)
+   {
+      slot = (slot + 1) & mask;
+   }
+
+   return slot;
+}
+
+static int
+grow(struct log_labels* labels)
+{
+   struct log_label* entries = labels->entries;
+   int capacity = labels->capacity;
+   int mask;
+   int slot;
+
+   labels->entries = (struct log_label*)calloc(capacity * 2, sizeof(struct log_label));
+   if (labels->entries == NULL)
+   {
+      labels->entries = entries;
+      return 1;
+   }
+
+   labels->capacity = capacity * 2;
+   mask = labels->capacity - 1;
+
+   /* The entries are distinct, so only a free slot is needed */
+   for (int i = 0; i < capacity; i++)
+   {
+      if (entries[i].hash != 0)
+      {
+         slot = (int)entries[i].hash & mask;
+         while (labels->entries[slot].hash != 0)
+         {
+            slot = (slot + 1) & mask;
+         }
+
+         labels->entries[slot] = entries[i];
+      }
+   }
+
+   free(entries);
+
+   return 0;
+}
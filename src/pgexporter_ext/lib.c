@@ -28,7 +28,10 @@
 
 /* pgexporter */
 #include <pgexporter_ext.h>
+#include <logs.h>
+#include <shmem.h>
 #include <utils.h>
+#include <worker.h>
 
 /* system */
 #include <ctype.h>
@@ -41,6 +44,7 @@
 #include <sys/sysinfo.h>
 #include <sys/utsname.h>
 #include <sys/stat.h>
+#include <sys/sysmacros.h>
 #endif
 #include <sys/types.h>
 
@@ -53,11 +57,15 @@
 #include "server/fmgr.h"
 #include "server/funcapi.h"
 #include "miscadmin.h"
+#include "pgtime.h"
 #include "nodes/execnodes.h"
 #include "server/utils/tuplestore.h"
 
+#include "catalog/pg_type.h"
+#include "utils/array.h"
 #include "utils/builtins.h"
 #include "utils/guc.h"
+#include "utils/timestamp.h"
 
 PG_MODULE_MAGIC;
 
@@ -116,9 +124,22 @@ static uint64_t kb_to_bytes(char* s);
 static void     network_info(Tuplestorestate* tupstore, TupleDesc tupdesc);
 static void     get_file_value(char* filename, char* interface, int64_t* value);
 static void     load_avg(Tuplestorestate* tupstore, TupleDesc tupdesc);
-static int cache_refresh_interval = 300;
-
-#define NUMBER_OF_FUNCTIONS 12
+static int64    log_count(int severity);
+static int64    log_time(TimestampTz timestamp);
+static void     log_refresh(void);
+static bool     check_log_patterns(char** newval, void** extra, GucSource source);
+
+int pgexporter_ext_cache_refresh_interval = 300;
+int pgexporter_ext_log_source = LOG_SOURCE_HOOK;
+int pgexporter_ext_max_scan_workers = 2;
+int pgexporter_ext_log_scan_max_time = 5000;
+int pgexporter_ext_log_scan_max_bytes = 0;
+int pgexporter_ext_max_disk_workers = 4;
+int pgexporter_ext_disk_cache_refresh_interval = 600;
+bool pgexporter_ext_disk_io_uring = false;
+char* pgexporter_ext_log_patterns = NULL;
+
+#define NUMBER_OF_FUNCTIONS 24
 #define NUMBER_OF_LOG_FUNCTIONS 12
 __attribute__((used))
 static struct function
@@ -129,13 +150,6 @@ static struct function
    char type[16];
 } f;
 
-typedef struct
-{
-   char level[16];
-   int count;
-   time_t last_updated;
-} LogCacheEntry;
-
 LogCacheEntry cache[NUMBER_OF_LOG_FUNCTIONS] = {
    {"DEBUG5", 0, 0},
    {"DEBUG4", 0, 0},
@@ -151,6 +165,12 @@ LogCacheEntry cache[NUMBER_OF_LOG_FUNCTIONS] = {
    {"PANIC", 0, 0}
 };
 
+static const struct config_enum_entry log_source_options[] = {
+   {"hook", LOG_SOURCE_HOOK, false},
+   {"files", LOG_SOURCE_FILES, false},
+   {NULL, 0, false}
+};
+
 static struct function functions[] = {
    /* {"pgexporter_ext_information", false, "pgexporter extension information", ""}, */
    {"pgexporter_ext_version", false, "pgexporter extension version", "gauge"},
@@ -165,6 +185,18 @@ static struct function functions[] = {
    {"pgexporter_ext_network_info", false, "The network information", "gauge"},
    {"pgexporter_ext_load_avg", false, "The load averages", "gauge"},
    {"pgexporter_ext_fips", false, "PostgreSQL OpenSSL FIPS mode status", "gauge"},
+   {"pgexporter_ext_log_counts", false, "Log count per severity", "gauge"},
+   {"pgexporter_ext_log_rate", true, "Log count and rate per severity in a recent interval", "gauge"},
+   {"pgexporter_ext_log_top_errors", true, "The most frequent error messages", "gauge"},
+   {"pgexporter_ext_log_counts_by_label", false, "Log count per database, user, application, host and severity", "gauge"},
+   {"pgexporter_ext_log_durations", false, "Statement duration quantiles from the log", "gauge"},
+   {"pgexporter_ext_log_pattern_counts", false, "Log count per pattern of pgexporter.log_patterns", "gauge"},
+   {"pgexporter_ext_recent_errors", true, "The most recent error messages", ""},
+   {"pgexporter_ext_log_counts_between", true, "Log count per severity in a time range", "gauge"},
+   {"pgexporter_ext_log_scan_status", false, "Status of the last log scan", "gauge"},
+   {"pgexporter_ext_disk_usage", false, "Disk usage of the data directory, pg_wal and the tablespaces", "gauge"},
+   {"pgexporter_ext_data_directory_breakdown", false, "Disk usage per database and area of the data directory", "gauge"},
+   {"pgexporter_ext_filesystems", false, "Space and inodes of the file systems of the data directory", "gauge"},
 };
 
 static struct function log_metrics[] = {
@@ -189,7 +221,7 @@ _PG_init(void)
       "pgexporter.log_cache_refresh_interval",    // GUC name
       "Interval (in seconds) to refresh the log cache.",    // Description
       NULL,
-      &cache_refresh_interval,
+      &pgexporter_ext_cache_refresh_interval,
       300,
       1,
       3600,
@@ -199,6 +231,127 @@ _PG_init(void)
       NULL,
       NULL
       );
+
+   DefineCustomEnumVariable(
+      "pgexporter.log_source",    // GUC name
+      "Source of the log counts: messages seen by the server (hook) or the log files (files).",    // Description
+      NULL,
+      &pgexporter_ext_log_source,
+      LOG_SOURCE_HOOK,
+      log_source_options,
+      PGC_SUSET,
+      0,
+      NULL,
+      NULL,
+      NULL
+      );
+
+   DefineCustomIntVariable(
+      "pgexporter.max_scan_workers",    // GUC name
+      "Maximum number of threads scanning log files concurrently.",    // Description
+      NULL,
+      &pgexporter_ext_max_scan_workers,
+      2,
+      1,
+      MAX_SCAN_WORKERS,
+      PGC_SUSET,
+      0,
+      NULL,
+      NULL,
+      NULL
+      );
+
+   DefineCustomIntVariable(
+      "pgexporter.log_scan_max_time",    // GUC name
+      "Time after which a log scan returns the counts read so far, 0 for no limit.",    // Description
+      NULL,
+      &pgexporter_ext_log_scan_max_time,
+      5000,
+      0,
+      INT_MAX,
+      PGC_SUSET,
+      GUC_UNIT_MS,
+      NULL,
+      NULL,
+      NULL
+      );
+
+   DefineCustomIntVariable(
+      "pgexporter.log_scan_max_bytes",    // GUC name
+      "Amount of log read after which a log scan returns the counts read so far, 0 for no limit.",    // Description
+      NULL,
+      &pgexporter_ext_log_scan_max_bytes,
+      0,
+      0,
+      INT_MAX,
+      PGC_SUSET,
+      GUC_UNIT_MB,
+      NULL,
+      NULL,
+      NULL
+      );
+
+   DefineCustomIntVariable(
+      "pgexporter.max_disk_workers",    // GUC name
+      "Maximum number of threads walking the data directory concurrently.",    // Description
+      NULL,
+      &pgexporter_ext_max_disk_workers,
+      4,
+      1,
+      MAX_DISK_WORKERS,
+      PGC_SUSET,
+      0,
+      NULL,
+      NULL,
+      NULL
+      );
+
+   DefineCustomIntVariable(
+      "pgexporter.disk_cache_refresh_interval",    // GUC name
+      "Interval (in seconds) between full walks of the disk cache, 0 to disable the cache.",    // Description
+      NULL,
+      &pgexporter_ext_disk_cache_refresh_interval,
+      600,
+      0,
+      86400,
+      PGC_SUSET,
+      GUC_UNIT_S,
+      NULL,
+      NULL,
+      NULL
+      );
+
+   DefineCustomBoolVariable(
+      "pgexporter.disk_io_uring",    // GUC name
+      "Stat the files of the directory walks with io_uring when the kernel allows it.",    // Description
+      NULL,
+      &pgexporter_ext_disk_io_uring,
+      false,
+      PGC_SUSET,
+      0,
+      NULL,
+      NULL,
+      NULL
+      );
+
+   DefineCustomStringVariable(
+      "pgexporter.log_patterns",    // GUC name
+      "Named patterns counted in the log messages, as name=text;name=text.",    // Description
+      NULL,
+      &pgexporter_ext_log_patterns,
+      "",
+      PGC_SUSET,
+      0,
+      check_log_patterns,
+      NULL,
+      NULL
+      );
+
+   if (process_shared_preload_libraries_in_progress)
+   {
+      pgexporter_ext_shmem_init();
+      pgexporter_ext_worker_register();
+   }
 }
 
 void
@@ -236,6 +389,18 @@ PG_FUNCTION_INFO_V1(pgexporter_ext_log_error);
 PG_FUNCTION_INFO_V1(pgexporter_ext_log_log);
 PG_FUNCTION_INFO_V1(pgexporter_ext_log_fatal);
 PG_FUNCTION_INFO_V1(pgexporter_ext_log_panic);
+PG_FUNCTION_INFO_V1(pgexporter_ext_log_counts);
+PG_FUNCTION_INFO_V1(pgexporter_ext_log_rate);
+PG_FUNCTION_INFO_V1(pgexporter_ext_log_top_errors);
+PG_FUNCTION_INFO_V1(pgexporter_ext_log_counts_by_label);
+PG_FUNCTION_INFO_V1(pgexporter_ext_log_durations);
+PG_FUNCTION_INFO_V1(pgexporter_ext_log_pattern_counts);
+PG_FUNCTION_INFO_V1(pgexporter_ext_recent_errors);
+PG_FUNCTION_INFO_V1(pgexporter_ext_log_counts_between);
+PG_FUNCTION_INFO_V1(pgexporter_ext_log_scan_status);
+PG_FUNCTION_INFO_V1(pgexporter_ext_disk_usage);
+PG_FUNCTION_INFO_V1(pgexporter_ext_data_directory_breakdown);
+PG_FUNCTION_INFO_V1(pgexporter_ext_filesystems);
 
 bool
 cache_is_valid(const char* level)
@@ -246,14 +411,14 @@ cache_is_valid(const char* level)
    {
       if (strcmp(cache[i].level, level) == 0)
       {
-         return (now - cache[i].last_updated) < cache_refresh_interval;
+         return (now - cache[i].last_updated) < pgexporter_ext_cache_refresh_interval;
       }
    }
 
    return false;
 }
 
-int
+int64
 cache_get_count(const char* level)
 {
    for (int i = 0; i < NUMBER_OF_LOG_FUNCTIONS; i++)
@@ -267,7 +432,7 @@ cache_get_count(const char* level)
 }
 
 void
-cache_update(const char* level, int count)
+cache_update(const char* level, int64 count)
 {
    for (int i = 0; i < NUMBER_OF_LOG_FUNCTIONS; i++)
    {
@@ -1270,71 +1435,837 @@ error:
 Datum
 pgexporter_ext_log_debug5(PG_FUNCTION_ARGS)
 {
-   PG_RETURN_INT32(pgexporter_ext_parse_log_files("DEBUG5"));
+   PG_RETURN_INT64(log_count(SEVERITY_DEBUG5));
 }
 
 Datum
 pgexporter_ext_log_debug4(PG_FUNCTION_ARGS)
 {
-   PG_RETURN_INT32(pgexporter_ext_parse_log_files("DEBUG4"));
+   PG_RETURN_INT64(log_count(SEVERITY_DEBUG4));
 }
 
 Datum
 pgexporter_ext_log_debug3(PG_FUNCTION_ARGS)
 {
-   PG_RETURN_INT32(pgexporter_ext_parse_log_files("DEBUG3"));
+   PG_RETURN_INT64(log_count(SEVERITY_DEBUG3));
 }
 
 Datum
 pgexporter_ext_log_debug2(PG_FUNCTION_ARGS)
 {
-   PG_RETURN_INT32(pgexporter_ext_parse_log_files("DEBUG2"));
+   PG_RETURN_INT64(log_count(SEVERITY_DEBUG2));
 }
 
 Datum
 pgexporter_ext_log_debug1(PG_FUNCTION_ARGS)
 {
-   PG_RETURN_INT32(pgexporter_ext_parse_log_files("DEBUG1"));
+   PG_RETURN_INT64(log_count(SEVERITY_DEBUG1));
 }
 
 Datum
 pgexporter_ext_log_info(PG_FUNCTION_ARGS)
 {
-   PG_RETURN_INT32(pgexporter_ext_parse_log_files("INFO"));
+   PG_RETURN_INT64(log_count(SEVERITY_INFO));
 }
 
 Datum
 pgexporter_ext_log_notice(PG_FUNCTION_ARGS)
 {
-   PG_RETURN_INT32(pgexporter_ext_parse_log_files("NOTICE"));
+   PG_RETURN_INT64(log_count(SEVERITY_NOTICE));
 }
 
 Datum
 pgexporter_ext_log_warning(PG_FUNCTION_ARGS)
 {
-   PG_RETURN_INT32(pgexporter_ext_parse_log_files("WARNING"));
+   PG_RETURN_INT64(log_count(SEVERITY_WARNING));
 }
 
 Datum
 pgexporter_ext_log_error(PG_FUNCTION_ARGS)
 {
-   PG_RETURN_INT32(pgexporter_ext_parse_log_files("ERROR"));
+   PG_RETURN_INT64(log_count(SEVERITY_ERROR));
 }
 
 Datum
 pgexporter_ext_log_log(PG_FUNCTION_ARGS)
 {
-   PG_RETURN_INT32(pgexporter_ext_parse_log_files("LOG"));
+   PG_RETURN_INT64(log_count(SEVERITY_LOG));
 }
 
 Datum
 pgexporter_ext_log_fatal(PG_FUNCTION_ARGS)
 {
-   PG_RETURN_INT32(pgexporter_ext_parse_log_files("FATAL"));
+   PG_RETURN_INT64(log_count(SEVERITY_FATAL));
 }
 
 Datum
 pgexporter_ext_log_panic(PG_FUNCTION_ARGS)
 {
-   PG_RETURN_INT32(pgexporter_ext_parse_log_files("PANIC"));
+   PG_RETURN_INT64(log_count(SEVERITY_PANIC));
+}
+
+Datum
+pgexporter_ext_log_counts(PG_FUNCTION_ARGS)
+{
+   ReturnSetInfo* rsinfo = (ReturnSetInfo*)fcinfo->resultinfo;
+   TupleDesc tupdesc;
+   Tuplestorestate* tupstore;
+   MemoryContext per_query_ctx;
+   MemoryContext oldcontext;
+   Datum values[2];
+   bool nulls[2];
+
+   memset(&nulls[0], 0, sizeof(nulls));
+
+   per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+   oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+   if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+   {
+      elog(ERROR, "Must be a return row type");
+   }
+
+   tupstore = tuplestore_begin_heap(true, false, work_mem);
+   rsinfo->returnMode = SFRM_Materialize;
+   rsinfo->setResult = tupstore;
+   rsinfo->setDesc = tupdesc;
+
+   MemoryContextSwitchTo(oldcontext);
+
+   for (int i = 0; i < NUMBER_OF_LOG_FUNCTIONS; i++)
+   {
+      values[0] = CStringGetTextDatum(pgexporter_ext_log_severity_name(i));
+      values[1] = Int64GetDatumFast(log_count(i));
+      tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+   }
+
+   return (Datum)0;
+}
+
+Datum
+pgexporter_ext_log_rate(PG_FUNCTION_ARGS)
+{
+   Interval* span = PG_GETARG_INTERVAL_P(0);
+   ReturnSetInfo* rsinfo = (ReturnSetInfo*)fcinfo->resultinfo;
+   TupleDesc tupdesc;
+   Tuplestorestate* tupstore;
+   MemoryContext per_query_ctx;
+   MemoryContext oldcontext;
+   Datum values[3];
+   bool nulls[3];
+   int64 seconds;
+   int minutes;
+   double elapsed;
+   time_t now;
+   time_t started;
+   struct log_counts counts;
+
+   memset(&nulls[0], 0, sizeof(nulls));
+
+   seconds = span->time / USECS_PER_SEC + (int64)span->day * SECS_PER_DAY +
+             (int64)span->month * DAYS_PER_MONTH * SECS_PER_DAY;
+   if (seconds <= 0)
+   {
+      elog(ERROR, "The interval must be positive");
+   }
+
+   minutes = seconds >= LOG_RATE_MINUTES * 60 ? LOG_RATE_MINUTES : (int)((seconds + 59) / 60);
+
+   if (!pgexporter_ext_shmem_log_window(minutes, &counts, &started))
+   {
+      elog(ERROR, "pgexporter_ext must be loaded via shared_preload_libraries");
+   }
+
+   /* The current minute has only partly passed, and nothing was counted
+    * before the shared memory was initialized */
+   now = time(NULL);
+   elapsed = (minutes - 1) * 60 + now % 60 + 1;
+   if (elapsed > now - started + 1)
+   {
+      elapsed = now - started + 1;
+   }
+
+   per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+   oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+   if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+   {
+      elog(ERROR, "Must be a return row type");
+   }
+
+   tupstore = tuplestore_begin_heap(true, false, work_mem);
+   rsinfo->returnMode = SFRM_Materialize;
+   rsinfo->setResult = tupstore;
+   rsinfo->setDesc = tupdesc;
+
+   MemoryContextSwitchTo(oldcontext);
+
+   for (int i = 0; i < NUMBER_OF_SEVERITIES; i++)
+   {
+      values[0] = CStringGetTextDatum(pgexporter_ext_log_severity_name(i));
+      values[1] = Int64GetDatumFast((int64)counts.count[i]);
+      values[2] = Float8GetDatum(counts.count[i] / elapsed);
+      tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+   }
+
+   return (Datum)0;
+}
+
+Datum
+pgexporter_ext_log_top_errors(PG_FUNCTION_ARGS)
+{
+   int32 k = PG_GETARG_INT32(0);
+   ReturnSetInfo* rsinfo = (ReturnSetInfo*)fcinfo->resultinfo;
+   TupleDesc tupdesc;
+   Tuplestorestate* tupstore;
+   MemoryContext per_query_ctx;
+   MemoryContext oldcontext;
+   Datum values[5];
+   bool nulls[5];
+   char fingerprint[17];
+   struct log_topk* topk;
+   struct log_error* errors;
+   int size;
+
+   if (k < 1 || k > TOPK_CAPACITY)
+   {
+      elog(ERROR, "k must be between 1 and %d", TOPK_CAPACITY);
+   }
+
+   topk = (struct log_topk*)palloc(sizeof(struct log_topk));
+   errors = (struct log_error*)palloc(TOPK_CAPACITY * sizeof(struct log_error));
+
+   if (pgexporter_ext_parse_log_errors(topk))
+   {
+      elog(ERROR, "Failed to scan the log files");
+   }
+
+   size = pgexporter_ext_topk_errors(topk, errors);
+
+   per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+   oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+   if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+   {
+      elog(ERROR, "Must be a return row type");
+   }
+
+   tupstore = tuplestore_begin_heap(true, false, work_mem);
+   rsinfo->returnMode = SFRM_Materialize;
+   rsinfo->setResult = tupstore;
+   rsinfo->setDesc = tupdesc;
+
+   MemoryContextSwitchTo(oldcontext);
+
+   for (int i = 0; i < size && i < k; i++)
+   {
+      memset(&nulls[0], 0, sizeof(nulls));
+
+      snprintf(fingerprint, sizeof(fingerprint), "%016llx", (unsigned long long)errors[i].fingerprint);
+
+      values[0] = CStringGetTextDatum(fingerprint);
+      if (errors[i].sqlstate[0] != '\0')
+      {
+         values[1] = CStringGetTextDatum(errors[i].sqlstate);
+      }
+      else
+      {
+         nulls[1] = true;
+      }
+      values[2] = CStringGetTextDatum(errors[i].sample);
+      values[3] = Int64GetDatumFast((int64)errors[i].count);
+      values[4] = Int64GetDatumFast((int64)errors[i].error);
+      tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+   }
+
+   pfree(errors);
+   pfree(topk);
+
+   return (Datum)0;
+}
+
+Datum
+pgexporter_ext_log_counts_by_label(PG_FUNCTION_ARGS)
+{
+   ReturnSetInfo* rsinfo = (ReturnSetInfo*)fcinfo->resultinfo;
+   TupleDesc tupdesc;
+   Tuplestorestate* tupstore;
+   MemoryContext per_query_ctx;
+   MemoryContext oldcontext;
+   Datum values[NUMBER_OF_LABELS + 2];
+   bool nulls[NUMBER_OF_LABELS + 2];
+   struct log_labels* labels = NULL;
+   struct log_label* label;
+
+   if (pgexporter_ext_parse_log_labels(&labels))
+   {
+      elog(ERROR, "Failed to scan the log files");
+   }
+
+   per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+   oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+   if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+   {
+      pgexporter_ext_log_labels_destroy(labels);
+      elog(ERROR, "Must be a return row type");
+   }
+
+   tupstore = tuplestore_begin_heap(true, false, work_mem);
+   rsinfo->returnMode = SFRM_Materialize;
+   rsinfo->setResult = tupstore;
+   rsinfo->setDesc = tupdesc;
+
+   MemoryContextSwitchTo(oldcontext);
+
+   for (int i = 0; i < labels->capacity; i++)
+   {
+      label = &labels->entries[i];
+
+      if (label->hash == 0)
+      {
+         continue;
+      }
+
+      memset(&nulls[0], 0, sizeof(nulls));
+
+      /* An unknown label is NULL */
+      for (int j = 0; j < NUMBER_OF_LABELS; j++)
+      {
+         if (label->values[j][0] != '\0')
+         {
+            values[j] = CStringGetTextDatum(label->values[j]);
+         }
+         else
+         {
+            nulls[j] = true;
+         }
+      }
+
+      for (int j = 0; j < NUMBER_OF_SEVERITIES; j++)
+      {
+         if (label->counts.count[j] == 0)
+         {
+            continue;
+         }
+
+         values[NUMBER_OF_LABELS] = CStringGetTextDatum(pgexporter_ext_log_severity_name(j));
+         values[NUMBER_OF_LABELS + 1] = Int64GetDatumFast((int64)label->counts.count[j]);
+         tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+      }
+   }
+
+   pgexporter_ext_log_labels_destroy(labels);
+
+   return (Datum)0;
+}
+
+Datum
+pgexporter_ext_log_durations(PG_FUNCTION_ARGS)
+{
+   ReturnSetInfo* rsinfo = (ReturnSetInfo*)fcinfo->resultinfo;
+   TupleDesc tupdesc;
+   Tuplestorestate* tupstore;
+   MemoryContext per_query_ctx;
+   MemoryContext oldcontext;
+   Datum values[6];
+   bool nulls[6];
+   struct log_histogram* histogram;
+
+   histogram = (struct log_histogram*)palloc(sizeof(struct log_histogram));
+
+   if (pgexporter_ext_parse_log_durations(histogram))
+   {
+      elog(ERROR, "Failed to scan the log files");
+   }
+
+   per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+   oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+   if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+   {
+      elog(ERROR, "Must be a return row type");
+   }
+
+   tupstore = tuplestore_begin_heap(true, false, work_mem);
+   rsinfo->returnMode = SFRM_Materialize;
+   rsinfo->setResult = tupstore;
+   rsinfo->setDesc = tupdesc;
+
+   MemoryContextSwitchTo(oldcontext);
+
+   memset(&nulls[0], 0, sizeof(nulls));
+
+   /* The durations are in microseconds, and reported in milliseconds like in the log */
+   values[0] = Int64GetDatumFast((int64)histogram->count);
+   values[1] = Float8GetDatum(histogram->sum / 1000.0);
+
+   if (histogram->count > 0)
+   {
+      values[2] = Float8GetDatum(pgexporter_ext_histogram_quantile(histogram, 0.50) / 1000.0);
+      values[3] = Float8GetDatum(pgexporter_ext_histogram_quantile(histogram, 0.95) / 1000.0);
+      values[4] = Float8GetDatum(pgexporter_ext_histogram_quantile(histogram, 0.99) / 1000.0);
+      values[5] = Float8GetDatum(histogram->max / 1000.0);
+   }
+   else
+   {
+      nulls[2] = true;
+      nulls[3] = true;
+      nulls[4] = true;
+      nulls[5] = true;
+   }
+
+   tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+
+   pfree(histogram);
+
+   return (Datum)0;
+}
+
+Datum
+pgexporter_ext_log_pattern_counts(PG_FUNCTION_ARGS)
+{
+   ReturnSetInfo* rsinfo = (ReturnSetInfo*)fcinfo->resultinfo;
+   TupleDesc tupdesc;
+   Tuplestorestate* tupstore;
+   MemoryContext per_query_ctx;
+   MemoryContext oldcontext;
+   Datum values[3];
+   bool nulls[3];
+   const struct log_patterns* patterns = NULL;
+   uint64_t matches[LOG_PATTERNS_MAX];
+
+   if (pgexporter_ext_parse_log_patterns(&patterns, matches))
+   {
+      elog(ERROR, "Failed to scan the log files");
+   }
+
+   per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+   oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+   if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+   {
+      elog(ERROR, "Must be a return row type");
+   }
+
+   tupstore = tuplestore_begin_heap(true, false, work_mem);
+   rsinfo->returnMode = SFRM_Materialize;
+   rsinfo->setResult = tupstore;
+   rsinfo->setDesc = tupdesc;
+
+   MemoryContextSwitchTo(oldcontext);
+
+   memset(&nulls[0], 0, sizeof(nulls));
+
+   for (int i = 0; patterns != NULL && i < patterns->size; i++)
+   {
+      values[0] = CStringGetTextDatum(patterns->names[i]);
+      values[1] = CStringGetTextDatum(patterns->texts[i]);
+      values[2] = Int64GetDatumFast((int64)matches[i]);
+      tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+   }
+
+   return (Datum)0;
+}
+
+Datum
+pgexporter_ext_recent_errors(PG_FUNCTION_ARGS)
+{
+   int32 n = PG_GETARG_INT32(0);
+   ReturnSetInfo* rsinfo = (ReturnSetInfo*)fcinfo->resultinfo;
+   TupleDesc tupdesc;
+   Tuplestorestate* tupstore;
+   MemoryContext per_query_ctx;
+   MemoryContext oldcontext;
+   Datum values[3];
+   bool nulls[3];
+   struct log_entry* entries;
+   int count;
+
+   if (n < 1 || n > LOG_RECENT_MAX)
+   {
+      elog(ERROR, "n must be between 1 and %d", LOG_RECENT_MAX);
+   }
+
+   entries = (struct log_entry*)palloc(n * sizeof(struct log_entry));
+
+   if (pgexporter_ext_read_recent_errors(n, entries, &count))
+   {
+      elog(ERROR, "Failed to read the log files");
+   }
+
+   per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+   oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+   if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+   {
+      elog(ERROR, "Must be a return row type");
+   }
+
+   tupstore = tuplestore_begin_heap(true, false, work_mem);
+   rsinfo->returnMode = SFRM_Materialize;
+   rsinfo->setResult = tupstore;
+   rsinfo->setDesc = tupdesc;
+
+   MemoryContextSwitchTo(oldcontext);
+
+   memset(&nulls[0], 0, sizeof(nulls));
+
+   for (int i = 0; i < count; i++)
+   {
+      values[0] = CStringGetTextDatum(entries[i].file);
+      values[1] = CStringGetTextDatum(pgexporter_ext_log_severity_name(entries[i].severity));
+      values[2] = CStringGetTextDatum(entries[i].line);
+      tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+   }
+
+   pfree(entries);
+
+   return (Datum)0;
+}
+
+Datum
+pgexporter_ext_log_counts_between(PG_FUNCTION_ARGS)
+{
+   TimestampTz from = PG_GETARG_TIMESTAMPTZ(0);
+   TimestampTz to = PG_GETARG_TIMESTAMPTZ(1);
+   ReturnSetInfo* rsinfo = (ReturnSetInfo*)fcinfo->resultinfo;
+   TupleDesc tupdesc;
+   Tuplestorestate* tupstore;
+   MemoryContext per_query_ctx;
+   MemoryContext oldcontext;
+   Datum values[2];
+   bool nulls[2];
+   struct log_counts counts;
+
+   if (from >= to)
+   {
+      elog(ERROR, "The start of the range must be before its end");
+   }
+
+   if (pgexporter_ext_parse_log_counts_between(log_time(from), log_time(to), &counts))
+   {
+      elog(ERROR, "Failed to scan the log files");
+   }
+
+   memset(&nulls[0], 0, sizeof(nulls));
+
+   per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+   oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+   if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+   {
+      elog(ERROR, "Must be a return row type");
+   }
+
+   tupstore = tuplestore_begin_heap(true, false, work_mem);
+   rsinfo->returnMode = SFRM_Materialize;
+   rsinfo->setResult = tupstore;
+   rsinfo->setDesc = tupdesc;
+
+   MemoryContextSwitchTo(oldcontext);
+
+   for (int i = 0; i < NUMBER_OF_SEVERITIES; i++)
+   {
+      values[0] = CStringGetTextDatum(pgexporter_ext_log_severity_name(i));
+      values[1] = Int64GetDatumFast((int64)counts.count[i]);
+      tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+   }
+
+   return (Datum)0;
+}
+
+Datum
+pgexporter_ext_log_scan_status(PG_FUNCTION_ARGS)
+{
+   ReturnSetInfo* rsinfo = (ReturnSetInfo*)fcinfo->resultinfo;
+   TupleDesc tupdesc;
+   Tuplestorestate* tupstore;
+   MemoryContext per_query_ctx;
+   MemoryContext oldcontext;
+   Datum values[3];
+   bool nulls[3];
+   bool stale;
+   int64_t bytes;
+   int64_t elapsed;
+
+   pgexporter_ext_log_scan_status_get(&stale, &bytes, &elapsed);
+
+   memset(&nulls[0], 0, sizeof(nulls));
+
+   per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+   oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+   if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+   {
+      elog(ERROR, "Must be a return row type");
+   }
+
+   tupstore = tuplestore_begin_heap(true, false, work_mem);
+   rsinfo->returnMode = SFRM_Materialize;
+   rsinfo->setResult = tupstore;
+   rsinfo->setDesc = tupdesc;
+
+   MemoryContextSwitchTo(oldcontext);
+
+   values[0] = BoolGetDatum(stale);
+   values[1] = Int64GetDatumFast((int64)bytes);
+   values[2] = Int64GetDatumFast((int64)elapsed);
+   tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+
+   return (Datum)0;
+}
+
+Datum
+pgexporter_ext_disk_usage(PG_FUNCTION_ARGS)
+{
+   ReturnSetInfo* rsinfo = (ReturnSetInfo*)fcinfo->resultinfo;
+   TupleDesc tupdesc;
+   Tuplestorestate* tupstore;
+   MemoryContext per_query_ctx;
+   MemoryContext oldcontext;
+   Datum values[6];
+   bool nulls[6];
+   struct disk_root* roots;
+   int number_of_roots;
+
+   if (pgexporter_ext_disk_usage_roots(&roots, &number_of_roots))
+   {
+      elog(ERROR, "Failed to walk the data directory");
+   }
+
+   per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+   oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+   if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+   {
+      elog(ERROR, "Must be a return row type");
+   }
+
+   tupstore = tuplestore_begin_heap(true, false, work_mem);
+   rsinfo->returnMode = SFRM_Materialize;
+   rsinfo->setResult = tupstore;
+   rsinfo->setDesc = tupdesc;
+
+   MemoryContextSwitchTo(oldcontext);
+
+   for (int i = 0; i < number_of_roots; i++)
+   {
+      memset(&nulls[0], 0, sizeof(nulls));
+
+      values[0] = CStringGetTextDatum(roots[i].name);
+      values[1] = ObjectIdGetDatum((Oid)roots[i].oid);
+      nulls[1] = roots[i].oid == 0;
+      values[2] = CStringGetTextDatum(roots[i].path);
+
+      /* A root that can't be read has no usage */
+      values[3] = Int64GetDatumFast((int64)roots[i].usage.bytes);
+      values[4] = Int64GetDatumFast((int64)roots[i].usage.files);
+      values[5] = Int64GetDatumFast((int64)roots[i].usage.directories);
+      nulls[3] = nulls[4] = nulls[5] = roots[i].result != 0;
+
+      tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+   }
+
+   pfree(roots);
+
+   return (Datum)0;
+}
+
+Datum
+pgexporter_ext_data_directory_breakdown(PG_FUNCTION_ARGS)
+{
+   ReturnSetInfo* rsinfo = (ReturnSetInfo*)fcinfo->resultinfo;
+   TupleDesc tupdesc;
+   Tuplestorestate* tupstore;
+   MemoryContext per_query_ctx;
+   MemoryContext oldcontext;
+   Datum values[7];
+   bool nulls[7];
+   struct disk_root* roots;
+   int number_of_roots;
+
+   if (pgexporter_ext_disk_breakdown_roots(&roots, &number_of_roots))
+   {
+      elog(ERROR, "Failed to walk the data directory");
+   }
+
+   per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+   oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+   if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+   {
+      elog(ERROR, "Must be a return row type");
+   }
+
+   tupstore = tuplestore_begin_heap(true, false, work_mem);
+   rsinfo->returnMode = SFRM_Materialize;
+   rsinfo->setResult = tupstore;
+   rsinfo->setDesc = tupdesc;
+
+   MemoryContextSwitchTo(oldcontext);
+
+   for (int i = 0; i < number_of_roots; i++)
+   {
+      memset(&nulls[0], 0, sizeof(nulls));
+
+      values[0] = CStringGetTextDatum(roots[i].name);
+      values[1] = ObjectIdGetDatum((Oid)roots[i].database);
+      nulls[1] = roots[i].database == 0;
+      values[2] = ObjectIdGetDatum((Oid)roots[i].oid);
+      nulls[2] = roots[i].oid == 0;
+      values[3] = CStringGetTextDatum(roots[i].path);
+
+      /* A directory that can't be read has no usage */
+      values[4] = Int64GetDatumFast((int64)roots[i].usage.bytes);
+      values[5] = Int64GetDatumFast((int64)roots[i].usage.files);
+      values[6] = Int64GetDatumFast((int64)roots[i].usage.directories);
+      nulls[4] = nulls[5] = nulls[6] = roots[i].result != 0;
+
+      tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+   }
+
+   pfree(roots);
+
+   return (Datum)0;
+}
+
+Datum
+pgexporter_ext_filesystems(PG_FUNCTION_ARGS)
+{
+   ReturnSetInfo* rsinfo = (ReturnSetInfo*)fcinfo->resultinfo;
+   TupleDesc tupdesc;
+   Tuplestorestate* tupstore;
+   MemoryContext per_query_ctx;
+   MemoryContext oldcontext;
+   Datum values[11];
+   bool nulls[11];
+   Datum* names;
+   char device[32];
+   struct disk_filesystem* filesystems;
+   struct disk_filesystem* fs;
+   int number_of_filesystems;
+
+   if (pgexporter_ext_disk_filesystems(&filesystems, &number_of_filesystems))
+   {
+      elog(ERROR, "Failed to read the file systems of the data directory");
+   }
+
+   per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+   oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+   if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+   {
+      elog(ERROR, "Must be a return row type");
+   }
+
+   tupstore = tuplestore_begin_heap(true, false, work_mem);
+   rsinfo->returnMode = SFRM_Materialize;
+   rsinfo->setResult = tupstore;
+   rsinfo->setDesc = tupdesc;
+
+   MemoryContextSwitchTo(oldcontext);
+
+   for (int i = 0; i < number_of_filesystems; i++)
+   {
+      fs = &filesystems[i];
+      memset(&nulls[0], 0, sizeof(nulls));
+
+      /* A file system without a mount in mountinfo still has its device */
+      snprintf(device, sizeof(device), "%u:%u", major(fs->device), minor(fs->device));
+
+      values[0] = CStringGetTextDatum(fs->mount.mount_point);
+      values[1] = CStringGetTextDatum(device);
+      values[2] = CStringGetTextDatum(fs->mount.type);
+      values[3] = CStringGetTextDatum(fs->mount.source);
+      nulls[0] = nulls[2] = nulls[3] = !fs->mounted;
+
+      names = (Datum*)palloc(fs->number_of_names * sizeof(Datum));
+      for (int j = 0; j < fs->number_of_names; j++)
+      {
+         names[j] = CStringGetTextDatum(fs->names[j]);
+      }
+      values[4] = PointerGetDatum(construct_array(names, fs->number_of_names, TEXTOID, -1, false, TYPALIGN_INT));
+
+      values[5] = Int64GetDatumFast((int64)fs->total);
+      values[6] = Int64GetDatumFast((int64)fs->free);
+      values[7] = Int64GetDatumFast((int64)fs->available);
+      values[8] = Int64GetDatumFast((int64)fs->inodes);
+      values[9] = Int64GetDatumFast((int64)fs->inodes_free);
+      values[10] = Int64GetDatumFast((int64)fs->inodes_available);
+      nulls[5] = nulls[6] = nulls[7] = nulls[8] = nulls[9] = nulls[10] = fs->result != 0;
+
+      tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+   }
+
+   return (Datum)0;
+}
+
+static int64
+log_count(int severity)
+{
+   const char* level = pgexporter_ext_log_severity_name(severity);
+   LogCacheEntry shared_cache[NUMBER_OF_LOG_FUNCTIONS];
+
+   /* The counters of the hook are only there when the library is preloaded */
+   if (pgexporter_ext_log_source == LOG_SOURCE_HOOK && pgexporter_ext_shmem_available())
+   {
+      return (int64)pgexporter_ext_shmem_log_count(severity);
+   }
+
+   /* The log worker keeps the log file counts of all backends */
+   if (pgexporter_ext_shmem_log_cache(&shared_cache[0]))
+   {
+      return shared_cache[severity].count;
+   }
+
+   if (!cache_is_valid(level))
+   {
+      log_refresh();
+   }
+
+   return cache_get_count(level);
+}
+
+static int64
+log_time(TimestampTz timestamp)
+{
+   pg_time_t seconds = timestamptz_to_time_t(timestamp);
+   struct pg_tm* tm;
+
+   /* The log has the wall clock of log_timezone, in milliseconds since the Unix epoch */
+   tm = pg_localtime(&seconds, log_timezone);
+
+   return timestamp / 1000 +
+          ((int64)(POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE) * SECS_PER_DAY + (tm != NULL ? tm->tm_gmtoff : 0)) * 1000;
+}
+
+static void
+log_refresh(void)
+{
+   struct log_counts counts;
+
+   /* One pass over log_directory fills the entries for all severities */
+   pgexporter_ext_parse_log_files(&counts);
+
+   for (int i = 0; i < NUMBER_OF_LOG_FUNCTIONS; i++)
+   {
+      cache_update(pgexporter_ext_log_severity_name(i), counts.count[i]);
+   }
+}
+
+static bool
+check_log_patterns(char** newval, void** extra, GucSource source)
+{
+   struct log_patterns* patterns = NULL;
+
+   if (pgexporter_ext_log_patterns_compile(*newval, &patterns))
+   {
+      GUC_check_errdetail("Expected at most %d patterns as name=text;name=text.", LOG_PATTERNS_MAX);
+      return false;
+   }
+
+   pgexporter_ext_log_patterns_destroy(patterns);
+
+   return true;
 }
@@ -0,0 +1,2654 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgexporter */
+#include <pgexporter_ext.h>
+#include <logs.h>
+#include <marks.h>
+#include <stream.h>
+#include <topk.h>
+
+/* system */
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+/** @struct log_job
+ * A file to scan
+ */
+struct log_job
+{
+   struct log_file* file; /**< The file */
+   char path[MAX_PATH];   /**< The path */
+   off_t size;            /**< The size when listed */
+   time_t mtime;          /**< The modification time when listed */
+   int result;            /**< The result of the scan */
+};
+
+/** @struct log_pool
+ * The files of a scan shared by the threads
+ */
+struct log_pool
+{
+   struct log_job* jobs;      /**< The jobs */
+   int number_of_jobs;        /**< The number of jobs */
+   atomic_int next;           /**< The next job to take */
+   atomic_llong bytes;        /**< The number of bytes read */
+   int64_t max_bytes;         /**< The number of bytes read after which the scan stops, or 0 */
+   int64_t deadline;          /**< The monotonic time in milliseconds at which the scan stops, or 0 */
+   bool (*interrupted)(void); /**< Is the scan to be stopped, or NULL */
+   atomic_bool stopped;       /**< Was the scan stopped */
+};
+
+/** @struct log_index_header
+ * The header of the index file
+ */
+struct log_index_header
+{
+   uint32_t magic;   /**< LOG_INDEX_MAGIC */
+   uint32_t version; /**< LOG_INDEX_VERSION */
+   uint32_t entries; /**< The number of entries */
+};
+
+/** @struct log_index_entry
+ * The counts of a compressed file in the index file
+ */
+struct log_index_entry
+{
+   uint64_t device;          /**< The device */
+   uint64_t inode;           /**< The inode */
+   int64_t size;             /**< The size */
+   int64_t mtime;            /**< The modification time */
+   int64_t offset;           /**< The number of decoded bytes */
+   struct log_counts counts; /**< The counts */
+   uint32_t errors;          /**< The number of struct log_error following the entry */
+   uint32_t labeled;         /**< Were the lines counted by label */
+   uint32_t labels;          /**< The number of struct log_label following the errors */
+   uint32_t durations;       /**< Does a struct log_histogram follow the labels */
+   uint32_t matches;         /**< The number of pattern counts following the histogram */
+   uint64_t patterns;        /**< The hash of the patterns counted */
+   uint32_t marks;           /**< The number of struct log_mark following the pattern counts */
+};
+
+#define LOG_SCAN_STOPPED   2
+#define LOG_SCAN_TRUNCATED 3
+
+#define LOG_INDEX_MAGIC   0x50474549
+#define LOG_INDEX_VERSION 6
+
+static void logs_init(void) __attribute__((constructor));
+static void scan_block(struct log_file* file, const char* buffer, size_t length);
+static const char* scan_line(const char* line, const char* end, int* severity, const char** message);
+static const char* find_newline_scalar(const char* p, const char* end);
+static const char* find_event_scalar(const char* p, const char* end);
+#if defined(__x86_64__)
+static const char* find_newline_sse2(const char* p, const char* end);
+static const char* find_event_sse2(const char* p, const char* end);
+static const char* find_newline_avx2(const char* p, const char* end) __attribute__((target("avx2")));
+static const char* find_event_avx2(const char* p, const char* end) __attribute__((target("avx2")));
+#endif
+static int severity_from_token(const char* token, size_t length);
+static void count_line(struct log_file* file, const char* line, size_t length);
+static void count_severity(struct log_file* file, const char* line, size_t length, int severity, const char* message);
+static void count_labels(struct log_file* file, const char* line, size_t length, int severity, const char* message);
+static const char* prefix_end(const char* line, const char* message);
+static void add_label(struct log_file* file, struct log_label_key* key, int severity);
+static void value_key(struct log_file* file, struct log_label_key* key);
+static void json_labels(struct log_file* file, const char* line, size_t length);
+static int csv_label(int field);
+static void end_csv_record(struct log_file* file);
+static int classify_json(const char* line, size_t length);
+static bool is_error(int severity);
+static void add_line_error(struct log_file* file, const char* line, size_t length, const char* message);
+static void add_json_error(struct log_file* file, const char* line, size_t length);
+static void add_error(struct log_file* file, struct log_fingerprint* fingerprint, const char* sqlstate);
+static void add_line_duration(struct log_file* file, const char* line, size_t length, const char* message);
+static void add_duration(struct log_file* file, const char* message, const char* end);
+static void count_patterns(struct log_file* file, const char* line, size_t length, const char* message);
+static void add_matches(struct log_file* file, uint64_t found);
+static uint64_t hash_spec(const char* spec);
+static const char* json_value(const char* line, size_t length, const char* key, size_t key_length);
+static void scan_csv_block(struct log_file* file, const char* p, const char* end);
+static void finish_file(struct log_file* file);
+static bool ends_with(const char* str, const char* suffix);
+static struct log_file* find_file(struct log_state* state, struct stat* st);
+static int compare_jobs(const void* a, const void* b);
+static void run_jobs(struct log_pool* pool, int workers, char* buffer);
+static void* scan_worker(void* arg);
+static void reset_file(struct log_file* file);
+static void load_index(struct log_state* state);
+static void save_index(struct log_state* state);
+static int scan_file(struct log_pool* pool, const char* path, struct log_file* file, char* buffer);
+static bool spend(struct log_pool* pool, size_t length);
+static int64_t now_ms(void);
+static int process_log_file(struct log_pool* pool, const char* file_path, struct log_file* file, char* buffer);
+static int map_log_file(struct log_pool* pool, int fd, off_t size, struct log_file* file);
+static void release_pages(int fd, off_t start, off_t end);
+static void install_map_guard(void);
+static void map_fault(int signo);
+static int process_compressed_log_file(struct log_pool* pool, const char* file_path, const struct log_decoder* decoder, struct log_file* file, char* buffer);
+static void close_stream(struct log_stream* stream);
+
+/* The mapping being scanned by this thread, to recover from its truncation */
+static _Thread_local sigjmp_buf* map_guard = NULL;
+static pthread_once_t map_guard_once = PTHREAD_ONCE_INIT;
+static struct sigaction map_fault_default;
+
+/* Selected for the CPU when the library is loaded */
+static const char* (*find_newline)(const char* p, const char* end) = find_newline_scalar;
+static const char* (*find_event)(const char* p, const char* end) = find_event_scalar;
+
+static const char* severities[NUMBER_OF_SEVERITIES] = {
+   "DEBUG5",
+   "DEBUG4",
+   "DEBUG3",
+   "DEBUG2",
+   "DEBUG1",
+   "INFO",
+   "NOTICE",
+   "WARNING",
+   "ERROR",
+   "LOG",
+   "FATAL",
+   "PANIC"
+};
+
+const char*
+pgexporter_ext_log_severity_name(int severity)
+{
+   if (severity < 0 || severity >= NUMBER_OF_SEVERITIES)
+   {
+      return NULL;
+   }
+
+   return severities[severity];
+}
+
+int
+pgexporter_ext_log_classify(const char* line, size_t length)
+{
+   int severity;
+   const char* message;
+
+   scan_line(line, line + length, &severity, &message);
+
+   return severity;
+}
+
+int
+pgexporter_ext_log_classify_message(const char* line, size_t length, const char** message)
+{
+   int severity;
+
+   scan_line(line, line + length, &severity, message);
+
+   return severity;
+}
+
+int
+pgexporter_ext_log_classify_json(const char* line, size_t length)
+{
+   return classify_json(line, length);
+}
+
+int
+pgexporter_ext_log_severity(const char* token, size_t length)
+{
+   return severity_from_token(token, length);
+}
+
+void
+pgexporter_ext_log_finish_file(struct log_file* file)
+{
+   finish_file(file);
+}
+
+void
+pgexporter_ext_log_scan_block(struct log_file* file, const char* buffer, size_t length)
+{
+   const char* p = buffer;
+   const char* end = buffer + length;
+   const char* q;
+   int64_t time;
+
+   /* The block is split at the entries starting a mark, so the counts of a mark are exact */
+   while ((q = pgexporter_ext_log_marks_find(file, buffer, p, end, &time)) != NULL)
+   {
+      scan_block(file, p, q - p);
+
+      /* A csvlog line inside a quoted field doesn't start a record */
+      if (file->format != LOG_FORMAT_CSV || (file->field == 0 && !file->quoted))
+      {
+         pgexporter_ext_log_marks_add(file, file->offset + (q - buffer), time);
+      }
+      else
+      {
+         file->next_mark = file->offset + (q - buffer) + 1;
+      }
+
+      p = q;
+   }
+
+   scan_block(file, p, end - p);
+
+   if (length > 0)
+   {
+      file->midline = buffer[length - 1] != '\n';
+   }
+}
+
+static void
+scan_block(struct log_file* file, const char* buffer, size_t length)
+{
+   const char* p = buffer;
+   const char* end = buffer + length;
+   const char* nl;
+   const char* message = NULL;
+   size_t n;
+   int severity;
+
+   /* A csvlog record may span lines, so it is scanned field by field */
+   if (file->format == LOG_FORMAT_CSV)
+   {
+      scan_csv_block(file, p, end);
+      return;
+   }
+
+   if (file->partial_length > 0)
+   {
+      nl = find_newline(p, end);
+
+      /* Only the start of a line is needed to classify it */
+      n = (nl != NULL ? nl : end) - p;
+      if (n > LOG_PARTIAL_SIZE - file->partial_length)
+      {
+         n = LOG_PARTIAL_SIZE - file->partial_length;
+      }
+
+      memcpy(file->partial + file->partial_length, p, n);
+      file->partial_length += n;
+
+      if (nl == NULL)
+      {
+         return;
+      }
+
+      count_line(file, file->partial, file->partial_length);
+
+      file->partial_length = 0;
+      p = nl + 1;
+   }
+
+   while (p < end)
+   {
+      if (file->format == LOG_FORMAT_JSON)
+      {
+         nl = find_newline(p, end);
+         severity = nl != NULL ? classify_json(p, nl - p) : -1;
+      }
+      else
+      {
+         nl = scan_line(p, end, &severity, &message);
+      }
+
+      if (nl == NULL)
+      {
+         n = end - p;
+         if (n > LOG_PARTIAL_SIZE)
+         {
+            n = LOG_PARTIAL_SIZE;
+         }
+
+         memcpy(file->partial, p, n);
+         file->partial_length = n;
+         break;
+      }
+
+      if (severity >= 0)
+      {
+         count_severity(file, p, nl - p, severity, message);
+      }
+
+      p = nl + 1;
+   }
+}
+
+int
+pgexporter_ext_log_format(const char* path)
+{
+   char name[MAX_PATH];
+   size_t length;
+
+   snprintf(name, sizeof(name), "%s", path);
+   length = strlen(name);
+
+   if (pgexporter_ext_log_decoder(name) != NULL)
+   {
+      while (length > 0 && name[length - 1] != '.')
+      {
+         length--;
+      }
+      if (length > 0)
+      {
+         name[length - 1] = '\0';
+      }
+   }
+
+   if (ends_with(name, ".csv"))
+   {
+      return LOG_FORMAT_CSV;
+   }
+   else if (ends_with(name, ".json"))
+   {
+      return LOG_FORMAT_JSON;
+   }
+
+   return LOG_FORMAT_STDERR;
+}
+
+struct log_state*
+pgexporter_ext_log_state_create(void)
+{
+   struct log_state* state = NULL;
+
+   state = (struct log_state*)malloc(sizeof(struct log_state));
+   if (state == NULL)
+   {
+      goto error;
+   }
+
+   memset(state, 0, sizeof(struct log_state));
+   state->workers = 1;
+
+   state->buffer = (char*)malloc(LOG_BUFFER_SIZE);
+   if (state->buffer == NULL)
+   {
+      goto error;
+   }
+
+   return state;
+
+error:
+
+   free(state);
+
+   return NULL;
+}
+
+void
+pgexporter_ext_log_state_destroy(struct log_state* state)
+{
+   struct log_file* file;
+   struct log_file* next;
+
+   if (state == NULL)
+   {
+      return;
+   }
+
+   file = state->files;
+   while (file != NULL)
+   {
+      next = file->next;
+      free(file->errors);
+      pgexporter_ext_log_labels_destroy(file->labels);
+      free(file->durations);
+      free(file->matches);
+      pgexporter_ext_log_marks_destroy(file->marks);
+      close_stream(file->stream);
+      free(file);
+      file = next;
+   }
+
+   pgexporter_ext_log_patterns_destroy(state->patterns);
+   free(state->buffer);
+   free(state);
+}
+
+int
+pgexporter_ext_log_state_scan(struct log_state* state, const char* directory, struct log_counts* counts)
+{
+   DIR* dp;
+   struct dirent* entry;
+   struct stat st;
+   struct log_file* file;
+   struct log_file** link;
+   struct log_pool pool;
+   struct log_job* job;
+   struct log_job* jobs;
+   int capacity = 0;
+   bool labeled;
+   int64_t start;
+
+   memset(counts, 0, sizeof(struct log_counts));
+   memset(&pool, 0, sizeof(struct log_pool));
+
+   start = now_ms();
+   atomic_init(&pool.bytes, 0);
+   atomic_init(&pool.stopped, false);
+   pool.max_bytes = state->max_bytes;
+   pool.deadline = state->max_time > 0 ? start + state->max_time : 0;
+   pool.interrupted = state->interrupted;
+
+   if (state->index[0] != '\0' && !state->index_loaded)
+   {
+      load_index(state);
+      state->index_loaded = true;
+   }
+
+   dp = opendir(directory);
+   if (!dp)
+   {
+      goto error;
+   }
+
+   for (file = state->files; file != NULL; file = file->next)
+   {
+      file->seen = false;
+   }
+
+   while ((entry = readdir(dp)) != NULL)
+   {
+      if (entry->d_name[0] == '.')
+      {
+         continue;
+      }
+
+      if (pool.number_of_jobs == capacity)
+      {
+         capacity = capacity == 0 ? 64 : capacity * 2;
+         jobs = (struct log_job*)realloc(pool.jobs, capacity * sizeof(struct log_job));
+         if (jobs == NULL)
+         {
+            closedir(dp);
+            goto error;
+         }
+         pool.jobs = jobs;
+      }
+
+      job = &pool.jobs[pool.number_of_jobs];
+
+      snprintf(job->path, sizeof(job->path), "%s/%s", directory, entry->d_name);
+
+      if (stat(job->path, &st) || !S_ISREG(st.st_mode))
+      {
+         continue;
+      }
+
+      file = find_file(state, &st);
+      if (file == NULL)
+      {
+         file = (struct log_file*)malloc(sizeof(struct log_file));
+         if (file == NULL)
+         {
+            closedir(dp);
+            goto error;
+         }
+
+         memset(file, 0, sizeof(struct log_file));
+         file->device = st.st_dev;
+         file->inode = st.st_ino;
+         file->compressed = pgexporter_ext_log_decoder(job->path) != NULL;
+         file->next = state->files;
+         state->files = file;
+      }
+
+      file->seen = true;
+      file->format = pgexporter_ext_log_format(job->path);
+
+      /* A compressed file is only decoded once, so it is always counted by label
+       * and its entry in the index serves every process */
+      labeled = state->labeled || file->compressed;
+
+      /* A file scanned without labels is scanned again once they are counted */
+      if (labeled && !file->labeled && file->offset > 0)
+      {
+         reset_file(file);
+      }
+      file->prefix = &state->prefix;
+      file->labeled = labeled;
+      file->patterns = state->patterns;
+
+      if (file->compressed)
+      {
+         /* Compressed files are immutable once written, so only one whose scan
+          * was stopped is read again, from where it stopped */
+         if (file->offset > 0 && file->size == st.st_size && file->mtime == st.st_mtime)
+         {
+            if (file->stream == NULL)
+            {
+               continue;
+            }
+         }
+         else
+         {
+            reset_file(file);
+         }
+      }
+      else if (st.st_size < file->offset)
+      {
+         /* Truncated, f.ex. by log_truncate_on_rotation */
+         reset_file(file);
+      }
+      else if (st.st_size == file->offset)
+      {
+         continue;
+      }
+
+      job->file = file;
+      job->size = st.st_size;
+      job->mtime = st.st_mtime;
+      job->result = 0;
+      pool.number_of_jobs++;
+   }
+
+   closedir(dp);
+
+   run_jobs(&pool, state->workers, state->buffer);
+
+   state->stale = false;
+
+   for (int i = 0; i < pool.number_of_jobs; i++)
+   {
+      job = &pool.jobs[i];
+
+      /* A file may be rotated away while we scan, so skip it */
+      if (job->result == 1)
+      {
+         reset_file(job->file);
+         continue;
+      }
+
+      /* The file continues from its cursor on the next scan */
+      if (job->result == LOG_SCAN_STOPPED)
+      {
+         state->stale = true;
+      }
+
+      job->file->size = job->size;
+      job->file->mtime = job->mtime;
+
+      if (job->file->compressed)
+      {
+         state->index_dirty = true;
+      }
+   }
+
+   free(pool.jobs);
+   pool.jobs = NULL;
+
+   state->scanned = atomic_load(&pool.bytes);
+   state->elapsed = now_ms() - start;
+
+   /* Forget the files that were removed */
+   link = &state->files;
+   while (*link != NULL)
+   {
+      file = *link;
+
+      if (!file->seen)
+      {
+         if (file->compressed)
+         {
+            state->index_dirty = true;
+         }
+
+         *link = file->next;
+         free(file->errors);
+         pgexporter_ext_log_labels_destroy(file->labels);
+         free(file->durations);
+         free(file->matches);
+         pgexporter_ext_log_marks_destroy(file->marks);
+         close_stream(file->stream);
+         free(file);
+         continue;
+      }
+
+      for (int i = 0; i < NUMBER_OF_SEVERITIES; i++)
+      {
+         counts->count[i] += file->counts.count[i];
+      }
+
+      link = &file->next;
+   }
+
+   if (state->index[0] != '\0' && state->index_dirty)
+   {
+      save_index(state);
+   }
+
+   return 0;
+
+error:
+
+   free(pool.jobs);
+
+   return 1;
+}
+
+void
+pgexporter_ext_log_state_errors(struct log_state* state, struct log_topk* topk)
+{
+   memset(topk, 0, sizeof(struct log_topk));
+
+   for (struct log_file* file = state->files; file != NULL; file = file->next)
+   {
+      if (file->errors != NULL)
+      {
+         pgexporter_ext_topk_merge(topk, file->errors);
+      }
+   }
+}
+
+struct log_labels*
+pgexporter_ext_log_state_labels(struct log_state* state)
+{
+   struct log_labels* labels;
+
+   labels = pgexporter_ext_log_labels_create();
+   if (labels == NULL)
+   {
+      return NULL;
+   }
+
+   for (struct log_file* file = state->files; file != NULL; file = file->next)
+   {
+      if (file->labels != NULL)
+      {
+         pgexporter_ext_log_labels_merge(labels, file->labels);
+      }
+   }
+
+   return labels;
+}
+
+void
+pgexporter_ext_log_state_durations(struct log_state* state, struct log_histogram* histogram)
+{
+   memset(histogram, 0, sizeof(struct log_histogram));
+
+   for (struct log_file* file = state->files; file != NULL; file = file->next)
+   {
+      if (file->durations != NULL)
+      {
+         pgexporter_ext_histogram_merge(histogram, file->durations);
+      }
+   }
+}
+
+int
+pgexporter_ext_log_state_patterns(struct log_state* state, const char* spec)
+{
+   struct log_patterns* patterns = NULL;
+   uint64_t hash;
+
+   hash = hash_spec(spec);
+   if (hash == state->patterns_hash)
+   {
+      return 0;
+   }
+
+   if (pgexporter_ext_log_patterns_compile(spec, &patterns))
+   {
+      return 1;
+   }
+
+   pgexporter_ext_log_patterns_destroy(state->patterns);
+   state->patterns = patterns;
+   state->patterns_hash = hash;
+
+   /* The counts of the old patterns are useless */
+   for (struct log_file* file = state->files; file != NULL; file = file->next)
+   {
+      reset_file(file);
+      file->patterns = patterns;
+   }
+
+   return 0;
+}
+
+void
+pgexporter_ext_log_state_matches(struct log_state* state, uint64_t* matches)
+{
+   memset(matches, 0, LOG_PATTERNS_MAX * sizeof(uint64_t));
+
+   for (struct log_file* file = state->files; file != NULL; file = file->next)
+   {
+      if (file->matches != NULL)
+      {
+         for (int i = 0; i < LOG_PATTERNS_MAX; i++)
+         {
+            matches[i] += file->matches[i];
+         }
+      }
+   }
+}
+
+int
+pgexporter_ext_log_state_counts_between(struct log_state* state, const char* directory, int64_t from, int64_t to, struct log_counts* counts)
+{
+   DIR* dp;
+   struct dirent* entry;
+   struct stat st;
+   struct log_file* file;
+   char path[MAX_PATH];
+
+   memset(counts, 0, sizeof(struct log_counts));
+
+   dp = opendir(directory);
+   if (dp == NULL)
+   {
+      goto error;
+   }
+
+   while ((entry = readdir(dp)) != NULL)
+   {
+      if (entry->d_name[0] == '.')
+      {
+         continue;
+      }
+
+      snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+
+      if (stat(path, &st) || !S_ISREG(st.st_mode))
+      {
+         continue;
+      }
+
+      /* A file without times in its entries can't be placed in the range */
+      file = find_file(state, &st);
+      if (file == NULL || file->marks == NULL || file->marks->size == 0)
+      {
+         continue;
+      }
+
+      /* A file may be rotated away while we read, so it is skipped */
+      pgexporter_ext_log_marks_count(path, file, from, to, counts, state->buffer);
+   }
+
+   closedir(dp);
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+bool
+pgexporter_ext_log_duration(const char* message, const char* end, uint64_t* duration)
+{
+   static const char key[] = "duration: ";
+   const char* p;
+   uint64_t ms = 0;
+   uint64_t us = 0;
+   int digits = 0;
+
+   if ((size_t)(end - message) < sizeof(key) - 1 || memcmp(message, key, sizeof(key) - 1) != 0)
+   {
+      return false;
+   }
+
+   /* PostgreSQL writes the duration as "%.3f ms" */
+   for (p = message + sizeof(key) - 1; p < end && *p >= '0' && *p <= '9'; p++)
+   {
+      ms = ms * 10 + (*p - '0');
+      digits++;
+   }
+
+   if (digits == 0)
+   {
+      return false;
+   }
+
+   if (p < end && *p == '.')
+   {
+      digits = 0;
+      for (p++; p < end && *p >= '0' && *p <= '9'; p++)
+      {
+         if (digits++ < 3)
+         {
+            us = us * 10 + (*p - '0');
+         }
+      }
+
+      for (; digits < 3; digits++)
+      {
+         us *= 10;
+      }
+   }
+
+   if (end - p < 3 || memcmp(p, " ms", 3) != 0)
+   {
+      return false;
+   }
+
+   *duration = ms * 1000 + us;
+
+   return true;
+}
+
+int
+pgexporter_ext_log_scan_file(const char* path, struct log_counts* counts)
+{
+   struct log_file* file = NULL;
+   char* buffer = NULL;
+
+   file = (struct log_file*)malloc(sizeof(struct log_file));
+   buffer = (char*)malloc(LOG_BUFFER_SIZE);
+
+   if (file == NULL || buffer == NULL)
+   {
+      goto error;
+   }
+
+   memset(file, 0, sizeof(struct log_file));
+   file->compressed = pgexporter_ext_log_decoder(path) != NULL;
+   file->format = pgexporter_ext_log_format(path);
+
+   if (scan_file(NULL, path, file, buffer))
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < NUMBER_OF_SEVERITIES; i++)
+   {
+      counts->count[i] += file->counts.count[i];
+   }
+
+   free(buffer);
+   free(file->errors);
+   free(file->durations);
+   free(file->matches);
+   pgexporter_ext_log_marks_destroy(file->marks);
+   free(file);
+
+   return 0;
+
+error:
+
+   free(buffer);
+   if (file != NULL)
+   {
+      free(file->errors);
+      free(file->durations);
+      free(file->matches);
+      pgexporter_ext_log_marks_destroy(file->marks);
+   }
+   free(file);
+
+   return 1;
+}
+
+int
+pgexporter_ext_log_scan_directory(const char* directory, int workers, struct log_counts* counts)
+{
+   struct log_state* state = NULL;
+
+   state = pgexporter_ext_log_state_create();
+   if (state == NULL)
+   {
+      goto error;
+   }
+
+   state->workers = workers;
+
+   if (pgexporter_ext_log_state_scan(state, directory, counts))
+   {
+      goto error;
+   }
+
+   pgexporter_ext_log_state_destroy(state);
+
+   return 0;
+
+error:
+
+   pgexporter_ext_log_state_destroy(state);
+
+   return 1;
+}
+
+static const char*
+scan_line(const char* line, const char* end, int* severity, const char** message)
+{
+   const char* p = line;
+   const char* s;
+
+   *severity = -1;
+   *message = NULL;
+
+   /* Continuation lines of multi-line entries */
+   if (p < end && *p == '\t')
+   {
+      return find_newline(p, end);
+   }
+
+   /* PostgreSQL writes the severity as "LEVEL:  " right after log_line_prefix,
+    * so one sweep finds either the severity or the end of the line */
+   while ((p = find_event(p, end)) != NULL)
+   {
+      if (*p == '\n')
+      {
+         return p;
+      }
+
+      s = p;
+      while (s > line && p - s < 8 && ((*(s - 1) >= 'A' && *(s - 1) <= 'Z') || (*(s - 1) >= '0' && *(s - 1) <= '9')))
+      {
+         s--;
+      }
+
+      if (p - s >= 3)
+      {
+         /* DETAIL, HINT, STATEMENT, ... lines belong to the previous entry */
+         *severity = severity_from_token(s, p - s);
+         *message = p + 3;
+
+         return find_newline(p + 3, end);
+      }
+
+      p++;
+   }
+
+   return NULL;
+}
+
+static int
+compare_jobs(const void* a, const void* b)
+{
+   const struct log_job* ja = (const struct log_job*)a;
+   const struct log_job* jb = (const struct log_job*)b;
+
+   /* Compressed files cost the most per byte, then the largest files */
+   if (ja->file->compressed != jb->file->compressed)
+   {
+      return ja->file->compressed ? -1 : 1;
+   }
+
+   if (ja->size != jb->size)
+   {
+      return ja->size > jb->size ? -1 : 1;
+   }
+
+   return 0;
+}
+
+static void
+run_jobs(struct log_pool* pool, int workers, char* buffer)
+{
+   pthread_t threads[MAX_SCAN_WORKERS];
+   int started = 0;
+   sigset_t all;
+   sigset_t old;
+   struct log_job* job;
+   int i;
+
+   if (workers > pool->number_of_jobs)
+   {
+      workers = pool->number_of_jobs;
+   }
+
+   if (workers > MAX_SCAN_WORKERS)
+   {
+      workers = MAX_SCAN_WORKERS;
+   }
+
+   atomic_init(&pool->next, 0);
+
+   if (workers > 1)
+   {
+      qsort(pool->jobs, pool->number_of_jobs, sizeof(struct log_job), compare_jobs);
+
+      /* The threads only decompress and count, so keep every signal on the calling thread */
+      sigfillset(&all);
+      pthread_sigmask(SIG_SETMASK, &all, &old);
+
+      for (i = 1; i < workers; i++)
+      {
+         if (pthread_create(&threads[started], NULL, scan_worker, pool) != 0)
+         {
+            break;
+         }
+         started++;
+      }
+
+      pthread_sigmask(SIG_SETMASK, &old, NULL);
+   }
+
+   /* The calling thread takes part with its own buffer */
+   while ((i = atomic_fetch_add(&pool->next, 1)) < pool->number_of_jobs)
+   {
+      job = &pool->jobs[i];
+      job->result = atomic_load(&pool->stopped) ? LOG_SCAN_STOPPED : scan_file(pool, job->path, job->file, buffer);
+   }
+
+   for (i = 0; i < started; i++)
+   {
+      pthread_join(threads[i], NULL);
+   }
+}
+
+static void*
+scan_worker(void* arg)
+{
+   struct log_pool* pool = (struct log_pool*)arg;
+   struct log_job* job;
+   char* buffer = NULL;
+   int i;
+
+   buffer = (char*)malloc(LOG_BUFFER_SIZE);
+
+   while ((i = atomic_fetch_add(&pool->next, 1)) < pool->number_of_jobs)
+   {
+      job = &pool->jobs[i];
+      if (atomic_load(&pool->stopped))
+      {
+         job->result = LOG_SCAN_STOPPED;
+      }
+      else
+      {
+         job->result = buffer != NULL ? scan_file(pool, job->path, job->file, buffer) : 1;
+      }
+   }
+
+   free(buffer);
+
+   return NULL;
+}
+
+static void
+logs_init(void)
+{
+#if defined(__x86_64__)
+   __builtin_cpu_init();
+
+   if (__builtin_cpu_supports("avx2"))
+   {
+      find_newline = find_newline_avx2;
+      find_event = find_event_avx2;
+   }
+   else
+   {
+      find_newline = find_newline_sse2;
+      find_event = find_event_sse2;
+   }
+#endif
+}
+
+static const char*
+find_newline_scalar(const char* p, const char* end)
+{
+   return memchr(p, '\n', end - p);
+}
+
+static const char*
+find_event_scalar(const char* p, const char* end)
+{
+   for (; p < end; p++)
+   {
+      if (*p == '\n' || (*p == ':' && end - p >= 3 && p[1] == ' ' && p[2] == ' '))
+      {
+         return p;
+      }
+   }
+
+   return NULL;
+}
+
+#if defined(__x86_64__)
+static const char*
+find_newline_sse2(const char* p, const char* end)
+{
+   const __m128i nl = _mm_set1_epi8('\n');
+   unsigned int mask;
+
+   while (end - p >= 16)
+   {
+      mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p), nl));
+      if (mask != 0)
+      {
+         return p + __builtin_ctz(mask);
+      }
+
+      p += 16;
+   }
+
+   return find_newline_scalar(p, end);
+}
+
+static const char*
+find_event_sse2(const char* p, const char* end)
+{
+   const __m128i nl = _mm_set1_epi8('\n');
+   const __m128i colon = _mm_set1_epi8(':');
+   const __m128i space = _mm_set1_epi8(' ');
+   __m128i a;
+   __m128i m;
+   unsigned int mask;
+
+   /* A newline, or a ':' followed by two spaces checked with shifted loads */
+   while (end - p >= 18)
+   {
+      a = _mm_loadu_si128((const __m128i*)p);
+      m = _mm_cmpeq_epi8(a, colon);
+      m = _mm_and_si128(m, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p + 1)), space));
+      m = _mm_and_si128(m, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p + 2)), space));
+      m = _mm_or_si128(m, _mm_cmpeq_epi8(a, nl));
+
+      mask = _mm_movemask_epi8(m);
+      if (mask != 0)
+      {
+         return p + __builtin_ctz(mask);
+      }
+
+      p += 16;
+   }
+
+   return find_event_scalar(p, end);
+}
+
+static const char*
+find_newline_avx2(const char* p, const char* end)
+{
+   const __m256i nl = _mm256_set1_epi8('\n');
+   unsigned int mask;
+
+   while (end - p >= 32)
+   {
+      mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)p), nl));
+      if (mask != 0)
+      {
+         return p + __builtin_ctz(mask);
+      }
+
+      p += 32;
+   }
+
+   return find_newline_sse2(p, end);
+}
+
+static const char*
+find_event_avx2(const char* p, const char* end)
+{
+   const __m256i nl = _mm256_set1_epi8('\n');
+   const __m256i colon = _mm256_set1_epi8(':');
+   const __m256i space = _mm256_set1_epi8(' ');
+   __m256i a;
+   __m256i m;
+   unsigned int mask;
+
+   while (end - p >= 34)
+   {
+      a = _mm256_loadu_si256((const __m256i*)p);
+      m = _mm256_cmpeq_epi8(a, colon);
+      m = _mm256_and_si256(m, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(p + 1)), space));
+      m = _mm256_and_si256(m, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(p + 2)), space));
+      m = _mm256_or_si256(m, _mm256_cmpeq_epi8(a, nl));
+
+      mask = _mm256_movemask_epi8(m);
+      if (mask != 0)
+      {
+         return p + __builtin_ctz(mask);
+      }
+
+      p += 32;
+   }
+
+   return find_event_sse2(p, end);
+}
+#endif
+
+static int
+severity_from_token(const char* token, size_t length)
+{
+   switch (length)
+   {
+      case 3:
+         if (!memcmp(token, "LOG", 3))
+         {
+            return SEVERITY_LOG;
+         }
+         break;
+      case 4:
+         if (!memcmp(token, "INFO", 4))
+         {
+            return SEVERITY_INFO;
+         }
+         break;
+      case 5:
+         if (!memcmp(token, "ERROR", 5))
+         {
+            return SEVERITY_ERROR;
+         }
+         else if (!memcmp(token, "FATAL", 5))
+         {
+            return SEVERITY_FATAL;
+         }
+         else if (!memcmp(token, "PANIC", 5))
+         {
+            return SEVERITY_PANIC;
+         }
+         break;
+      case 6:
+         if (!memcmp(token, "DEBUG", 5) && token[5] >= '1' && token[5] <= '5')
+         {
+            return SEVERITY_DEBUG1 - (token[5] - '1');
+         }
+         else if (!memcmp(token, "NOTICE", 6))
+         {
+            return SEVERITY_NOTICE;
+         }
+         break;
+      case 7:
+         if (!memcmp(token, "WARNING", 7))
+         {
+            return SEVERITY_WARNING;
+         }
+         break;
+      default:
+         break;
+   }
+
+   return -1;
+}
+
+static bool
+ends_with(const char* str, const char* suffix)
+{
+   size_t str_len = strlen(str);
+   size_t suffix_len = strlen(suffix);
+
+   return (str_len >= suffix_len) && (strcmp(str + (str_len - suffix_len), suffix) == 0);
+}
+
+static struct log_file*
+find_file(struct log_state* state, struct stat* st)
+{
+   for (struct log_file* file = state->files; file != NULL; file = file->next)
+   {
+      if (file->device == st->st_dev && file->inode == st->st_ino)
+      {
+         return file;
+      }
+   }
+
+   return NULL;
+}
+
+static void
+reset_file(struct log_file* file)
+{
+   file->size = 0;
+   file->mtime = 0;
+   file->offset = 0;
+   file->partial_length = 0;
+   file->quoted = false;
+   file->closed = false;
+   file->field = 0;
+   file->token_length = 0;
+   file->error = false;
+   file->duration_length = 0;
+   file->pattern_state = 0;
+   file->pattern_found = 0;
+   pgexporter_ext_log_marks_destroy(file->marks);
+   file->marks = NULL;
+   file->next_mark = 0;
+   file->midline = false;
+   file->frame_input = 0;
+   file->frame_output = 0;
+   memset(file->values, 0, sizeof(file->values));
+   memset(&file->counts, 0, sizeof(struct log_counts));
+
+   close_stream(file->stream);
+   file->stream = NULL;
+
+   if (file->errors != NULL)
+   {
+      file->errors->size = 0;
+   }
+
+   if (file->durations != NULL)
+   {
+      memset(file->durations, 0, sizeof(struct log_histogram));
+   }
+
+   if (file->matches != NULL)
+   {
+      memset(file->matches, 0, LOG_PATTERNS_MAX * sizeof(uint64_t));
+   }
+
+   pgexporter_ext_log_labels_destroy(file->labels);
+   file->labels = NULL;
+}
+
+static void
+count_line(struct log_file* file, const char* line, size_t length)
+{
+   const char* message = NULL;
+   int severity;
+
+   if (file->format == LOG_FORMAT_JSON)
+   {
+      severity = classify_json(line, length);
+   }
+   else
+   {
+      scan_line(line, line + length, &severity, &message);
+   }
+
+   if (severity >= 0)
+   {
+      count_severity(file, line, length, severity, message);
+   }
+}
+
+static void
+count_severity(struct log_file* file, const char* line, size_t length, int severity, const char* message)
+{
+   file->counts.count[severity]++;
+
+   if (file->labeled)
+   {
+      count_labels(file, line, length, severity, message);
+   }
+
+   if (file->patterns != NULL)
+   {
+      count_patterns(file, line, length, message);
+   }
+
+   if (is_error(severity))
+   {
+      add_line_error(file, line, length, message);
+   }
+   else if (severity == SEVERITY_LOG)
+   {
+      add_line_duration(file, line, length, message);
+   }
+}
+
+static void
+count_labels(struct log_file* file, const char* line, size_t length, int severity, const char* message)
+{
+   struct log_label_key key;
+
+   if (file->format == LOG_FORMAT_JSON)
+   {
+      json_labels(file, line, length);
+      value_key(file, &key);
+   }
+   else if (file->prefix->labeled && message != NULL)
+   {
+      pgexporter_ext_log_prefix_extract(file->prefix, line, prefix_end(line, message), &key);
+   }
+   else
+   {
+      memset(&key, 0, sizeof(struct log_label_key));
+   }
+
+   add_label(file, &key, severity);
+}
+
+static const char*
+prefix_end(const char* line, const char* message)
+{
+   const char* end;
+
+   /* The prefix ends where the severity starts */
+   end = message - 3;
+   while (end > line && message - 3 - end < 8 && ((*(end - 1) >= 'A' && *(end - 1) <= 'Z') || (*(end - 1) >= '0' && *(end - 1) <= '9')))
+   {
+      end--;
+   }
+
+   return end;
+}
+
+static void
+add_label(struct log_file* file, struct log_label_key* key, int severity)
+{
+   struct log_label* label;
+
+   if (file->labels == NULL)
+   {
+      file->labels = pgexporter_ext_log_labels_create();
+      if (file->labels == NULL)
+      {
+         return;
+      }
+   }
+
+   label = pgexporter_ext_log_labels_find(file->labels, key);
+   if (label != NULL)
+   {
+      label->counts.count[severity]++;
+   }
+}
+
+static void
+value_key(struct log_file* file, struct log_label_key* key)
+{
+   for (int i = 0; i < NUMBER_OF_LABELS; i++)
+   {
+      key->values[i] = file->values[i];
+      key->lengths[i] = strlen(file->values[i]);
+   }
+}
+
+static void
+json_labels(struct log_file* file, const char* line, size_t length)
+{
+   static const char* keys[NUMBER_OF_LABELS] = {
+      [LOG_LABEL_DATABASE] = "\"dbname\":\"",
+      [LOG_LABEL_USER] = "\"user\":\"",
+      [LOG_LABEL_APPLICATION] = "\"application_name\":\"",
+      [LOG_LABEL_HOST] = "\"remote_host\":\""
+   };
+   const char* end = line + length;
+   const char* p;
+   size_t n;
+
+   memset(file->values, 0, sizeof(file->values));
+
+   for (int i = 0; i < NUMBER_OF_LABELS; i++)
+   {
+      p = json_value(line, length, keys[i], strlen(keys[i]));
+
+      for (n = 0; p != NULL && p < end && *p != '"' && n < LOG_LABEL_SIZE - 1; p++)
+      {
+         if (*p == '\\' && p + 1 < end)
+         {
+            p++;
+         }
+
+         file->values[i][n++] = *p;
+      }
+   }
+}
+
+static int
+classify_json(const char* line, size_t length)
+{
+   static const char key[] = "\"error_severity\":\"";
+   const char* p;
+   const char* q;
+
+   /* Quotes inside jsonlog strings are escaped, so the key can't be part of a value */
+   p = memmem(line, length, key, sizeof(key) - 1);
+   if (p == NULL)
+   {
+      return -1;
+   }
+
+   p += sizeof(key) - 1;
+   q = memchr(p, '"', line + length - p);
+   if (q == NULL)
+   {
+      return -1;
+   }
+
+   return severity_from_token(p, q - p);
+}
+
+static bool
+is_error(int severity)
+{
+   return severity == SEVERITY_ERROR || severity == SEVERITY_FATAL || severity == SEVERITY_PANIC;
+}
+
+static void
+add_line_error(struct log_file* file, const char* line, size_t length, const char* message)
+{
+   struct log_fingerprint fingerprint;
+   struct log_label_key key;
+   char sqlstate[SQLSTATE_SIZE];
+
+   if (file->format == LOG_FORMAT_JSON)
+   {
+      add_json_error(file, line, length);
+      return;
+   }
+
+   if (message == NULL)
+   {
+      return;
+   }
+
+   /* The SQLSTATE is only in a stderr line when log_line_prefix has %e */
+   memset(sqlstate, 0, sizeof(sqlstate));
+   if (file->prefix != NULL && file->prefix->sqlstate)
+   {
+      pgexporter_ext_log_prefix_extract(file->prefix, line, prefix_end(line, message), &key);
+      if (key.lengths[LOG_FIELD_SQLSTATE] < SQLSTATE_SIZE)
+      {
+         memcpy(sqlstate, key.values[LOG_FIELD_SQLSTATE], key.lengths[LOG_FIELD_SQLSTATE]);
+      }
+   }
+
+   pgexporter_ext_fingerprint_init(&fingerprint);
+   pgexporter_ext_fingerprint_feed(&fingerprint, message, line + length - message);
+   add_error(file, &fingerprint, sqlstate);
+}
+
+static void
+add_json_error(struct log_file* file, const char* line, size_t length)
+{
+   static const char message_key[] = "\"message\":\"";
+   static const char state_key[] = "\"state_code\":\"";
+   struct log_fingerprint fingerprint;
+   char sqlstate[SQLSTATE_SIZE];
+   const char* p;
+   const char* end = line + length;
+   char c;
+
+   memset(sqlstate, 0, sizeof(sqlstate));
+
+   p = json_value(line, length, state_key, sizeof(state_key) - 1);
+   for (int i = 0; p != NULL && i < SQLSTATE_SIZE - 1 && p < end && *p != '"'; i++, p++)
+   {
+      sqlstate[i] = *p;
+   }
+
+   p = json_value(line, length, message_key, sizeof(message_key) - 1);
+   if (p == NULL)
+   {
+      return;
+   }
+
+   pgexporter_ext_fingerprint_init(&fingerprint);
+
+   for (; p < end && *p != '"'; p++)
+   {
+      c = *p;
+
+      if (c == '\\' && p + 1 < end)
+      {
+         p++;
+         switch (*p)
+         {
+            case '"':
+            case '\\':
+            case '/':
+               c = *p;
+               break;
+            case 'u':
+               /* Non-ASCII characters don't matter for the fingerprint */
+               p += p + 4 < end ? 4 : 0;
+               c = '?';
+               break;
+            default:
+               c = ' ';
+               break;
+         }
+      }
+
+      pgexporter_ext_fingerprint_feed(&fingerprint, &c, 1);
+   }
+
+   add_error(file, &fingerprint, sqlstate);
+}
+
+static void
+add_error(struct log_file* file, struct log_fingerprint* fingerprint, const char* sqlstate)
+{
+   if (file->errors == NULL)
+   {
+      file->errors = (struct log_topk*)malloc(sizeof(struct log_topk));
+      if (file->errors == NULL)
+      {
+         return;
+      }
+
+      memset(file->errors, 0, sizeof(struct log_topk));
+   }
+
+   pgexporter_ext_topk_add(file->errors, fingerprint, sqlstate, 1);
+}
+
+static void
+add_line_duration(struct log_file* file, const char* line, size_t length, const char* message)
+{
+   static const char message_key[] = "\"message\":\"";
+
+   if (file->format == LOG_FORMAT_JSON)
+   {
+      message = json_value(line, length, message_key, sizeof(message_key) - 1);
+   }
+
+   if (message != NULL)
+   {
+      add_duration(file, message, line + length);
+   }
+}
+
+static void
+add_duration(struct log_file* file, const char* message, const char* end)
+{
+   uint64_t duration;
+
+   /* log_duration and log_min_duration_statement lines, f.ex. "duration: 1.234 ms  statement: ..." */
+   if (!pgexporter_ext_log_duration(message, end, &duration))
+   {
+      return;
+   }
+
+   if (file->durations == NULL)
+   {
+      file->durations = (struct log_histogram*)malloc(sizeof(struct log_histogram));
+      if (file->durations == NULL)
+      {
+         return;
+      }
+
+      memset(file->durations, 0, sizeof(struct log_histogram));
+   }
+
+   pgexporter_ext_histogram_add(file->durations, duration);
+}
+
+static void
+count_patterns(struct log_file* file, const char* line, size_t length, const char* message)
+{
+   static const char message_key[] = "\"message\":\"";
+   const char* end = line + length;
+   uint64_t found = 0;
+
+   if (file->format == LOG_FORMAT_JSON)
+   {
+      message = json_value(line, length, message_key, sizeof(message_key) - 1);
+
+      /* The message ends at the first unescaped quote */
+      for (const char* p = message; p != NULL && p < end; p++)
+      {
+         if (*p == '\\')
+         {
+            p++;
+         }
+         else if (*p == '"')
+         {
+            end = p;
+            break;
+         }
+      }
+   }
+
+   if (message == NULL)
+   {
+      return;
+   }
+
+   pgexporter_ext_log_patterns_feed(file->patterns, 0, message, end - message, &found);
+   add_matches(file, found);
+}
+
+static void
+add_matches(struct log_file* file, uint64_t found)
+{
+   if (found == 0)
+   {
+      return;
+   }
+
+   if (file->matches == NULL)
+   {
+      file->matches = (uint64_t*)calloc(LOG_PATTERNS_MAX, sizeof(uint64_t));
+      if (file->matches == NULL)
+      {
+         return;
+      }
+   }
+
+   /* A message is counted once per pattern, however often the pattern occurs */
+   while (found != 0)
+   {
+      file->matches[__builtin_ctzll(found)]++;
+      found &= found - 1;
+   }
+}
+
+static uint64_t
+hash_spec(const char* spec)
+{
+   uint64_t hash = 0xcbf29ce484222325ULL;
+
+   if (spec == NULL || *spec == '\0')
+   {
+      return 0;
+   }
+
+   for (const unsigned char* p = (const unsigned char*)spec; *p != '\0'; p++)
+   {
+      hash = (hash ^ *p) * 0x100000001b3ULL;
+   }
+
+   return hash | 1;
+}
+
+static const char*
+json_value(const char* line, size_t length, const char* key, size_t key_length)
+{
+   const char* p;
+
+   p = memmem(line, length, key, key_length);
+
+   return p != NULL ? p + key_length : NULL;
+}
+
+static void
+scan_csv_block(struct log_file* file, const char* p, const char* end)
+{
+   const char* q;
+   int severity;
+   int label;
+   int last;
+   size_t n;
+   size_t length;
+   bool closed;
+   bool message;
+   bool duration;
+   bool pattern;
+
+   while (p < end)
+   {
+      /* The message of an error record is fingerprinted and the start of the message of
+       * a LOG record is kept for its duration, everything else is skipped */
+      message = file->error && file->field == CSV_MESSAGE_FIELD;
+      duration = file->severity == SEVERITY_LOG && file->field == CSV_MESSAGE_FIELD;
+      pattern = file->patterns != NULL && file->field == CSV_MESSAGE_FIELD;
+      label = file->labeled ? csv_label(file->field) : -1;
+
+      if (file->quoted)
+      {
+         /* A doubled quote inside a field just leaves and enters the field again */
+         q = memchr(p, '"', end - p);
+
+         if (pattern)
+         {
+            file->pattern_state = pgexporter_ext_log_patterns_feed(file->patterns, file->pattern_state, p,
+                                                                   (q != NULL ? q : end) - p, &file->pattern_found);
+         }
+
+         if (message)
+         {
+            pgexporter_ext_fingerprint_feed(&file->fingerprint, p, (q != NULL ? q : end) - p);
+         }
+         else if (label >= 0)
+         {
+            n = strlen(file->values[label]);
+            length = (q != NULL ? q : end) - p;
+            if (length > LOG_LABEL_SIZE - 1 - n)
+            {
+               length = LOG_LABEL_SIZE - 1 - n;
+            }
+
+            memcpy(file->values[label] + n, p, length);
+         }
+         else if (duration)
+         {
+            length = (q != NULL ? q : end) - p;
+            if (length > LOG_DURATION_SIZE - file->duration_length)
+            {
+               length = LOG_DURATION_SIZE - file->duration_length;
+            }
+
+            memcpy(file->duration + file->duration_length, p, length);
+            file->duration_length += length;
+         }
+
+         if (q == NULL)
+         {
+            return;
+         }
+
+         file->quoted = false;
+         file->closed = true;
+         p = q + 1;
+         continue;
+      }
+
+      closed = file->closed;
+      file->closed = false;
+
+      /* The last field needed from the record */
+      last = file->labeled ? CSV_APPLICATION_FIELD :
+             file->error || file->severity == SEVERITY_LOG || file->patterns != NULL ? CSV_MESSAGE_FIELD : CSV_SEVERITY_FIELD;
+
+      if (file->field == CSV_SEVERITY_FIELD)
+      {
+         /* error_severity is never quoted */
+         if (*p == ',' || *p == '\n')
+         {
+            severity = severity_from_token(file->token, file->token_length);
+            if (severity >= 0)
+            {
+               file->counts.count[severity]++;
+            }
+
+            file->severity = severity;
+            file->error = is_error(severity);
+            if (file->error)
+            {
+               pgexporter_ext_fingerprint_init(&file->fingerprint);
+               memset(file->sqlstate, 0, sizeof(file->sqlstate));
+            }
+
+            file->duration_length = 0;
+            file->pattern_state = 0;
+            file->pattern_found = 0;
+            file->token_length = 0;
+
+            if (*p == ',')
+            {
+               file->field++;
+            }
+            else
+            {
+               end_csv_record(file);
+            }
+         }
+         else if (file->token_length < sizeof(file->token))
+         {
+            file->token[file->token_length++] = *p;
+         }
+
+         p++;
+      }
+      else if (file->field > last)
+      {
+         /* Only the end of the record matters after the last needed field */
+         for (q = p; q < end && *q != '"' && *q != '\n'; q++)
+         {
+         }
+
+         if (q == end)
+         {
+            return;
+         }
+
+         if (*q == '"')
+         {
+            file->quoted = true;
+         }
+         else
+         {
+            end_csv_record(file);
+         }
+
+         p = q + 1;
+      }
+      else
+      {
+         if (pattern && (*p != '"' || closed) && *p != ',' && *p != '\n')
+         {
+            file->pattern_state = pgexporter_ext_log_patterns_feed(file->patterns, file->pattern_state, p, 1,
+                                                                   &file->pattern_found);
+         }
+
+         if (*p == '"')
+         {
+            if (message && closed)
+            {
+               pgexporter_ext_fingerprint_feed(&file->fingerprint, p, 1);
+            }
+            else if (label >= 0 && closed && strlen(file->values[label]) < LOG_LABEL_SIZE - 1)
+            {
+               file->values[label][strlen(file->values[label])] = '"';
+            }
+            else if (duration && closed && file->duration_length < LOG_DURATION_SIZE)
+            {
+               file->duration[file->duration_length++] = '"';
+            }
+
+            file->quoted = true;
+         }
+         else if (*p == ',' || *p == '\n')
+         {
+            if (message)
+            {
+               add_error(file, &file->fingerprint, file->sqlstate);
+            }
+            else if (duration)
+            {
+               add_duration(file, file->duration, file->duration + file->duration_length);
+            }
+
+            if (pattern && file->severity >= 0)
+            {
+               add_matches(file, file->pattern_found);
+            }
+
+            if (*p == ',')
+            {
+               file->field++;
+            }
+            else
+            {
+               end_csv_record(file);
+            }
+         }
+         else if (file->error && file->field == CSV_SQLSTATE_FIELD)
+         {
+            if (strlen(file->sqlstate) < SQLSTATE_SIZE - 1)
+            {
+               file->sqlstate[strlen(file->sqlstate)] = *p;
+            }
+         }
+         else if (message)
+         {
+            pgexporter_ext_fingerprint_feed(&file->fingerprint, p, 1);
+         }
+         else if (duration)
+         {
+            if (file->duration_length < LOG_DURATION_SIZE)
+            {
+               file->duration[file->duration_length++] = *p;
+            }
+         }
+         else if (label >= 0 && strlen(file->values[label]) < LOG_LABEL_SIZE - 1)
+         {
+            file->values[label][strlen(file->values[label])] = *p;
+         }
+
+         p++;
+      }
+   }
+}
+
+static int
+csv_label(int field)
+{
+   switch (field)
+   {
+      case CSV_USER_FIELD:
+         return LOG_LABEL_USER;
+      case CSV_DATABASE_FIELD:
+         return LOG_LABEL_DATABASE;
+      case CSV_HOST_FIELD:
+         return LOG_LABEL_HOST;
+      case CSV_APPLICATION_FIELD:
+         return LOG_LABEL_APPLICATION;
+      default:
+         return -1;
+   }
+}
+
+static void
+end_csv_record(struct log_file* file)
+{
+   struct log_label_key key;
+   char* port;
+
+   if (file->labeled)
+   {
+      if (file->field >= CSV_SEVERITY_FIELD && file->severity >= 0)
+      {
+         /* connection_from is host:port */
+         port = strrchr(file->values[LOG_LABEL_HOST], ':');
+         if (port != NULL && strspn(port + 1, "0123456789") == strlen(port + 1))
+         {
+            memset(port, 0, strlen(port));
+         }
+
+         value_key(file, &key);
+         add_label(file, &key, file->severity);
+      }
+
+      memset(file->values, 0, sizeof(file->values));
+   }
+
+   file->field = 0;
+}
+
+static void
+finish_file(struct log_file* file)
+{
+   int severity = -1;
+
+   if (file->format == LOG_FORMAT_CSV)
+   {
+      if (file->field == CSV_SEVERITY_FIELD && file->token_length > 0)
+      {
+         severity = severity_from_token(file->token, file->token_length);
+         if (severity >= 0)
+         {
+            file->counts.count[severity]++;
+         }
+      }
+      else if (file->error && file->field == CSV_MESSAGE_FIELD)
+      {
+         add_error(file, &file->fingerprint, file->sqlstate);
+      }
+      else if (file->severity == SEVERITY_LOG && file->field == CSV_MESSAGE_FIELD)
+      {
+         add_duration(file, file->duration, file->duration + file->duration_length);
+      }
+
+      if (file->patterns != NULL && file->field == CSV_MESSAGE_FIELD && file->severity >= 0)
+      {
+         add_matches(file, file->pattern_found);
+      }
+
+      if (file->field == CSV_SEVERITY_FIELD)
+      {
+         file->severity = severity;
+      }
+
+      end_csv_record(file);
+
+      file->token_length = 0;
+      file->quoted = false;
+      file->closed = false;
+      file->error = false;
+   }
+   else if (file->partial_length > 0)
+   {
+      count_line(file, file->partial, file->partial_length);
+      file->partial_length = 0;
+   }
+}
+
+static void
+load_index(struct log_state* state)
+{
+   FILE* fp;
+   struct log_index_header header;
+   struct log_index_entry entry;
+   struct log_error errors[TOPK_CAPACITY];
+   struct log_label label;
+   struct log_label_key key;
+   struct log_label* found;
+   struct log_file* file;
+   bool ok = true;
+
+   /* The index is only a cache, so a missing or damaged one means a full scan */
+   fp = fopen(state->index, "rb");
+   if (fp == NULL)
+   {
+      return;
+   }
+
+   if (fread(&header, sizeof(header), 1, fp) != 1 ||
+       header.magic != LOG_INDEX_MAGIC || header.version != LOG_INDEX_VERSION)
+   {
+      fclose(fp);
+      return;
+   }
+
+   for (uint32_t i = 0; ok && i < header.entries; i++)
+   {
+      if (fread(&entry, sizeof(entry), 1, fp) != 1)
+      {
+         break;
+      }
+
+      if (entry.errors > TOPK_CAPACITY || entry.labels > LOG_LABELS_MAX + 1)
+      {
+         break;
+      }
+
+      file = (struct log_file*)malloc(sizeof(struct log_file));
+      if (file == NULL)
+      {
+         break;
+      }
+
+      memset(file, 0, sizeof(struct log_file));
+
+      if (entry.errors > 0)
+      {
+         file->errors = (struct log_topk*)malloc(sizeof(struct log_topk));
+         if (file->errors == NULL ||
+             fread(errors, sizeof(struct log_error), entry.errors, fp) != entry.errors)
+         {
+            free(file->errors);
+            free(file);
+            break;
+         }
+
+         file->errors->size = 0;
+         for (uint32_t j = 0; j < entry.errors; j++)
+         {
+            pgexporter_ext_topk_add_error(file->errors, &errors[j]);
+         }
+      }
+
+      if (entry.labels > 0)
+      {
+         file->labels = pgexporter_ext_log_labels_create();
+         ok = file->labels != NULL;
+      }
+
+      for (uint32_t j = 0; ok && j < entry.labels; j++)
+      {
+         found = NULL;
+         if (fread(&label, sizeof(struct log_label), 1, fp) == 1)
+         {
+            for (int k = 0; k < NUMBER_OF_LABELS; k++)
+            {
+               label.values[k][LOG_LABEL_SIZE - 1] = '\0';
+               key.values[k] = label.values[k];
+               key.lengths[k] = strlen(label.values[k]);
+            }
+
+            found = pgexporter_ext_log_labels_find(file->labels, &key);
+         }
+
+         if (found == NULL)
+         {
+            ok = false;
+            break;
+         }
+
+         for (int k = 0; k < NUMBER_OF_SEVERITIES; k++)
+         {
+            found->counts.count[k] += label.counts.count[k];
+         }
+      }
+
+      if (ok && entry.durations)
+      {
+         file->durations = (struct log_histogram*)malloc(sizeof(struct log_histogram));
+         ok = file->durations != NULL &&
+              fread(file->durations, sizeof(struct log_histogram), 1, fp) == 1;
+      }
+
+      if (ok && entry.matches > 0)
+      {
+         file->matches = (uint64_t*)calloc(LOG_PATTERNS_MAX, sizeof(uint64_t));
+         ok = file->matches != NULL && entry.matches <= LOG_PATTERNS_MAX &&
+              fread(file->matches, sizeof(uint64_t), entry.matches, fp) == entry.matches;
+      }
+
+      if (ok && entry.marks > 0)
+      {
+         file->marks = entry.marks <= LOG_MARKS_MAX ? pgexporter_ext_log_marks_create(entry.marks) : NULL;
+         ok = file->marks != NULL &&
+              fread(file->marks->entries, sizeof(struct log_mark), entry.marks, fp) == entry.marks;
+         if (ok)
+         {
+            file->marks->size = entry.marks;
+         }
+      }
+
+      /* The entries are written by every process, so they have the labels and
+       * only differ in the patterns when a session has its own */
+      if (!ok || !entry.labeled ||
+          (state->patterns != NULL && entry.patterns != state->patterns_hash))
+      {
+         free(file->errors);
+         pgexporter_ext_log_labels_destroy(file->labels);
+         free(file->durations);
+         free(file->matches);
+         pgexporter_ext_log_marks_destroy(file->marks);
+         free(file);
+         continue;
+      }
+
+      file->device = entry.device;
+      file->inode = entry.inode;
+      file->size = entry.size;
+      file->mtime = entry.mtime;
+      file->offset = entry.offset;
+      file->compressed = true;
+      file->prefix = &state->prefix;
+      file->labeled = entry.labeled;
+      file->counts = entry.counts;
+      file->next = state->files;
+      state->files = file;
+   }
+
+   fclose(fp);
+}
+
+static void
+save_index(struct log_state* state)
+{
+   char path[MAX_PATH + 32];
+   FILE* fp;
+   struct log_index_header header;
+   struct log_index_entry entry;
+   struct log_error errors[TOPK_CAPACITY];
+   struct log_file* file;
+   bool ok = true;
+
+   memset(&header, 0, sizeof(header));
+   header.magic = LOG_INDEX_MAGIC;
+   header.version = LOG_INDEX_VERSION;
+
+   /* A file whose scan was stopped is only kept once complete */
+   for (file = state->files; file != NULL; file = file->next)
+   {
+      if (file->compressed && file->offset > 0 && file->stream == NULL)
+      {
+         header.entries++;
+      }
+   }
+
+   /* Several processes may write the index, so each writes its own file and renames it */
+   snprintf(path, sizeof(path), "%s.%d.tmp", state->index, (int)getpid());
+
+   fp = fopen(path, "wb");
+   if (fp == NULL)
+   {
+      return;
+   }
+
+   ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+
+   for (file = state->files; ok && file != NULL; file = file->next)
+   {
+      if (!file->compressed || file->offset == 0 || file->stream != NULL)
+      {
+         continue;
+      }
+
+      memset(&entry, 0, sizeof(entry));
+      entry.device = file->device;
+      entry.inode = file->inode;
+      entry.size = file->size;
+      entry.mtime = file->mtime;
+      entry.offset = file->offset;
+      entry.counts = file->counts;
+      entry.errors = file->errors != NULL ? pgexporter_ext_topk_errors(file->errors, errors) : 0;
+      entry.labeled = file->labeled;
+      entry.labels = file->labels != NULL ? file->labels->size : 0;
+      entry.durations = file->durations != NULL;
+      entry.matches = file->matches != NULL && state->patterns != NULL ? state->patterns->size : 0;
+      entry.patterns = state->patterns_hash;
+      entry.marks = file->marks != NULL ? file->marks->size : 0;
+
+      ok = fwrite(&entry, sizeof(entry), 1, fp) == 1;
+
+      if (ok && entry.errors > 0)
+      {
+         ok = fwrite(errors, sizeof(struct log_error), entry.errors, fp) == entry.errors;
+      }
+
+      for (int i = 0; ok && entry.labels > 0 && i < file->labels->capacity; i++)
+      {
+         if (file->labels->entries[i].hash != 0)
+         {
+            ok = fwrite(&file->labels->entries[i], sizeof(struct log_label), 1, fp) == 1;
+         }
+      }
+
+      if (ok && entry.durations)
+      {
+         ok = fwrite(file->durations, sizeof(struct log_histogram), 1, fp) == 1;
+      }
+
+      if (ok && entry.matches > 0)
+      {
+         ok = fwrite(file->matches, sizeof(uint64_t), entry.matches, fp) == entry.matches;
+      }
+
+      if (ok && entry.marks > 0)
+      {
+         ok = fwrite(file->marks->entries, sizeof(struct log_mark), entry.marks, fp) == entry.marks;
+      }
+   }
+
+   ok = ok && fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+
+   if (fclose(fp) != 0 || !ok || rename(path, state->index) != 0)
+   {
+      unlink(path);
+      return;
+   }
+
+   state->index_dirty = false;
+}
+
+static int
+scan_file(struct log_pool* pool, const char* path, struct log_file* file, char* buffer)
+{
+   const struct log_decoder* decoder;
+   int ret;
+
+   decoder = pgexporter_ext_log_decoder(path);
+   if (decoder != NULL)
+   {
+      ret = process_compressed_log_file(pool, path, decoder, file, buffer);
+   }
+   else
+   {
+      ret = process_log_file(pool, path, file, buffer);
+   }
+
+   /* A compressed file is complete, so its last line has ended too */
+   if (ret == 0 && file->compressed)
+   {
+      finish_file(file);
+   }
+
+   return ret;
+}
+
+static bool
+spend(struct log_pool* pool, size_t length)
+{
+   int64_t bytes;
+
+   if (pool == NULL)
+   {
+      return false;
+   }
+
+   bytes = atomic_fetch_add(&pool->bytes, length) + length;
+
+   if (atomic_load(&pool->stopped))
+   {
+      return true;
+   }
+
+   if ((pool->max_bytes > 0 && bytes >= pool->max_bytes) ||
+       (pool->deadline > 0 && now_ms() >= pool->deadline) ||
+       (pool->interrupted != NULL && pool->interrupted()))
+   {
+      atomic_store(&pool->stopped, true);
+      return true;
+   }
+
+   return false;
+}
+
+static int64_t
+now_ms(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int
+process_log_file(struct log_pool* pool, const char* file_path, struct log_file* file, char* buffer)
+{
+   int fd;
+   int ret;
+   off_t start;
+   ssize_t length;
+   struct stat st;
+
+   fd = open(file_path, O_RDONLY);
+   if (fd == -1)
+   {
+      goto error;
+   }
+
+   if (fstat(fd, &st) == -1)
+   {
+      close(fd);
+      goto error;
+   }
+
+   start = file->offset;
+
+   /* Scan the file in place, and only fall back to read() if it can't be mapped */
+   if (st.st_size > file->offset && (ret = map_log_file(pool, fd, st.st_size, file)) != 1)
+   {
+      release_pages(fd, start, file->offset);
+      close(fd);
+
+      /* A file truncated during the scan is scanned again from its start */
+      return ret == LOG_SCAN_TRUNCATED ? 1 : ret;
+   }
+
+   if (file->offset > 0 && lseek(fd, file->offset, SEEK_SET) != file->offset)
+   {
+      close(fd);
+      goto error;
+   }
+
+   while ((length = read(fd, buffer, LOG_BLOCK_SIZE)) > 0)
+   {
+      pgexporter_ext_log_scan_block(file, buffer, length);
+      file->offset += length;
+
+      if (spend(pool, length))
+      {
+         break;
+      }
+   }
+
+   release_pages(fd, start, file->offset);
+   close(fd);
+
+   if (length < 0)
+   {
+      goto error;
+   }
+
+   return length > 0 ? LOG_SCAN_STOPPED : 0;
+
+error:
+
+   return 1;
+}
+
+static int
+map_log_file(struct log_pool* pool, int fd, off_t size, struct log_file* file)
+{
+   long page_size;
+   off_t base;
+   size_t skip;
+   size_t length;
+   char* volatile map = NULL;
+   volatile size_t mapped = 0;
+   sigjmp_buf guard;
+   sigset_t bus;
+   sigset_t old;
+   int ret = 0;
+
+   page_size = sysconf(_SC_PAGESIZE);
+   if (page_size <= 0 || pthread_once(&map_guard_once, install_map_guard) != 0)
+   {
+      return 1;
+   }
+
+   /* A page past the end of a file truncated after fstat(), f.ex. by
+    * log_truncate_on_rotation or copytruncate, raises SIGBUS, which the
+    * scanning threads would otherwise have blocked, killing the server */
+   sigemptyset(&bus);
+   sigaddset(&bus, SIGBUS);
+   pthread_sigmask(SIG_UNBLOCK, &bus, &old);
+
+   if (sigsetjmp(guard, 1) != 0)
+   {
+      map_guard = NULL;
+      munmap(map, mapped);
+      ret = LOG_SCAN_TRUNCATED;
+      goto done;
+   }
+
+   /* Map LOG_MAP_SIZE windows so a large file doesn't need a large address range,
+    * and only up to the size seen by fstat() since PostgreSQL may still be appending */
+   while (file->offset < size)
+   {
+      base = file->offset - (file->offset % page_size);
+      skip = file->offset - base;
+      length = size - base;
+      if (length > LOG_MAP_SIZE)
+      {
+         length = LOG_MAP_SIZE;
+      }
+
+      map = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, base);
+      if (map == MAP_FAILED)
+      {
+         /* Nothing of the window was scanned, so read() takes over */
+         ret = 1;
+         goto done;
+      }
+      mapped = length;
+
+      madvise(map, length, MADV_SEQUENTIAL);
+
+      map_guard = &guard;
+      pgexporter_ext_log_scan_block(file, map + skip, length - skip);
+      map_guard = NULL;
+
+      file->offset += length - skip;
+
+      munmap(map, length);
+
+      if (spend(pool, length - skip) && file->offset < size)
+      {
+         ret = LOG_SCAN_STOPPED;
+         goto done;
+      }
+   }
+
+done:
+
+   pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+   return ret;
+}
+
+static void
+install_map_guard(void)
+{
+   struct sigaction action;
+
+   memset(&action, 0, sizeof(struct sigaction));
+   action.sa_handler = map_fault;
+   sigemptyset(&action.sa_mask);
+
+   sigaction(SIGBUS, &action, &map_fault_default);
+}
+
+static void
+map_fault(int signo)
+{
+   if (map_guard != NULL)
+   {
+      siglongjmp(*map_guard, 1);
+   }
+
+   /* Not a fault of a scan, so the faulting access runs again with the previous handler */
+   sigaction(SIGBUS, &map_fault_default, NULL);
+}
+
+static void
+release_pages(int fd, off_t start, off_t end)
+{
+   /* The log pages are read once per scrape, so keep them from pushing
+    * the database's own pages out of the page cache */
+   if (end > start)
+   {
+      posix_fadvise(fd, start, end - start, POSIX_FADV_DONTNEED);
+   }
+}
+
+static int
+process_compressed_log_file(struct log_pool* pool, const char* file_path, const struct log_decoder* decoder, struct log_file* file, char* buffer)
+{
+   struct log_stream* stream = file->stream;
+   ssize_t length;
+
+   file->stream = NULL;
+
+   /* A stream kept by a stopped scan continues with its own input */
+   if (stream == NULL)
+   {
+      stream = (struct log_stream*)malloc(sizeof(struct log_stream));
+      if (stream == NULL)
+      {
+         goto error;
+      }
+
+      memset(stream, 0, sizeof(struct log_stream));
+      stream->decoder = decoder;
+
+      stream->input = (char*)malloc(LOG_BLOCK_SIZE);
+      if (stream->input == NULL || decoder->open(stream, file_path))
+      {
+         goto error;
+      }
+   }
+
+   while ((length = decoder->read(stream, buffer, LOG_BLOCK_SIZE)) > 0)
+   {
+      file->frame_input = stream->frame_input;
+      file->frame_output = stream->frame_output;
+
+      pgexporter_ext_log_scan_block(file, buffer, length);
+      file->offset += length;
+
+      if (spend(pool, length))
+      {
+         file->stream = stream;
+         return LOG_SCAN_STOPPED;
+      }
+   }
+
+   close_stream(stream);
+
+   if (length < 0)
+   {
+      goto error;
+   }
+
+   return 0;
+
+error:
+
+   close_stream(stream);
+
+   return 1;
+}
+
+static void
+close_stream(struct log_stream* stream)
+{
+   if (stream == NULL)
+   {
+      return;
+   }
+
+   stream->decoder->close(stream);
+   free(stream->input);
+   free(stream);
+}
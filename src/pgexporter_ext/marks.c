@@ -0,0 +1,538 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgexporter */
+#include <pgexporter_ext.h>
+#include <logs.h>
+#include <marks.h>
+#include <stream.h>
+
+/* system */
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static bool entry_time(int format, const char* line, const char* end, int64_t* time);
+static bool parse_time(const char* p, const char* end, int64_t* time);
+static int count_segment(const char* path, struct log_file* file, struct log_mark* mark, int64_t end, struct log_range* range, char* buffer);
+
+struct log_marks*
+pgexporter_ext_log_marks_create(int capacity)
+{
+   struct log_marks* marks;
+
+   marks = (struct log_marks*)malloc(sizeof(struct log_marks));
+   if (marks == NULL)
+   {
+      return NULL;
+   }
+
+   memset(marks, 0, sizeof(struct log_marks));
+
+   marks->entries = (struct log_mark*)malloc(capacity * sizeof(struct log_mark));
+   if (marks->entries == NULL)
+   {
+      free(marks);
+      return NULL;
+   }
+
+   marks->capacity = capacity;
+
+   return marks;
+}
+
+void
+pgexporter_ext_log_marks_destroy(struct log_marks* marks)
+{
+   if (marks == NULL)
+   {
+      return;
+   }
+
+   free(marks->entries);
+   free(marks);
+}
+
+const char*
+pgexporter_ext_log_marks_find(struct log_file* file, const char* buffer, const char* p, const char* end, int64_t* time)
+{
+   const char* q;
+   const char* nl;
+   int tries;
+
+   if (file->next_mark - file->offset >= end - buffer)
+   {
+      return NULL;
+   }
+
+   q = buffer + (file->next_mark > file->offset ? file->next_mark - file->offset : 0);
+   if (q < p)
+   {
+      q = p;
+   }
+
+   /* A mark is placed at the start of a line */
+   if (q == buffer ? file->midline : *(q - 1) != '\n')
+   {
+      nl = memchr(q, '\n', end - q);
+      if (nl == NULL)
+      {
+         return NULL;
+      }
+
+      q = nl + 1;
+   }
+
+   /* A segment counting a range needs the time of every entry, while a file
+    * without times in its lines shouldn't be searched line by line */
+   tries = file->marks != NULL && file->marks->range != NULL ? INT_MAX : LOG_MARK_TRIES;
+
+   while (q < end && tries-- > 0)
+   {
+      if (entry_time(file->format, q, end, time))
+      {
+         return q;
+      }
+
+      nl = memchr(q, '\n', end - q);
+      if (nl == NULL)
+      {
+         break;
+      }
+
+      q = nl + 1;
+   }
+
+   return NULL;
+}
+
+void
+pgexporter_ext_log_marks_add(struct log_file* file, int64_t offset, int64_t time)
+{
+   struct log_marks* marks = file->marks;
+   struct log_range* range = marks != NULL ? marks->range : NULL;
+   struct log_mark* entries;
+   struct log_mark* mark;
+   int capacity;
+
+   if (range != NULL)
+   {
+      if (!range->started && time >= range->from)
+      {
+         range->before = file->counts;
+         range->started = true;
+      }
+
+      if (!range->ended && time >= range->to)
+      {
+         range->until = file->counts;
+         range->ended = true;
+      }
+
+      file->next_mark = offset + 1;
+      return;
+   }
+
+   file->next_mark = offset + LOG_MARK_INTERVAL;
+
+   if (marks == NULL)
+   {
+      marks = pgexporter_ext_log_marks_create(16);
+      if (marks == NULL)
+      {
+         return;
+      }
+
+      file->marks = marks;
+   }
+
+   if (marks->size == marks->capacity)
+   {
+      if (marks->capacity == LOG_MARKS_MAX)
+      {
+         return;
+      }
+
+      capacity = marks->capacity * 2;
+      entries = (struct log_mark*)realloc(marks->entries, capacity * sizeof(struct log_mark));
+      if (entries == NULL)
+      {
+         return;
+      }
+
+      marks->entries = entries;
+      marks->capacity = capacity;
+   }
+
+   mark = &marks->entries[marks->size++];
+   mark->time = time;
+   mark->offset = offset;
+   mark->counts = file->counts;
+
+   /* A compressed file can only be decoded from the start of a frame */
+   if (file->compressed)
+   {
+      mark->input = file->frame_input;
+      mark->frame = file->frame_output;
+   }
+   else
+   {
+      mark->input = offset;
+      mark->frame = offset;
+   }
+}
+
+int
+pgexporter_ext_log_marks_count(const char* path, struct log_file* file, int64_t from, int64_t to, struct log_counts* counts, char* buffer)
+{
+   struct log_marks* marks = file->marks;
+   struct log_mark* mark;
+   struct log_mark* next;
+   struct log_counts* end;
+   struct log_range range;
+   struct log_counts total;
+
+   memset(&total, 0, sizeof(struct log_counts));
+
+   for (int i = 0; i < marks->size; i++)
+   {
+      mark = &marks->entries[i];
+      next = i + 1 < marks->size ? &marks->entries[i + 1] : NULL;
+      end = next != NULL ? &next->counts : &file->counts;
+
+      /* The entries of a segment are timed between its mark and the next one */
+      if (mark->time >= to)
+      {
+         break;
+      }
+
+      if (next != NULL && next->time < from)
+      {
+         continue;
+      }
+
+      if (mark->time >= from && next != NULL && next->time < to)
+      {
+         for (int j = 0; j < NUMBER_OF_SEVERITIES; j++)
+         {
+            total.count[j] += end->count[j] - mark->counts.count[j];
+         }
+
+         continue;
+      }
+
+      /* The segment holds the start or the end of the range */
+      memset(&range, 0, sizeof(struct log_range));
+      range.from = from;
+      range.to = to;
+
+      if (count_segment(path, file, mark, next != NULL ? next->offset : file->offset, &range, buffer))
+      {
+         goto error;
+      }
+
+      for (int j = 0; j < NUMBER_OF_SEVERITIES; j++)
+      {
+         total.count[j] += range.until.count[j] - range.before.count[j];
+      }
+   }
+
+   for (int i = 0; i < NUMBER_OF_SEVERITIES; i++)
+   {
+      counts->count[i] += total.count[i];
+   }
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+static bool
+entry_time(int format, const char* line, const char* end, int64_t* time)
+{
+   static const char key[] = "\"timestamp\":\"";
+   const char* nl;
+   const char* message;
+   const char* p;
+
+   if (format == LOG_FORMAT_CSV)
+   {
+      /* log_time is the first field of a record */
+      return parse_time(line, end, time);
+   }
+
+   if (format == LOG_FORMAT_JSON)
+   {
+      nl = memchr(line, '\n', end - line);
+      p = memmem(line, (nl != NULL ? nl : end) - line, key, sizeof(key) - 1);
+
+      return p != NULL && parse_time(p + sizeof(key) - 1, end, time);
+   }
+
+   /* The time is written by the %t or %m escape of log_line_prefix */
+   if (pgexporter_ext_log_classify_message(line, end - line, &message) < 0)
+   {
+      return false;
+   }
+
+   for (p = line; p + 19 <= message; p++)
+   {
+      if (p[4] == '-' && parse_time(p, message, time))
+      {
+         return true;
+      }
+   }
+
+   return false;
+}
+
+static bool
+parse_time(const char* p, const char* end, int64_t* time)
+{
+   static const char layout[] = "0000-00-00 00:00:00";
+   int64_t days;
+   int year;
+   int month;
+   int day;
+   int era;
+   int yoe;
+   int doy;
+   int millis = 0;
+   int scale = 100;
+
+   if (end - p < 19)
+   {
+      return false;
+   }
+
+   for (int i = 0; i < 19; i++)
+   {
+      if (layout[i] == '0' ? p[i] < '0' || p[i] > '9' : p[i] != layout[i])
+      {
+         return false;
+      }
+   }
+
+   year = (p[0] - '0') * 1000 + (p[1] - '0') * 100 + (p[2] - '0') * 10 + (p[3] - '0');
+   month = (p[5] - '0') * 10 + (p[6] - '0');
+   day = (p[8] - '0') * 10 + (p[9] - '0');
+
+   if (month < 1 || month > 12 || day < 1 || day > 31)
+   {
+      return false;
+   }
+
+   /* %m has milliseconds */
+   if (end - p > 20 && p[19] == '.')
+   {
+      for (const char* q = p + 20; q < end && q < p + 23 && *q >= '0' && *q <= '9'; q++)
+      {
+         millis += (*q - '0') * scale;
+         scale /= 10;
+      }
+   }
+
+   /* The days since the epoch of the civil date, so the time zone of the process doesn't matter */
+   year -= month <= 2;
+   era = year / 400;
+   yoe = year - era * 400;
+   doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+   days = (int64_t)era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
+
+   *time = (((days * 24 + (p[11] - '0') * 10 + (p[12] - '0')) * 60 +
+             (p[14] - '0') * 10 + (p[15] - '0')) * 60 +
+            (p[17] - '0') * 10 + (p[18] - '0')) * 1000 + millis;
+
+   return true;
+}
+
+static int
+count_segment(const char* path, struct log_file* file, struct log_mark* mark, int64_t end, struct log_range* range, char* buffer)
+{
+   const struct log_decoder* decoder = NULL;
+   struct log_stream stream;
+   struct log_file* segment = NULL;
+   struct log_marks marks;
+   int fd = -1;
+   int64_t position;
+   int64_t skip;
+   ssize_t length;
+   size_t carry = 0;
+   size_t n;
+   char* last;
+
+   memset(&stream, 0, sizeof(struct log_stream));
+   stream.input = buffer + LOG_BLOCK_SIZE;
+
+   /* A segment only follows the range, it doesn't place marks */
+   memset(&marks, 0, sizeof(struct log_marks));
+   marks.range = range;
+
+   segment = (struct log_file*)malloc(sizeof(struct log_file));
+   if (segment == NULL)
+   {
+      goto error;
+   }
+
+   memset(segment, 0, sizeof(struct log_file));
+   segment->format = file->format;
+   segment->compressed = file->compressed;
+   segment->offset = mark->offset;
+   segment->next_mark = mark->offset;
+   segment->marks = &marks;
+
+   if (file->compressed)
+   {
+      decoder = pgexporter_ext_log_decoder(path);
+   }
+
+   if (decoder != NULL)
+   {
+      if (decoder->open(&stream, path) ||
+          (mark->input > 0 && pgexporter_ext_log_stream_seek(&stream, mark->input, mark->frame)))
+      {
+         decoder->close(&stream);
+         decoder = NULL;
+         goto error;
+      }
+
+      /* From the start of the frame to the mark */
+      for (skip = mark->offset - mark->frame; skip > 0; skip -= length)
+      {
+         length = decoder->read(&stream, buffer, skip < LOG_BLOCK_SIZE ? skip : LOG_BLOCK_SIZE);
+         if (length <= 0)
+         {
+            goto error;
+         }
+      }
+   }
+   else
+   {
+      fd = open(path, O_RDONLY);
+      if (fd == -1)
+      {
+         goto error;
+      }
+   }
+
+   position = mark->offset;
+
+   while (position < end && !range->ended)
+   {
+      n = LOG_BLOCK_SIZE - carry;
+      if ((int64_t)n > end - position)
+      {
+         n = end - position;
+      }
+
+      if (decoder != NULL)
+      {
+         length = decoder->read(&stream, buffer + carry, n);
+      }
+      else
+      {
+         length = pread(fd, buffer + carry, n, position);
+      }
+
+      if (length <= 0)
+      {
+         goto error;
+      }
+
+      position += length;
+      length += carry;
+
+      /* Only complete lines, so the time of every entry is seen */
+      last = position < end ? memrchr(buffer, '\n', length) : NULL;
+      n = last != NULL ? (size_t)(last + 1 - buffer) : (size_t)length;
+
+      pgexporter_ext_log_scan_block(segment, buffer, n);
+      segment->offset += n;
+
+      carry = length - n;
+      memmove(buffer, buffer + n, carry);
+   }
+
+   /* A compressed file is complete, so its last line has ended too */
+   if (file->compressed && position == file->offset && !range->ended)
+   {
+      pgexporter_ext_log_finish_file(segment);
+   }
+
+   if (!range->started)
+   {
+      range->before = segment->counts;
+   }
+
+   if (!range->ended)
+   {
+      range->until = segment->counts;
+   }
+
+   if (decoder != NULL)
+   {
+      decoder->close(&stream);
+   }
+
+   if (fd != -1)
+   {
+      close(fd);
+   }
+
+   free(segment->errors);
+   free(segment->durations);
+   free(segment);
+
+   return 0;
+
+error:
+
+   if (decoder != NULL)
+   {
+      decoder->close(&stream);
+   }
+
+   if (fd != -1)
+   {
+      close(fd);
+   }
+
+   if (segment != NULL)
+   {
+      free(segment->errors);
+      free(segment->durations);
+   }
+   free(segment);
+
+   return 1;
+}
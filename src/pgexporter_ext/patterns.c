@@ -0,0 +1,407 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgexporter */
+#include <pgexporter_ext.h>
+#include <patterns.h>
+
+/* system */
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+static int add_pattern(struct log_patterns* patterns, const char* name, size_t name_length, const char* text,
+                       size_t text_length);
+static int build(struct log_patterns* patterns);
+static const unsigned char* find_start(const struct log_patterns* patterns, const unsigned char* p, const unsigned char* end);
+
+int
+pgexporter_ext_log_patterns_compile(const char* spec, struct log_patterns** patterns)
+{
+   struct log_patterns* p = NULL;
+   const char* start;
+   const char* end;
+   const char* equal;
+   const char* name_end;
+
+   *patterns = NULL;
+
+   if (spec == NULL)
+   {
+      return 0;
+   }
+
+   p = (struct log_patterns*)malloc(sizeof(struct log_patterns));
+   if (p == NULL)
+   {
+      goto error;
+   }
+
+   memset(p, 0, sizeof(struct log_patterns));
+
+   for (start = spec; *start != '\0'; start = *end == ';' ? end + 1 : end)
+   {
+      end = strchrnul(start, ';');
+
+      while (start < end && isspace((unsigned char)*start))
+      {
+         start++;
+      }
+
+      if (start == end)
+      {
+         continue;
+      }
+
+      equal = memchr(start, '=', end - start);
+      if (equal == NULL)
+      {
+         goto error;
+      }
+
+      name_end = equal;
+      while (name_end > start && isspace((unsigned char)*(name_end - 1)))
+      {
+         name_end--;
+      }
+
+      if (add_pattern(p, start, name_end - start, equal + 1, end - equal - 1))
+      {
+         goto error;
+      }
+   }
+
+   if (p->size == 0)
+   {
+      free(p);
+      return 0;
+   }
+
+   if (build(p))
+   {
+      goto error;
+   }
+
+   *patterns = p;
+
+   return 0;
+
+error:
+
+   pgexporter_ext_log_patterns_destroy(p);
+
+   return 1;
+}
+
+void
+pgexporter_ext_log_patterns_destroy(struct log_patterns* patterns)
+{
+   if (patterns == NULL)
+   {
+      return;
+   }
+
+   free(patterns->transitions);
+   free(patterns->outputs);
+   free(patterns);
+}
+
+int
+pgexporter_ext_log_patterns_feed(const struct log_patterns* patterns, int state, const char* data, size_t length,
+                                 uint64_t* found)
+{
+   const uint32_t* transitions = patterns->transitions;
+   const unsigned char* byte_classes = patterns->byte_classes;
+   const unsigned char* p = (const unsigned char*)data;
+   const unsigned char* end = p + length;
+   uint32_t row = (uint32_t)state;
+   uint32_t next;
+
+   while (p < end)
+   {
+      /* Most bytes don't start a pattern, and those don't need the lookups */
+      if (row == 0)
+      {
+         p = find_start(patterns, p, end);
+         if (p == end)
+         {
+            break;
+         }
+      }
+
+      next = transitions[row + byte_classes[*p++]];
+      row = next & ~LOG_PATTERN_FOUND;
+
+      if (next & LOG_PATTERN_FOUND)
+      {
+         *found |= patterns->outputs[row / patterns->classes];
+      }
+   }
+
+   return (int)row;
+}
+
+static int
+add_pattern(struct log_patterns* patterns, const char* name, size_t name_length, const char* text,
+            size_t text_length)
+{
+   if (patterns->size == LOG_PATTERNS_MAX)
+   {
+      return 1;
+   }
+
+   if (name_length == 0 || name_length >= LOG_PATTERN_NAME_SIZE || text_length == 0 || text_length >= LOG_PATTERN_SIZE)
+   {
+      return 1;
+   }
+
+   for (size_t i = 0; i < name_length; i++)
+   {
+      if (!isalnum((unsigned char)name[i]) && name[i] != '_')
+      {
+         return 1;
+      }
+   }
+
+   for (int i = 0; i < patterns->size; i++)
+   {
+      if (strlen(patterns->names[i]) == name_length && memcmp(patterns->names[i], name, name_length) == 0)
+      {
+         return 1;
+      }
+   }
+
+   memcpy(patterns->names[patterns->size], name, name_length);
+   memcpy(patterns->texts[patterns->size], text, text_length);
+   patterns->size++;
+
+   return 0;
+}
+
+static int
+build(struct log_patterns* patterns)
+{
+   const unsigned char* text;
+   uint32_t* transitions;
+   uint64_t* outputs;
+   int* fail = NULL;
+   int* queue = NULL;
+   int head = 0;
+   int tail = 0;
+   int capacity = 1;
+   int classes;
+   int state;
+   int next;
+
+   /* Only the bytes of the patterns need their own column */
+   patterns->classes = 1;
+   for (int i = 0; i < patterns->size; i++)
+   {
+      for (text = (const unsigned char*)patterns->texts[i]; *text != '\0'; text++)
+      {
+         if (patterns->byte_classes[*text] == 0)
+         {
+            patterns->byte_classes[*text] = patterns->classes++;
+         }
+      }
+
+      capacity += strlen(patterns->texts[i]);
+   }
+
+   classes = patterns->classes;
+
+   patterns->transitions = (uint32_t*)calloc((size_t)capacity * classes, sizeof(uint32_t));
+   patterns->outputs = (uint64_t*)calloc(capacity, sizeof(uint64_t));
+   fail = (int*)calloc(capacity, sizeof(int));
+   queue = (int*)malloc(capacity * sizeof(int));
+
+   if (patterns->transitions == NULL || patterns->outputs == NULL || fail == NULL || queue == NULL)
+   {
+      goto error;
+   }
+
+   transitions = patterns->transitions;
+   outputs = patterns->outputs;
+
+   /* The trie of the patterns */
+   patterns->states = 1;
+   for (int i = 0; i < patterns->size; i++)
+   {
+      state = 0;
+      for (text = (const unsigned char*)patterns->texts[i]; *text != '\0'; text++)
+      {
+         next = transitions[state * classes + patterns->byte_classes[*text]];
+         if (next == 0)
+         {
+            next = patterns->states++;
+            transitions[state * classes + patterns->byte_classes[*text]] = next;
+         }
+         state = next;
+      }
+
+      outputs[state] |= 1ULL << i;
+   }
+
+   /* Breadth first, each missing transition is the one of the longest proper suffix,
+    * which is complete already, so no failure links are followed while matching */
+   for (int c = 0; c < classes; c++)
+   {
+      if (transitions[c] != 0)
+      {
+         queue[tail++] = transitions[c];
+      }
+   }
+
+   while (head < tail)
+   {
+      state = queue[head++];
+
+      for (int c = 0; c < classes; c++)
+      {
+         next = transitions[state * classes + c];
+         if (next != 0)
+         {
+            fail[next] = transitions[fail[state] * classes + c];
+            outputs[next] |= outputs[fail[next]];
+            queue[tail++] = next;
+         }
+         else
+         {
+            transitions[state * classes + c] = transitions[fail[state] * classes + c];
+         }
+      }
+   }
+
+   for (int b = 0; b < 256; b++)
+   {
+      patterns->starts[b] = patterns->byte_classes[b] != 0 && transitions[patterns->byte_classes[b]] != 0;
+   }
+
+   /* A match can only start where the first two bytes of a pattern are */
+   for (int i = 0; i < patterns->size; i++)
+   {
+      text = (const unsigned char*)patterns->texts[i];
+      if (text[1] == '\0' || patterns->pairs > LOG_PATTERN_PAIRS)
+      {
+         patterns->pairs = LOG_PATTERN_PAIRS + 1;
+         continue;
+      }
+
+      next = 0;
+      while (next < patterns->pairs && (patterns->pair_bytes[next][0] != text[0] || patterns->pair_bytes[next][1] != text[1]))
+      {
+         next++;
+      }
+
+      if (next == patterns->pairs)
+      {
+         if (patterns->pairs < LOG_PATTERN_PAIRS)
+         {
+            patterns->pair_bytes[next][0] = text[0];
+            patterns->pair_bytes[next][1] = text[1];
+         }
+         patterns->pairs++;
+      }
+   }
+
+   if (patterns->pairs > LOG_PATTERN_PAIRS)
+   {
+      patterns->pairs = 0;
+   }
+
+   /* Rows instead of states save a multiplication per byte */
+   for (int i = 0; i < patterns->states * classes; i++)
+   {
+      next = transitions[i];
+      transitions[i] = next * classes | (outputs[next] != 0 ? LOG_PATTERN_FOUND : 0);
+   }
+
+   free(fail);
+   free(queue);
+
+   return 0;
+
+error:
+
+   free(fail);
+   free(queue);
+
+   return 1;
+}
+
+static const unsigned char*
+find_start(const struct log_patterns* patterns, const unsigned char* p, const unsigned char* end)
+{
+#if defined(__x86_64__)
+   __m128i firsts[LOG_PATTERN_PAIRS];
+   __m128i seconds[LOG_PATTERN_PAIRS];
+   __m128i a;
+   __m128i b;
+   __m128i m;
+   unsigned int mask;
+
+   /* With a few pairs 16 positions are checked at a time, using a shifted load for the second byte */
+   if (patterns->pairs > 0)
+   {
+      for (int i = 0; i < patterns->pairs; i++)
+      {
+         firsts[i] = _mm_set1_epi8((char)patterns->pair_bytes[i][0]);
+         seconds[i] = _mm_set1_epi8((char)patterns->pair_bytes[i][1]);
+      }
+
+      while (end - p >= 17)
+      {
+         a = _mm_loadu_si128((const __m128i*)p);
+         b = _mm_loadu_si128((const __m128i*)(p + 1));
+         m = _mm_and_si128(_mm_cmpeq_epi8(a, firsts[0]), _mm_cmpeq_epi8(b, seconds[0]));
+         for (int i = 1; i < patterns->pairs; i++)
+         {
+            m = _mm_or_si128(m, _mm_and_si128(_mm_cmpeq_epi8(a, firsts[i]), _mm_cmpeq_epi8(b, seconds[i])));
+         }
+
+         mask = _mm_movemask_epi8(m);
+         if (mask != 0)
+         {
+            return p + __builtin_ctz(mask);
+         }
+
+         p += 16;
+      }
+   }
+#endif
+
+   while (p < end && !patterns->starts[*p])
+   {
+      p++;
+   }
+
+   return p;
+}
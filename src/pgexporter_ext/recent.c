@@ -0,0 +1,531 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgexporter */
+#include <pgexporter_ext.h>
+#include <logs.h>
+#include <stream.h>
+
+/* system */
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/** @struct log_recent
+ * A search for the most recent errors
+ */
+struct log_recent
+{
+   struct log_entry* entries;    /**< The entries found, newest first */
+   int n;                        /**< The number of entries wanted */
+   int count;                    /**< The number of entries found */
+   size_t bytes;                 /**< The number of bytes read */
+   size_t max_bytes;             /**< The number of bytes after which the search stops */
+   const char* name;             /**< The name of the current file */
+   int format;                   /**< The log format of the current file */
+   char* buffer;                 /**< The block being read followed by the compressed input */
+   char line[LOG_PARTIAL_SIZE];  /**< The start of a line spanning blocks */
+   size_t line_length;           /**< The length of the start of the line */
+};
+
+/** @struct log_recent_file
+ * A log file of a search for the most recent errors
+ */
+struct log_recent_file
+{
+   char name[LOG_FILE_NAME_SIZE]; /**< The name */
+   time_t mtime;                  /**< The modification time */
+};
+
+static int compare_recent_files(const void* a, const void* b);
+static int recent_plain(struct log_recent* recent, const char* path);
+static int recent_compressed(struct log_recent* recent, const char* path, const struct log_decoder* decoder);
+static int recent_severity(int format, const char* line, size_t length);
+static int csv_line_severity(const char* line, size_t length);
+static void prepend_line(struct log_recent* recent, const char* data, size_t length);
+static void append_line(struct log_recent* recent, const char* data, size_t length);
+static void fill_entry(struct log_entry* entry, const char* name, int severity, const char* line, size_t length);
+
+int
+pgexporter_ext_log_recent_errors(const char* directory, int n, size_t max_bytes, struct log_entry* entries, int* count)
+{
+   DIR* dp = NULL;
+   struct dirent* entry;
+   struct stat st;
+   struct log_recent* recent = NULL;
+   struct log_recent_file* files = NULL;
+   struct log_recent_file* grown;
+   const struct log_decoder* decoder;
+   char path[MAX_PATH];
+   int number_of_files = 0;
+   int capacity = 0;
+
+   *count = 0;
+
+   recent = (struct log_recent*)malloc(sizeof(struct log_recent));
+   if (recent == NULL)
+   {
+      goto error;
+   }
+
+   memset(recent, 0, sizeof(struct log_recent));
+   recent->entries = entries;
+   recent->n = n;
+   recent->max_bytes = max_bytes;
+
+   recent->buffer = (char*)malloc(LOG_BUFFER_SIZE);
+   if (recent->buffer == NULL)
+   {
+      goto error;
+   }
+
+   dp = opendir(directory);
+   if (dp == NULL)
+   {
+      goto error;
+   }
+
+   while ((entry = readdir(dp)) != NULL)
+   {
+      if (entry->d_name[0] == '.')
+      {
+         continue;
+      }
+
+      snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+
+      if (stat(path, &st) || !S_ISREG(st.st_mode))
+      {
+         continue;
+      }
+
+      if (number_of_files == capacity)
+      {
+         capacity = capacity == 0 ? 64 : capacity * 2;
+         grown = (struct log_recent_file*)realloc(files, capacity * sizeof(struct log_recent_file));
+         if (grown == NULL)
+         {
+            goto error;
+         }
+         files = grown;
+      }
+
+      snprintf(files[number_of_files].name, LOG_FILE_NAME_SIZE, "%s", entry->d_name);
+      files[number_of_files].mtime = st.st_mtime;
+      number_of_files++;
+   }
+
+   closedir(dp);
+   dp = NULL;
+
+   qsort(files, number_of_files, sizeof(struct log_recent_file), compare_recent_files);
+
+   /* The newest file first, the older ones only while more entries are needed */
+   for (int i = 0; i < number_of_files && recent->count < n && recent->bytes < max_bytes; i++)
+   {
+      snprintf(path, sizeof(path), "%s/%s", directory, files[i].name);
+
+      recent->name = files[i].name;
+      recent->format = pgexporter_ext_log_format(path);
+      recent->line_length = 0;
+
+      decoder = pgexporter_ext_log_decoder(path);
+
+      /* A file may be rotated away while we read, so it is skipped */
+      if (decoder != NULL)
+      {
+         recent_compressed(recent, path, decoder);
+      }
+      else
+      {
+         recent_plain(recent, path);
+      }
+   }
+
+   *count = recent->count;
+
+   free(files);
+   free(recent->buffer);
+   free(recent);
+
+   return 0;
+
+error:
+
+   if (dp != NULL)
+   {
+      closedir(dp);
+   }
+
+   free(files);
+   if (recent != NULL)
+   {
+      free(recent->buffer);
+   }
+   free(recent);
+
+   return 1;
+}
+
+static int
+compare_recent_files(const void* a, const void* b)
+{
+   const struct log_recent_file* fa = (const struct log_recent_file*)a;
+   const struct log_recent_file* fb = (const struct log_recent_file*)b;
+
+   if (fa->mtime != fb->mtime)
+   {
+      return fa->mtime > fb->mtime ? -1 : 1;
+   }
+
+   /* Rotated files written in the same second are named by time */
+   return strcmp(fb->name, fa->name);
+}
+
+static int
+recent_plain(struct log_recent* recent, const char* path)
+{
+   int fd;
+   struct stat st;
+   off_t position;
+   off_t start;
+   ssize_t length;
+   size_t n;
+   size_t done;
+   char* block = recent->buffer;
+   char* end;
+   char* nl;
+   int severity;
+
+   fd = open(path, O_RDONLY);
+   if (fd == -1)
+   {
+      goto error;
+   }
+
+   if (fstat(fd, &st))
+   {
+      goto error;
+   }
+
+   position = st.st_size;
+
+   /* Aligned blocks from the end, so only the blocks holding the entries are read */
+   while (position > 0 && recent->count < recent->n && recent->bytes < recent->max_bytes)
+   {
+      start = ((position - 1) / LOG_BLOCK_SIZE) * LOG_BLOCK_SIZE;
+      n = position - start;
+
+      for (done = 0; done < n; done += length)
+      {
+         length = pread(fd, block + done, n - done, start + done);
+         if (length <= 0)
+         {
+            goto error;
+         }
+      }
+
+      recent->bytes += n;
+      position = start;
+
+      end = block + n;
+      while (recent->count < recent->n && (nl = memrchr(block, '\n', end - block)) != NULL)
+      {
+         /* The line may continue in the block read before */
+         if (recent->line_length > 0)
+         {
+            prepend_line(recent, nl + 1, end - nl - 1);
+            severity = recent_severity(recent->format, recent->line, recent->line_length);
+            if (severity >= 0)
+            {
+               fill_entry(&recent->entries[recent->count++], recent->name, severity, recent->line, recent->line_length);
+            }
+            recent->line_length = 0;
+         }
+         else
+         {
+            severity = recent_severity(recent->format, nl + 1, end - nl - 1);
+            if (severity >= 0)
+            {
+               fill_entry(&recent->entries[recent->count++], recent->name, severity, nl + 1, end - nl - 1);
+            }
+         }
+
+         end = nl;
+      }
+
+      /* The start of the line is in the previous block */
+      prepend_line(recent, block, end - block);
+   }
+
+   /* The first line of the file */
+   if (position == 0 && recent->count < recent->n && recent->line_length > 0)
+   {
+      severity = recent_severity(recent->format, recent->line, recent->line_length);
+      if (severity >= 0)
+      {
+         fill_entry(&recent->entries[recent->count++], recent->name, severity, recent->line, recent->line_length);
+      }
+   }
+
+   close(fd);
+
+   return 0;
+
+error:
+
+   if (fd != -1)
+   {
+      close(fd);
+   }
+
+   return 1;
+}
+
+static int
+recent_compressed(struct log_recent* recent, const char* path, const struct log_decoder* decoder)
+{
+   struct log_stream stream;
+   struct log_entry* ring = NULL;
+   ssize_t length;
+   char* block = recent->buffer;
+   char* p;
+   char* end;
+   char* nl;
+   int capacity;
+   int severity;
+   uint64_t total = 0;
+   int n;
+
+   memset(&stream, 0, sizeof(struct log_stream));
+   stream.input = recent->buffer + LOG_BLOCK_SIZE;
+
+   /* A compressed file is only read forwards, so it keeps its last entries */
+   capacity = recent->n - recent->count;
+   ring = (struct log_entry*)malloc(capacity * sizeof(struct log_entry));
+   if (ring == NULL)
+   {
+      goto error;
+   }
+
+   if (decoder->open(&stream, path))
+   {
+      decoder->close(&stream);
+      goto error;
+   }
+
+   while ((length = decoder->read(&stream, block, LOG_BLOCK_SIZE)) > 0)
+   {
+      recent->bytes += length;
+
+      /* The newest entries of the file are at its end, so a partial read is useless */
+      if (recent->bytes >= recent->max_bytes)
+      {
+         decoder->close(&stream);
+         goto error;
+      }
+
+      p = block;
+      end = block + length;
+      while ((nl = memchr(p, '\n', end - p)) != NULL)
+      {
+         if (recent->line_length > 0)
+         {
+            append_line(recent, p, nl - p);
+            severity = recent_severity(recent->format, recent->line, recent->line_length);
+            if (severity >= 0)
+            {
+               fill_entry(&ring[total++ % capacity], recent->name, severity, recent->line, recent->line_length);
+            }
+            recent->line_length = 0;
+         }
+         else
+         {
+            severity = recent_severity(recent->format, p, nl - p);
+            if (severity >= 0)
+            {
+               fill_entry(&ring[total++ % capacity], recent->name, severity, p, nl - p);
+            }
+         }
+
+         p = nl + 1;
+      }
+
+      append_line(recent, p, end - p);
+   }
+
+   decoder->close(&stream);
+
+   if (length < 0)
+   {
+      goto error;
+   }
+
+   if (recent->line_length > 0)
+   {
+      severity = recent_severity(recent->format, recent->line, recent->line_length);
+      if (severity >= 0)
+      {
+         fill_entry(&ring[total++ % capacity], recent->name, severity, recent->line, recent->line_length);
+      }
+   }
+
+   n = total < (uint64_t)capacity ? (int)total : capacity;
+   for (int i = 0; i < n; i++)
+   {
+      recent->entries[recent->count++] = ring[(total - 1 - i) % capacity];
+   }
+
+   free(ring);
+
+   return 0;
+
+error:
+
+   free(ring);
+
+   return 1;
+}
+
+static int
+recent_severity(int format, const char* line, size_t length)
+{
+   int severity;
+
+   if (length == 0)
+   {
+      return -1;
+   }
+
+   if (format == LOG_FORMAT_JSON)
+   {
+      severity = pgexporter_ext_log_classify_json(line, length);
+   }
+   else if (format == LOG_FORMAT_CSV)
+   {
+      severity = csv_line_severity(line, length);
+   }
+   else
+   {
+      severity = pgexporter_ext_log_classify(line, length);
+   }
+
+   if (severity != SEVERITY_ERROR && severity != SEVERITY_FATAL && severity != SEVERITY_PANIC)
+   {
+      return -1;
+   }
+
+   return severity;
+}
+
+static int
+csv_line_severity(const char* line, size_t length)
+{
+   const char* end = line + length;
+   const char* token = NULL;
+   int field = 0;
+   bool quoted = false;
+
+   /* Only the first line of a record starts with its timestamp */
+   if (*line < '0' || *line > '9')
+   {
+      return -1;
+   }
+
+   for (const char* p = line; p < end; p++)
+   {
+      if (*p == '"')
+      {
+         quoted = !quoted;
+      }
+      else if (*p == ',' && !quoted)
+      {
+         field++;
+
+         if (field == CSV_SEVERITY_FIELD)
+         {
+            token = p + 1;
+         }
+         else if (field == CSV_SEVERITY_FIELD + 1)
+         {
+            return pgexporter_ext_log_severity(token, p - token);
+         }
+      }
+   }
+
+   return -1;
+}
+
+static void
+prepend_line(struct log_recent* recent, const char* data, size_t length)
+{
+   size_t keep;
+   size_t kept;
+
+   /* Only the start of a line is kept */
+   keep = length < LOG_PARTIAL_SIZE ? length : LOG_PARTIAL_SIZE;
+   kept = recent->line_length < LOG_PARTIAL_SIZE - keep ? recent->line_length : LOG_PARTIAL_SIZE - keep;
+
+   memmove(recent->line + keep, recent->line, kept);
+   memcpy(recent->line, data, keep);
+   recent->line_length = keep + kept;
+}
+
+static void
+append_line(struct log_recent* recent, const char* data, size_t length)
+{
+   size_t n;
+
+   n = LOG_PARTIAL_SIZE - recent->line_length;
+   if (n > length)
+   {
+      n = length;
+   }
+
+   memcpy(recent->line + recent->line_length, data, n);
+   recent->line_length += n;
+}
+
+static void
+fill_entry(struct log_entry* entry, const char* name, int severity, const char* line, size_t length)
+{
+   if (length > LOG_ENTRY_SIZE - 1)
+   {
+      length = LOG_ENTRY_SIZE - 1;
+   }
+
+   entry->severity = severity;
+   snprintf(entry->file, sizeof(entry->file), "%s", name);
+   memcpy(entry->line, line, length);
+   entry->line[length] = '\0';
+}
@@ -0,0 +1,414 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgexporter */
+#include <pgexporter_ext.h>
+#include <disk.h>
+#include <logs.h>
+#include <shmem.h>
+
+/* PostgreSQL */
+#include "postgres.h"
+#include "miscadmin.h"
+#include "port/atomics.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/elog.h"
+
+/* system */
+#include <string.h>
+#include <time.h>
+
+/* A slot of the per-minute ring holds the minute in the upper 32 bits
+ * and the count in the lower 32 bits, so it can be moved to a new minute
+ * with a single compare-and-swap and without a lock in the log hook */
+#define SLOT_MINUTE(v) ((uint32_t)((v) >> 32))
+#define SLOT_COUNT(v)  ((uint32_t)((v) & 0xFFFFFFFF))
+
+typedef struct
+{
+   pg_atomic_uint64 emitted[NUMBER_OF_SEVERITIES];
+   LWLock* lock;
+   LogCacheEntry cache[NUMBER_OF_SEVERITIES];
+   pg_atomic_uint64 minutes[LOG_RATE_MINUTES][NUMBER_OF_SEVERITIES];
+   time_t started;
+   int number_of_directories;
+   struct disk_directory_usage directories[DISK_CACHE_DIRECTORIES];
+} PgexporterExtShmem;
+
+static Size shmem_size(void);
+static void shmem_startup(void);
+#if PG_VERSION_NUM >= 150000
+static void shmem_request(void);
+#endif
+static void log_hook(ErrorData* edata);
+static int severity_from_elevel(int elevel);
+static void count_minute(int severity);
+
+static PgexporterExtShmem* shmem = NULL;
+
+#if PG_VERSION_NUM >= 150000
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+#endif
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static emit_log_hook_type prev_emit_log_hook = NULL;
+
+void
+pgexporter_ext_shmem_init(void)
+{
+#if PG_VERSION_NUM >= 150000
+   prev_shmem_request_hook = shmem_request_hook;
+   shmem_request_hook = shmem_request;
+#else
+   RequestAddinShmemSpace(shmem_size());
+   RequestNamedLWLockTranche("pgexporter_ext", 1);
+#endif
+
+   prev_shmem_startup_hook = shmem_startup_hook;
+   shmem_startup_hook = shmem_startup;
+
+   prev_emit_log_hook = emit_log_hook;
+   emit_log_hook = log_hook;
+}
+
+bool
+pgexporter_ext_shmem_available(void)
+{
+   return shmem != NULL;
+}
+
+uint64_t
+pgexporter_ext_shmem_log_count(int severity)
+{
+   if (shmem == NULL || severity < 0 || severity >= NUMBER_OF_SEVERITIES)
+   {
+      return 0;
+   }
+
+   return pg_atomic_read_u64(&shmem->emitted[severity]);
+}
+
+bool
+pgexporter_ext_shmem_log_window(int minutes, struct log_counts* counts, time_t* started)
+{
+   uint32_t now;
+   uint32_t minute;
+   uint64_t v;
+
+   memset(counts, 0, sizeof(struct log_counts));
+
+   if (shmem == NULL)
+   {
+      return false;
+   }
+
+   if (minutes > LOG_RATE_MINUTES)
+   {
+      minutes = LOG_RATE_MINUTES;
+   }
+
+   *started = shmem->started;
+   now = (uint32_t)(time(NULL) / 60);
+
+   for (int m = 0; m < minutes; m++)
+   {
+      minute = now - m;
+
+      for (int i = 0; i < NUMBER_OF_SEVERITIES; i++)
+      {
+         /* A slot that wasn't used since it wrapped belongs to an older minute */
+         v = pg_atomic_read_u64(&shmem->minutes[minute % LOG_RATE_MINUTES][i]);
+         if (SLOT_MINUTE(v) == minute)
+         {
+            counts->count[i] += SLOT_COUNT(v);
+         }
+      }
+   }
+
+   return true;
+}
+
+bool
+pgexporter_ext_shmem_log_cache(LogCacheEntry* entries)
+{
+   if (shmem == NULL)
+   {
+      return false;
+   }
+
+   LWLockAcquire(shmem->lock, LW_SHARED);
+   memcpy(entries, shmem->cache, sizeof(shmem->cache));
+   LWLockRelease(shmem->lock);
+
+   return entries[0].last_updated != 0;
+}
+
+void
+pgexporter_ext_shmem_log_cache_update(struct log_counts* counts)
+{
+   time_t now = time(NULL);
+
+   if (shmem == NULL)
+   {
+      return;
+   }
+
+   LWLockAcquire(shmem->lock, LW_EXCLUSIVE);
+
+   for (int i = 0; i < NUMBER_OF_SEVERITIES; i++)
+   {
+      shmem->cache[i].count = (int64_t)counts->count[i];
+      shmem->cache[i].last_updated = now;
+   }
+
+   LWLockRelease(shmem->lock);
+}
+
+void
+pgexporter_ext_shmem_log_cache_clear(void)
+{
+   if (shmem == NULL)
+   {
+      return;
+   }
+
+   LWLockAcquire(shmem->lock, LW_EXCLUSIVE);
+
+   for (int i = 0; i < NUMBER_OF_SEVERITIES; i++)
+   {
+      shmem->cache[i].count = 0;
+      shmem->cache[i].last_updated = 0;
+   }
+
+   LWLockRelease(shmem->lock);
+}
+
+bool
+pgexporter_ext_shmem_disk_usage(const char* path, struct disk_usage* usage)
+{
+   uint64_t hash;
+   int low = 0;
+   int high;
+   int middle;
+   bool found = false;
+
+   if (shmem == NULL)
+   {
+      return false;
+   }
+
+   hash = pgexporter_ext_disk_path_hash(path);
+
+   LWLockAcquire(shmem->lock, LW_SHARED);
+
+   high = shmem->number_of_directories - 1;
+   while (low <= high)
+   {
+      middle = low + (high - low) / 2;
+
+      if (shmem->directories[middle].hash == hash)
+      {
+         *usage = shmem->directories[middle].usage;
+         found = true;
+         break;
+      }
+      else if (shmem->directories[middle].hash < hash)
+      {
+         low = middle + 1;
+      }
+      else
+      {
+         high = middle - 1;
+      }
+   }
+
+   LWLockRelease(shmem->lock);
+
+   return found;
+}
+
+void
+pgexporter_ext_shmem_disk_cache_update(struct disk_directory_usage* directories, int number_of_directories)
+{
+   if (shmem == NULL)
+   {
+      return;
+   }
+
+   if (number_of_directories > DISK_CACHE_DIRECTORIES)
+   {
+      number_of_directories = DISK_CACHE_DIRECTORIES;
+   }
+
+   LWLockAcquire(shmem->lock, LW_EXCLUSIVE);
+
+   memcpy(shmem->directories, directories, number_of_directories * sizeof(struct disk_directory_usage));
+   shmem->number_of_directories = number_of_directories;
+
+   LWLockRelease(shmem->lock);
+}
+
+static Size
+shmem_size(void)
+{
+   return MAXALIGN(sizeof(PgexporterExtShmem));
+}
+
+#if PG_VERSION_NUM >= 150000
+static void
+shmem_request(void)
+{
+   if (prev_shmem_request_hook)
+   {
+      prev_shmem_request_hook();
+   }
+
+   RequestAddinShmemSpace(shmem_size());
+   RequestNamedLWLockTranche("pgexporter_ext", 1);
+}
+#endif
+
+static void
+shmem_startup(void)
+{
+   bool found;
+
+   if (prev_shmem_startup_hook)
+   {
+      prev_shmem_startup_hook();
+   }
+
+   LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+   shmem = ShmemInitStruct("pgexporter_ext", shmem_size(), &found);
+
+   if (!found)
+   {
+      memset(shmem, 0, sizeof(PgexporterExtShmem));
+
+      shmem->lock = &(GetNamedLWLockTranche("pgexporter_ext"))->lock;
+      shmem->started = time(NULL);
+
+      for (int i = 0; i < NUMBER_OF_SEVERITIES; i++)
+      {
+         pg_atomic_init_u64(&shmem->emitted[i], 0);
+
+         for (int m = 0; m < LOG_RATE_MINUTES; m++)
+         {
+            pg_atomic_init_u64(&shmem->minutes[m][i], 0);
+         }
+
+         strncpy(shmem->cache[i].level, pgexporter_ext_log_severity_name(i), sizeof(shmem->cache[i].level) - 1);
+      }
+   }
+
+   LWLockRelease(AddinShmemInitLock);
+}
+
+static void
+log_hook(ErrorData* edata)
+{
+   int severity;
+
+   /* Only count what log_min_messages lets through to the server log */
+   if (shmem != NULL && edata->output_to_server)
+   {
+      severity = severity_from_elevel(edata->elevel);
+      if (severity >= 0)
+      {
+         pg_atomic_fetch_add_u64(&shmem->emitted[severity], 1);
+         count_minute(severity);
+      }
+   }
+
+   if (prev_emit_log_hook)
+   {
+      prev_emit_log_hook(edata);
+   }
+}
+
+static void
+count_minute(int severity)
+{
+   uint32_t minute = (uint32_t)(time(NULL) / 60);
+   pg_atomic_uint64* slot = &shmem->minutes[minute % LOG_RATE_MINUTES][severity];
+   uint64 old;
+   uint64 next;
+
+   old = pg_atomic_read_u64(slot);
+   do
+   {
+      if (SLOT_MINUTE(old) == minute)
+      {
+         next = old + 1;
+      }
+      else
+      {
+         next = ((uint64)minute << 32) | 1;
+      }
+   }
+   while (!pg_atomic_compare_exchange_u64(slot, &old, next));
+}
+
+static int
+severity_from_elevel(int elevel)
+{
+   switch (elevel)
+   {
+      case DEBUG5:
+         return SEVERITY_DEBUG5;
+      case DEBUG4:
+         return SEVERITY_DEBUG4;
+      case DEBUG3:
+         return SEVERITY_DEBUG3;
+      case DEBUG2:
+         return SEVERITY_DEBUG2;
+      case DEBUG1:
+         return SEVERITY_DEBUG1;
+      case LOG:
+      case LOG_SERVER_ONLY:
+         return SEVERITY_LOG;
+      case INFO:
+         return SEVERITY_INFO;
+      case NOTICE:
+         return SEVERITY_NOTICE;
+      case WARNING:
+         return SEVERITY_WARNING;
+      case ERROR:
+         return SEVERITY_ERROR;
+      case FATAL:
+         return SEVERITY_FATAL;
+      case PANIC:
+         return SEVERITY_PANIC;
+      default:
+         break;
+   }
+
+   return -1;
+}
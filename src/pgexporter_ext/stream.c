@@ -0,0 +1,433 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgexporter */
+#include <pgexporter_ext.h>
+#include <logs.h>
+#include <stream.h>
+
+/* system */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int fill_input(struct log_stream* stream);
+static void start_frame(struct log_stream* stream);
+static int gz_open(struct log_stream* stream, const char* path);
+static ssize_t gz_read(struct log_stream* stream, char* out, size_t size);
+static void gz_close(struct log_stream* stream);
+static int bz2_open(struct log_stream* stream, const char* path);
+static ssize_t bz2_read(struct log_stream* stream, char* out, size_t size);
+static void bz2_close(struct log_stream* stream);
+static int lz4_open(struct log_stream* stream, const char* path);
+static ssize_t lz4_read(struct log_stream* stream, char* out, size_t size);
+static void lz4_close(struct log_stream* stream);
+static int zstd_open(struct log_stream* stream, const char* path);
+static ssize_t zstd_read(struct log_stream* stream, char* out, size_t size);
+static void zstd_close(struct log_stream* stream);
+
+static const struct log_decoder decoders[] = {
+   {".gz", gz_open, gz_read, gz_close},
+   {".bz2", bz2_open, bz2_read, bz2_close},
+   {".lz4", lz4_open, lz4_read, lz4_close},
+   {".zst", zstd_open, zstd_read, zstd_close},
+};
+
+const struct log_decoder*
+pgexporter_ext_log_decoder(const char* path)
+{
+   size_t length = strlen(path);
+   size_t suffix;
+
+   for (size_t i = 0; i < sizeof(decoders) / sizeof(decoders[0]); i++)
+   {
+      suffix = strlen(decoders[i].suffix);
+      if (length >= suffix && strcmp(path + length - suffix, decoders[i].suffix) == 0)
+      {
+         return &decoders[i];
+      }
+   }
+
+   return NULL;
+}
+
+int
+pgexporter_ext_log_stream_seek(struct log_stream* stream, int64_t input, int64_t output)
+{
+   /* Only the decoders reading the file themselves start at a frame */
+   if (stream->fp == NULL || fseeko(stream->fp, input, SEEK_SET) != 0)
+   {
+      return 1;
+   }
+
+   stream->base = input;
+   stream->position = 0;
+   stream->length = 0;
+   stream->eof = false;
+   stream->decoded = output;
+   stream->frame_input = input;
+   stream->frame_output = output;
+
+   return 0;
+}
+
+static int
+fill_input(struct log_stream* stream)
+{
+   if (stream->position < stream->length || stream->eof)
+   {
+      return 0;
+   }
+
+   stream->base += stream->length;
+   stream->position = 0;
+   stream->length = fread(stream->input, 1, LOG_BLOCK_SIZE, stream->fp);
+
+   if (stream->length == 0)
+   {
+      if (ferror(stream->fp))
+      {
+         return 1;
+      }
+
+      stream->eof = true;
+   }
+
+   return 0;
+}
+
+static void
+start_frame(struct log_stream* stream)
+{
+   stream->frame_input = stream->base + stream->position;
+   stream->frame_output = stream->decoded;
+   stream->frame_end = false;
+}
+
+static int
+gz_open(struct log_stream* stream, const char* path)
+{
+   stream->gz = gzopen(path, "r");
+   if (stream->gz == NULL)
+   {
+      return 1;
+   }
+
+   /* zlib reads through its own buffer, which defaults to 8 kB */
+   gzbuffer(stream->gz, LOG_BLOCK_SIZE);
+
+   return 0;
+}
+
+static ssize_t
+gz_read(struct log_stream* stream, char* out, size_t size)
+{
+   /* gzread() continues with the next member of a concatenated file */
+   return gzread(stream->gz, out, size);
+}
+
+static void
+gz_close(struct log_stream* stream)
+{
+   if (stream->gz != NULL)
+   {
+      gzclose(stream->gz);
+   }
+}
+
+static int
+bz2_open(struct log_stream* stream, const char* path)
+{
+   stream->fp = fopen(path, "rb");
+   if (stream->fp == NULL)
+   {
+      return 1;
+   }
+
+   if (BZ2_bzDecompressInit(&stream->bz, 0, 0) != BZ_OK)
+   {
+      return 1;
+   }
+
+   stream->bz_active = true;
+
+   return 0;
+}
+
+static ssize_t
+bz2_read(struct log_stream* stream, char* out, size_t size)
+{
+   int ret;
+
+   if (stream->frame_end)
+   {
+      start_frame(stream);
+   }
+
+   stream->bz.next_out = out;
+   stream->bz.avail_out = size;
+
+   while (stream->bz.avail_out > 0)
+   {
+      if (fill_input(stream))
+      {
+         return -1;
+      }
+
+      if (stream->eof && stream->position == stream->length)
+      {
+         break;
+      }
+
+      stream->bz.next_in = stream->input + stream->position;
+      stream->bz.avail_in = stream->length - stream->position;
+
+      ret = BZ2_bzDecompress(&stream->bz);
+
+      stream->position = stream->length - stream->bz.avail_in;
+
+      if (ret == BZ_STREAM_END)
+      {
+         /* pbzip2 and friends write one stream per block, so start over */
+         BZ2_bzDecompressEnd(&stream->bz);
+         if (BZ2_bzDecompressInit(&stream->bz, 0, 0) != BZ_OK)
+         {
+            stream->bz_active = false;
+            return -1;
+         }
+         stream->bz.next_out = out + size - stream->bz.avail_out;
+
+         /* The output of a call stays within one stream, so it can be decoded again from there */
+         if (stream->bz.avail_out < size)
+         {
+            stream->frame_end = true;
+            break;
+         }
+
+         start_frame(stream);
+      }
+      else if (ret != BZ_OK)
+      {
+         return -1;
+      }
+   }
+
+   stream->decoded += size - stream->bz.avail_out;
+
+   return size - stream->bz.avail_out;
+}
+
+static void
+bz2_close(struct log_stream* stream)
+{
+   if (stream->bz_active)
+   {
+      BZ2_bzDecompressEnd(&stream->bz);
+   }
+
+   if (stream->fp != NULL)
+   {
+      fclose(stream->fp);
+   }
+}
+
+static int
+lz4_open(struct log_stream* stream, const char* path)
+{
+   stream->fp = fopen(path, "rb");
+   if (stream->fp == NULL)
+   {
+      return 1;
+   }
+
+   if (LZ4F_isError(LZ4F_createDecompressionContext(&stream->lz4, LZ4F_VERSION)))
+   {
+      stream->lz4 = NULL;
+      return 1;
+   }
+
+   return 0;
+}
+
+static ssize_t
+lz4_read(struct log_stream* stream, char* out, size_t size)
+{
+   size_t produced = 0;
+   size_t in_size;
+   size_t out_size;
+   size_t ret;
+
+   if (stream->frame_end)
+   {
+      start_frame(stream);
+   }
+
+   while (produced < size)
+   {
+      if (fill_input(stream))
+      {
+         return -1;
+      }
+
+      if (stream->eof && stream->position == stream->length)
+      {
+         break;
+      }
+
+      in_size = stream->length - stream->position;
+      out_size = size - produced;
+
+      /* A return of 0 ends a frame, and the next call starts the following frame */
+      ret = LZ4F_decompress(stream->lz4, out + produced, &out_size,
+                            stream->input + stream->position, &in_size, NULL);
+      if (LZ4F_isError(ret))
+      {
+         return -1;
+      }
+
+      stream->position += in_size;
+      produced += out_size;
+
+      /* The output of a call stays within one frame, so it can be decoded again from there */
+      if (ret == 0)
+      {
+         if (produced > 0)
+         {
+            stream->frame_end = true;
+            break;
+         }
+
+         start_frame(stream);
+      }
+   }
+
+   stream->decoded += produced;
+
+   return produced;
+}
+
+static void
+lz4_close(struct log_stream* stream)
+{
+   if (stream->lz4 != NULL)
+   {
+      LZ4F_freeDecompressionContext(stream->lz4);
+   }
+
+   if (stream->fp != NULL)
+   {
+      fclose(stream->fp);
+   }
+}
+
+static int
+zstd_open(struct log_stream* stream, const char* path)
+{
+   stream->fp = fopen(path, "rb");
+   if (stream->fp == NULL)
+   {
+      return 1;
+   }
+
+   stream->zstd = ZSTD_createDCtx();
+   if (stream->zstd == NULL)
+   {
+      return 1;
+   }
+
+   return 0;
+}
+
+static ssize_t
+zstd_read(struct log_stream* stream, char* out, size_t size)
+{
+   ZSTD_inBuffer in;
+   ZSTD_outBuffer output = {out, size, 0};
+   size_t ret;
+
+   if (stream->frame_end)
+   {
+      start_frame(stream);
+   }
+
+   while (output.pos < output.size)
+   {
+      if (fill_input(stream))
+      {
+         return -1;
+      }
+
+      if (stream->eof && stream->position == stream->length)
+      {
+         break;
+      }
+
+      in.src = stream->input;
+      in.size = stream->length;
+      in.pos = stream->position;
+
+      /* Continues across frames, so concatenated files decode as one */
+      ret = ZSTD_decompressStream(stream->zstd, &output, &in);
+      if (ZSTD_isError(ret))
+      {
+         return -1;
+      }
+
+      stream->position = in.pos;
+
+      /* The output of a call stays within one frame, so it can be decoded again from there */
+      if (ret == 0)
+      {
+         if (output.pos > 0)
+         {
+            stream->frame_end = true;
+            break;
+         }
+
+         start_frame(stream);
+      }
+   }
+
+   stream->decoded += output.pos;
+
+   return output.pos;
+}
+
+static void
+zstd_close(struct log_stream* stream)
+{
+   if (stream->zstd != NULL)
+   {
+      ZSTD_freeDCtx(stream->zstd);
+   }
+
+   if (stream->fp != NULL)
+   {
+      fclose(stream->fp);
+   }
+}
@@ -0,0 +1,405 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgexporter */
+#include <pgexporter_ext.h>
+#include <topk.h>
+
+/* system */
+#include <stdlib.h>
+#include <string.h>
+
+#define HASH_SEED  0xcbf29ce484222325ULL
+#define HASH_PRIME 0x100000001b3ULL
+
+#define CHAR_PLAIN 0
+#define CHAR_IDENT 1
+#define CHAR_DIGIT 2
+#define CHAR_BLANK 3
+#define CHAR_QUOTE 4
+#define CHAR_SPACE 5
+
+static void append(struct log_fingerprint* fingerprint, const char* data, size_t length);
+static void init_classes(void) __attribute__((constructor));
+static int find_error(struct log_topk* topk, uint64_t fingerprint, const char* sqlstate);
+static int compare_errors(const void* a, const void* b);
+
+static unsigned char classes[256];
+
+void
+pgexporter_ext_fingerprint_init(struct log_fingerprint* fingerprint)
+{
+   fingerprint->hash = HASH_SEED;
+   fingerprint->word = 0;
+   fingerprint->word_length = 0;
+   fingerprint->sample_length = 0;
+   fingerprint->quote = 0;
+   fingerprint->closed = false;
+   fingerprint->number = false;
+   fingerprint->last = ' ';
+}
+
+void
+pgexporter_ext_fingerprint_feed(struct log_fingerprint* fingerprint, const char* data, size_t length)
+{
+   const char* p = data;
+   const char* end = data + length;
+   const char* q;
+   char c;
+   int previous;
+   int class;
+   bool closed;
+
+   closed = fingerprint->closed;
+
+   while (p < end)
+   {
+      if (fingerprint->quote != 0)
+      {
+         q = memchr(p, fingerprint->quote, end - p);
+         if (q == NULL)
+         {
+            closed = false;
+            break;
+         }
+
+         fingerprint->quote = 0;
+         closed = true;
+         p = q + 1;
+         continue;
+      }
+
+      /* Most of a message is words and single spaces, which are kept as they are.
+       * Digits are kept too when they are part of an identifier like pg_stat_1 */
+      previous = classes[(unsigned char)fingerprint->last];
+      for (q = p; q < end; q++)
+      {
+         class = classes[(unsigned char)*q];
+
+         if (class == CHAR_DIGIT)
+         {
+            if (previous != CHAR_IDENT && previous != CHAR_DIGIT)
+            {
+               break;
+            }
+         }
+         else if (class > CHAR_BLANK || (class == CHAR_BLANK && previous == CHAR_BLANK))
+         {
+            break;
+         }
+
+         previous = class;
+      }
+
+      if (q > p)
+      {
+         append(fingerprint, p, q - p);
+         fingerprint->number = false;
+         closed = false;
+         p = q;
+         continue;
+      }
+
+      c = *p++;
+
+      switch (classes[(unsigned char)c])
+      {
+         case CHAR_DIGIT:
+            if (!fingerprint->number)
+            {
+               append(fingerprint, "?", 1);
+               fingerprint->number = true;
+            }
+            break;
+         case CHAR_QUOTE:
+            fingerprint->number = false;
+
+            /* A doubled quote continues the literal */
+            if (!closed)
+            {
+               append(fingerprint, c == '"' ? "\"?\"" : "'?'", 3);
+            }
+            fingerprint->quote = c;
+            break;
+         case CHAR_SPACE:
+            /* Other whitespace becomes a space */
+            fingerprint->number = false;
+            if (fingerprint->last != ' ')
+            {
+               append(fingerprint, " ", 1);
+            }
+            break;
+         default:
+            /* A repeated space */
+            fingerprint->number = false;
+            break;
+      }
+
+      closed = false;
+   }
+
+   fingerprint->closed = closed;
+}
+
+uint64_t
+pgexporter_ext_fingerprint_value(struct log_fingerprint* fingerprint)
+{
+   if (fingerprint->word_length == 0)
+   {
+      return fingerprint->hash;
+   }
+
+   return (fingerprint->hash ^ fingerprint->word ^ ((uint64_t)fingerprint->word_length << 56)) * HASH_PRIME;
+}
+
+void
+pgexporter_ext_topk_add(struct log_topk* topk, struct log_fingerprint* fingerprint, const char* sqlstate, uint64_t count)
+{
+   struct log_error error;
+
+   memset(&error, 0, sizeof(struct log_error));
+   error.fingerprint = pgexporter_ext_fingerprint_value(fingerprint);
+   error.count = count;
+
+   if (sqlstate != NULL)
+   {
+      strncpy(error.sqlstate, sqlstate, sizeof(error.sqlstate) - 1);
+   }
+
+   memcpy(error.sample, fingerprint->sample, fingerprint->sample_length);
+
+   pgexporter_ext_topk_add_error(topk, &error);
+}
+
+void
+pgexporter_ext_topk_add_error(struct log_topk* topk, struct log_error* error)
+{
+   int i;
+   int min = 0;
+
+   i = find_error(topk, error->fingerprint, error->sqlstate);
+   if (i >= 0)
+   {
+      topk->counts[i] += error->count;
+      topk->errors[i] += error->error;
+      return;
+   }
+
+   if (topk->size < TOPK_CAPACITY)
+   {
+      i = topk->size++;
+      topk->counts[i] = 0;
+      topk->errors[i] = 0;
+   }
+   else
+   {
+      /* Space-Saving: the new message takes over the least frequent entry,
+       * inheriting its count as the possible overestimation */
+      for (int j = 1; j < topk->size; j++)
+      {
+         if (topk->counts[j] < topk->counts[min])
+         {
+            min = j;
+         }
+      }
+
+      i = min;
+      topk->errors[i] = topk->counts[i];
+   }
+
+   topk->fingerprints[i] = error->fingerprint;
+   topk->counts[i] += error->count;
+   topk->errors[i] += error->error;
+   memcpy(topk->sqlstates[i], error->sqlstate, SQLSTATE_SIZE);
+   memcpy(topk->samples[i], error->sample, TOPK_SAMPLE_SIZE);
+}
+
+void
+pgexporter_ext_topk_merge(struct log_topk* topk, struct log_topk* other)
+{
+   struct log_error errors[2 * TOPK_CAPACITY];
+   int size;
+   int i;
+
+   size = pgexporter_ext_topk_errors(topk, errors);
+
+   for (int j = 0; j < other->size; j++)
+   {
+      for (i = 0; i < size; i++)
+      {
+         if (errors[i].fingerprint == other->fingerprints[j] && strcmp(errors[i].sqlstate, other->sqlstates[j]) == 0)
+         {
+            break;
+         }
+      }
+
+      if (i == size)
+      {
+         memset(&errors[i], 0, sizeof(struct log_error));
+         errors[i].fingerprint = other->fingerprints[j];
+         memcpy(errors[i].sqlstate, other->sqlstates[j], SQLSTATE_SIZE);
+         memcpy(errors[i].sample, other->samples[j], TOPK_SAMPLE_SIZE);
+         size++;
+      }
+
+      errors[i].count += other->counts[j];
+      errors[i].error += other->errors[j];
+   }
+
+   /* Keep the most frequent of both */
+   qsort(errors, size, sizeof(struct log_error), compare_errors);
+
+   topk->size = 0;
+   for (i = 0; i < size && i < TOPK_CAPACITY; i++)
+   {
+      pgexporter_ext_topk_add_error(topk, &errors[i]);
+   }
+}
+
+int
+pgexporter_ext_topk_errors(struct log_topk* topk, struct log_error* errors)
+{
+   for (int i = 0; i < topk->size; i++)
+   {
+      errors[i].fingerprint = topk->fingerprints[i];
+      errors[i].count = topk->counts[i];
+      errors[i].error = topk->errors[i];
+      memcpy(errors[i].sqlstate, topk->sqlstates[i], SQLSTATE_SIZE);
+      memcpy(errors[i].sample, topk->samples[i], TOPK_SAMPLE_SIZE);
+   }
+
+   qsort(errors, topk->size, sizeof(struct log_error), compare_errors);
+
+   return topk->size;
+}
+
+static void
+append(struct log_fingerprint* fingerprint, const char* data, size_t length)
+{
+   uint64_t word;
+   size_t n;
+
+   if (length == 0)
+   {
+      return;
+   }
+
+   n = TOPK_SAMPLE_SIZE - 1 - fingerprint->sample_length;
+   if (n > length)
+   {
+      n = length;
+   }
+   memcpy(fingerprint->sample + fingerprint->sample_length, data, n);
+   fingerprint->sample_length += n;
+
+   fingerprint->last = data[length - 1];
+
+   /* FNV-1a over 8 byte words rather than single bytes */
+   while (length > 0 && fingerprint->word_length != 0)
+   {
+      fingerprint->word |= (uint64_t)(unsigned char)*data << (8 * fingerprint->word_length);
+      data++;
+      length--;
+
+      if (++fingerprint->word_length == 8)
+      {
+         fingerprint->hash = (fingerprint->hash ^ fingerprint->word) * HASH_PRIME;
+         fingerprint->word = 0;
+         fingerprint->word_length = 0;
+      }
+   }
+
+   while (length >= 8)
+   {
+      memcpy(&word, data, 8);
+      fingerprint->hash = (fingerprint->hash ^ word) * HASH_PRIME;
+      data += 8;
+      length -= 8;
+   }
+
+   while (length > 0)
+   {
+      fingerprint->word |= (uint64_t)(unsigned char)*data << (8 * fingerprint->word_length);
+      fingerprint->word_length++;
+      data++;
+      length--;
+   }
+}
+
+static void
+init_classes(void)
+{
+   for (int c = 'a'; c <= 'z'; c++)
+   {
+      classes[c] = CHAR_IDENT;
+      classes[c - 'a' + 'A'] = CHAR_IDENT;
+   }
+   classes['_'] = CHAR_IDENT;
+
+   for (int c = '0'; c <= '9'; c++)
+   {
+      classes[c] = CHAR_DIGIT;
+   }
+
+   classes[' '] = CHAR_BLANK;
+
+   classes['\''] = CHAR_QUOTE;
+   classes['"'] = CHAR_QUOTE;
+
+   classes['\t'] = CHAR_SPACE;
+   classes['\n'] = CHAR_SPACE;
+   classes['\r'] = CHAR_SPACE;
+}
+
+static int
+find_error(struct log_topk* topk, uint64_t fingerprint, const char* sqlstate)
+{
+   for (int i = 0; i < topk->size; i++)
+   {
+      if (topk->fingerprints[i] == fingerprint && strcmp(topk->sqlstates[i], sqlstate) == 0)
+      {
+         return i;
+      }
+   }
+
+   return -1;
+}
+
+static int
+compare_errors(const void* a, const void* b)
+{
+   const struct log_error* ea = (const struct log_error*)a;
+   const struct log_error* eb = (const struct log_error*)b;
+
+   if (ea->count != eb->count)
+   {
+      return ea->count > eb->count ? -1 : 1;
+   }
+
+   return 0;
+}
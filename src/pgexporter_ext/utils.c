@@ -28,15 +28,22 @@
 
 /* pgexporter */
 #include <pgexporter_ext.h>
+#include <disk.h>
+#include <logs.h>
+#include <shmem.h>
 #include <utils.h>
 
 /* postgresql */
 #include "postgres.h"
+#include "miscadmin.h"
+#include "catalog/pg_tablespace_d.h"
+#include "common/relpath.h"
 #include "utils/guc.h"
 
 /* system */
 #include <dirent.h>
 #include <errno.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -44,92 +51,338 @@
 #include <sys/stat.h>
 #include <sys/statvfs.h>
 #include <sys/types.h>
-#include <zlib.h>
-#include <bzlib.h>
-#include <lz4frame.h>
-#include <zstd.h>
-
-static char* pgexporter_ext_append(char* orig, char* s);
-static int pgexporter_ext_process_log_file(const char* file_path, const char* level);
-static int pgexporter_ext_process_gz_log_file(const char* file_path, const char* level);
-static int pgexporter_ext_process_bz2_log_file(const char* file_path, const char* level);
-static int pgexporter_ext_process_lz4_log_file(const char* file_path, const char* level);
-static int pgexporter_ext_process_zstd_log_file(const char* file_path, const char* level);
+#ifdef HAVE_LINUX
+#include <sys/sysmacros.h>
+#endif
+
+static int scan_log_files(struct log_counts* counts, bool labeled);
+static bool scan_interrupted(void);
+static bool cached_usage(const char* path, const char* skip, struct disk_usage* usage);
+static int walk_missing(struct disk_root* roots, int number_of_roots);
+static struct disk_root* add_root(struct disk_root* roots, int* number_of_roots, int* capacity, const char* name,
+                                  unsigned int oid, unsigned int database, const char* path);
+static struct disk_root* add_databases(struct disk_root* roots, int* number_of_roots, int* capacity,
+                                       unsigned int oid, const char* directory);
+
+/* The log file cursors of this backend */
+static struct log_state* log_state = NULL;
 
 unsigned long
 pgexporter_get_directory_size(char* directory)
 {
-   unsigned long total_size = 0;
+   struct disk_usage usage;
+   struct disk_root root;
+
+   /* The disk worker keeps the sizes of the directories it watches */
+   if (cached_usage(directory, NULL, &usage))
+   {
+      return usage.bytes;
+   }
+
+   if (pgexporter_ext_disk_io_uring)
+   {
+      memset(&root, 0, sizeof(struct disk_root));
+      snprintf(root.path, sizeof(root.path), "%s", directory);
+
+      if (pgexporter_ext_disk_walk_roots(&root, 1, pgexporter_ext_max_disk_workers, true, scan_interrupted) ||
+          root.result != 0)
+      {
+         CHECK_FOR_INTERRUPTS();
+         errno = 0;
+         return 0;
+      }
+
+      return root.usage.bytes;
+   }
+
+   if (pgexporter_ext_disk_walk(directory, &usage))
+   {
+      errno = 0;
+      return 0;
+   }
+
+   return usage.bytes;
+}
+
+int
+pgexporter_ext_disk_roots(struct disk_root** roots, int* number_of_roots)
+{
+   struct disk_root* result = NULL;
+   int capacity = 8;
+   int n = 0;
+   char path[MAXPGPATH];
+   char target[PATH_MAX];
    DIR* dir;
    struct dirent* entry;
-   char* p;
    struct stat st;
-   unsigned long l;
+   char* end;
+   unsigned long oid;
+
+   *roots = NULL;
+   *number_of_roots = 0;
 
-   if (!(dir = opendir(directory)))
+   result = (struct disk_root*)palloc0(capacity * sizeof(struct disk_root));
+
+   snprintf(result[n].name, sizeof(result[n].name), "data_directory");
+   snprintf(result[n].path, sizeof(result[n].path), "%s", DataDir);
+   n++;
+
+   /* pg_wal is walked on its own, whether it is a link or not */
+   snprintf(path, sizeof(path), "%s/pg_wal", DataDir);
+   snprintf(result[n].name, sizeof(result[n].name), "pg_wal");
+   if (lstat(path, &st) == 0 && S_ISLNK(st.st_mode) && realpath(path, target) != NULL)
+   {
+      snprintf(result[n].path, sizeof(result[n].path), "%s", target);
+   }
+   else
    {
-      return total_size;
+      snprintf(result[n].path, sizeof(result[n].path), "%s", path);
+      snprintf(result[0].skip, sizeof(result[0].skip), "pg_wal");
    }
+   n++;
 
-   while ((entry = readdir(dir)) != NULL)
+   /* The links of pg_tblspc; in-place tablespaces are part of the data directory */
+   snprintf(path, sizeof(path), "%s/pg_tblspc", DataDir);
+   dir = opendir(path);
+   while (dir != NULL && (entry = readdir(dir)) != NULL)
    {
-      if (entry->d_type == DT_DIR)
+      oid = strtoul(entry->d_name, &end, 10);
+      if (entry->d_name[0] == '.' || *end != '\0' || oid == 0)
       {
-         char path[1024];
+         continue;
+      }
 
-         if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
-         {
-            continue;
-         }
+      snprintf(path, sizeof(path), "%s/pg_tblspc/%s", DataDir, entry->d_name);
+      if (lstat(path, &st) != 0 || !S_ISLNK(st.st_mode) || realpath(path, target) == NULL)
+      {
+         continue;
+      }
+
+      if (n == capacity)
+      {
+         capacity *= 2;
+         result = (struct disk_root*)repalloc(result, capacity * sizeof(struct disk_root));
+         memset(result + n, 0, (capacity - n) * sizeof(struct disk_root));
+      }
+
+      snprintf(result[n].name, sizeof(result[n].name), "tablespace");
+      snprintf(result[n].path, sizeof(result[n].path), "%s", target);
+      result[n].oid = (unsigned int)oid;
+      n++;
+   }
+
+   if (dir != NULL)
+   {
+      closedir(dir);
+   }
+
+   *roots = result;
+   *number_of_roots = n;
+
+   return 0;
+}
+
+int
+pgexporter_ext_disk_usage_roots(struct disk_root** roots, int* number_of_roots)
+{
+   struct disk_root* result = NULL;
+   int n = 0;
+
+   *roots = NULL;
+   *number_of_roots = 0;
+
+   if (pgexporter_ext_disk_roots(&result, &n))
+   {
+      return 1;
+   }
+
+   if (walk_missing(result, n))
+   {
+      pfree(result);
+      elog(ERROR, "Failed to walk the data directory");
+      return 1;
+   }
+
+   *roots = result;
+   *number_of_roots = n;
+
+   return 0;
+}
+
+int
+pgexporter_ext_disk_breakdown_roots(struct disk_root** roots, int* number_of_roots)
+{
+   struct disk_root* result = NULL;
+   int capacity = 16;
+   int n = 0;
+   char path[MAXPGPATH];
+   char target[PATH_MAX];
+   static const char* areas[] = {"global", "pg_wal", "pg_xact", "pg_multixact", "pg_stat_tmp"};
+   DIR* dir;
+   struct dirent* entry;
+   char* end;
+   unsigned long oid;
+
+   *roots = NULL;
+   *number_of_roots = 0;
+
+   result = (struct disk_root*)palloc0(capacity * sizeof(struct disk_root));
+
+   /* The default tablespace; base/pgsql_tmp is one of its entries */
+   snprintf(path, sizeof(path), "%s/base", DataDir);
+   result = add_databases(result, &n, &capacity, DEFAULTTABLESPACE_OID, path);
 
-         snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+   for (int i = 0; i < (int)(sizeof(areas) / sizeof(areas[0])); i++)
+   {
+      snprintf(path, sizeof(path), "%s/%s", DataDir, areas[i]);
+      result = add_root(result, &n, &capacity, areas[i], i == 0 ? GLOBALTABLESPACE_OID : 0, 0, path);
+   }
 
-         total_size += pgexporter_get_directory_size(path);
+   /* The databases of each tablespace, in-place ones included */
+   snprintf(path, sizeof(path), "%s/pg_tblspc", DataDir);
+   dir = opendir(path);
+   while (dir != NULL && (entry = readdir(dir)) != NULL)
+   {
+      oid = strtoul(entry->d_name, &end, 10);
+      if (entry->d_name[0] == '.' || *end != '\0' || oid == 0)
+      {
+         continue;
       }
-      else if (entry->d_type == DT_REG)
+
+      snprintf(path, sizeof(path), "%s/pg_tblspc/%s", DataDir, entry->d_name);
+      if (realpath(path, target) == NULL)
       {
-         p = NULL;
+         continue;
+      }
 
-         p = pgexporter_ext_append(p, directory);
-         p = pgexporter_ext_append(p, "/");
-         p = pgexporter_ext_append(p, entry->d_name);
+      snprintf(path, sizeof(path), "%s/%s", target, TABLESPACE_VERSION_DIRECTORY);
+      result = add_databases(result, &n, &capacity, (unsigned int)oid, path);
+   }
 
-         memset(&st, 0, sizeof(struct stat));
+   if (dir != NULL)
+   {
+      closedir(dir);
+   }
 
-         stat(p, &st);
+   /* All the directories in one walk */
+   if (walk_missing(result, n))
+   {
+      pfree(result);
+      elog(ERROR, "Failed to walk the data directory");
+      return 1;
+   }
 
-         l = st.st_size / st.st_blksize;
+   *roots = result;
+   *number_of_roots = n;
 
-         if (st.st_size % st.st_blksize != 0)
-         {
-            l += 1;
-         }
+   return 0;
+}
 
-         total_size += (l * st.st_blksize);
+int
+pgexporter_ext_disk_filesystems(struct disk_filesystem** filesystems, int* number_of_filesystems)
+{
+   struct disk_root* roots = NULL;
+   int number_of_roots = 0;
+   struct disk_mount* mounts = NULL;
+   int number_of_mounts = 0;
+   struct disk_filesystem* result;
+   struct disk_filesystem* fs;
+   const char* log_directory;
+   const char* path;
+   char name[DISK_NAME_SIZE];
+   char target[PATH_MAX];
+   struct stat st;
+   struct statvfs buf;
+   int n = 0;
+   int m;
+   int k;
+
+   *filesystems = NULL;
+   *number_of_filesystems = 0;
+
+   if (pgexporter_ext_disk_roots(&roots, &number_of_roots))
+   {
+      return 1;
+   }
+
+   /* Without mountinfo the directories are still grouped by device */
+   pgexporter_ext_disk_mounts(DISK_MOUNTINFO, &mounts, &number_of_mounts);
 
-         free(p);
+   log_directory = GetConfigOptionByName("log_directory", NULL, false);
+
+   result = (struct disk_filesystem*)palloc0((number_of_roots + 1) * sizeof(struct disk_filesystem));
+
+   for (int i = 0; i <= number_of_roots; i++)
+   {
+      if (i < number_of_roots)
+      {
+         path = roots[i].path;
+         if (roots[i].oid != 0)
+         {
+            snprintf(name, sizeof(name), "pg_tblspc/%u", roots[i].oid);
+         }
+         else
+         {
+            snprintf(name, sizeof(name), "%s", roots[i].name);
+         }
+      }
+      else
+      {
+         /* A relative log_directory is in the data directory, the working directory */
+         path = log_directory;
+         snprintf(name, sizeof(name), "log_directory");
       }
-      else if (entry->d_type == DT_LNK)
+
+      if (path == NULL || realpath(path, target) == NULL || stat(target, &st) != 0)
       {
-         p = NULL;
+         continue;
+      }
 
-         p = pgexporter_ext_append(p, directory);
-         p = pgexporter_ext_append(p, "/");
-         p = pgexporter_ext_append(p, entry->d_name);
+      for (k = 0; k < n && result[k].device != (unsigned long)st.st_dev; k++)
+      {
+      }
 
-         memset(&st, 0, sizeof(struct stat));
+      fs = &result[k];
 
-         stat(p, &st);
+      if (k == n)
+      {
+         n++;
+         fs->device = (unsigned long)st.st_dev;
+         fs->names = (char**)palloc0((number_of_roots + 1) * sizeof(char*));
 
-         total_size += st.st_blksize;
+         m = pgexporter_ext_disk_mount(mounts, number_of_mounts, target, major(st.st_dev), minor(st.st_dev));
+         if (m >= 0)
+         {
+            fs->mounted = true;
+            fs->mount = mounts[m];
+         }
 
-         free(p);
+         /* One statvfs() per file system, whatever the number of directories on it */
+         if (statvfs(target, &buf) == 0)
+         {
+            fs->total = (uint64_t)buf.f_blocks * buf.f_frsize;
+            fs->free = (uint64_t)buf.f_bfree * buf.f_frsize;
+            fs->available = (uint64_t)buf.f_bavail * buf.f_frsize;
+            fs->inodes = (uint64_t)buf.f_files;
+            fs->inodes_free = (uint64_t)buf.f_ffree;
+            fs->inodes_available = (uint64_t)buf.f_favail;
+         }
+         else
+         {
+            fs->result = 1;
+         }
       }
+
+      fs->names[fs->number_of_names++] = pstrdup(name);
    }
 
-   closedir(dir);
+   free(mounts);
+   pfree(roots);
 
-   return total_size;
+   *filesystems = result;
+   *number_of_filesystems = n;
+
+   return 0;
 }
 
 unsigned long
@@ -211,301 +464,342 @@ pgexporter_ext_clean_string(char* orig)
    return result;
 }
 
-static char*
-pgexporter_ext_append(char* orig, char* s)
+bool
+pgexporter_ext_ends_with(char* str, char* suffix)
+{
+   int str_len = strlen(str);
+   int suffix_len = strlen(suffix);
+
+   return (str_len >= suffix_len) && (strcmp(str + (str_len - suffix_len), suffix) == 0);
+}
+
+int
+pgexporter_ext_parse_log_files(struct log_counts* counts)
+{
+   return scan_log_files(counts, false);
+}
+
+int
+pgexporter_ext_parse_log_errors(struct log_topk* topk)
 {
-   size_t orig_length;
-   size_t s_length;
-   char* n = NULL;
+   struct log_counts counts;
 
-   if (s == NULL)
+   if (scan_log_files(&counts, false))
    {
-      return orig;
+      return 1;
    }
 
-   if (orig != NULL)
+   pgexporter_ext_log_state_errors(log_state, topk);
+
+   return 0;
+}
+
+int
+pgexporter_ext_parse_log_labels(struct log_labels** labels)
+{
+   struct log_counts counts;
+
+   *labels = NULL;
+
+   if (scan_log_files(&counts, true))
    {
-      orig_length = strlen(orig);
+      return 1;
    }
-   else
+
+   *labels = pgexporter_ext_log_state_labels(log_state);
+
+   return *labels == NULL ? 1 : 0;
+}
+
+int
+pgexporter_ext_parse_log_durations(struct log_histogram* histogram)
+{
+   struct log_counts counts;
+
+   if (scan_log_files(&counts, false))
    {
-      orig_length = 0;
+      return 1;
    }
 
-   s_length = strlen(s);
+   pgexporter_ext_log_state_durations(log_state, histogram);
 
-   n = (char*)realloc(orig, orig_length + s_length + 1);
+   return 0;
+}
+
+int
+pgexporter_ext_parse_log_patterns(const struct log_patterns** patterns, uint64_t* matches)
+{
+   struct log_counts counts;
 
-   memcpy(n + orig_length, s, s_length);
+   *patterns = NULL;
 
-   n[orig_length + s_length] = '\0';
+   if (scan_log_files(&counts, false))
+   {
+      return 1;
+   }
 
-   return n;
+   *patterns = log_state->patterns;
+   pgexporter_ext_log_state_matches(log_state, matches);
+
+   return 0;
 }
 
-bool
-pgexporter_ext_ends_with(char* str, char* suffix)
+int
+pgexporter_ext_parse_log_counts_between(int64_t from, int64_t to, struct log_counts* counts)
 {
-   int str_len = strlen(str);
-   int suffix_len = strlen(suffix);
+   const char* log_directory = GetConfigOptionByName("log_directory", NULL, false);
 
-   return (str_len >= suffix_len) && (strcmp(str + (str_len - suffix_len), suffix) == 0);
+   /* The marks are placed by the scan */
+   if (scan_log_files(counts, false))
+   {
+      return 1;
+   }
+
+   if (pgexporter_ext_log_state_counts_between(log_state, log_directory, from, to, counts))
+   {
+      elog(ERROR, "Failed to open log directory: %s", log_directory);
+      return 1;
+   }
+
+   return 0;
 }
 
 int
-pgexporter_ext_parse_log_files(const char* level)
+pgexporter_ext_read_recent_errors(int n, struct log_entry* entries, int* count)
 {
-   struct dirent* entry;
-   int total_count = 0;
-   char file_path[MAXPGPATH];
-   struct stat path_stat;
-
    const char* log_directory = GetConfigOptionByName("log_directory", NULL, false);
+
+   *count = 0;
+
    if (!log_directory)
    {
       elog(ERROR, "Failed to retrieve log directory from configuration");
-      return 0;
+      return 1;
    }
-   DIR* dp = opendir(log_directory);
-   if (!dp)
+
+   if (pgexporter_ext_log_recent_errors(log_directory, n, LOG_RECENT_BYTES, entries, count))
    {
       elog(ERROR, "Failed to open log directory: %s", log_directory);
-      return 0;
+      return 1;
    }
-   
-   while ((entry = readdir(dp)) != NULL)
-   {
-      if (entry->d_name[0] == '.')
-      {
-         continue;
-      }
 
-      snprintf(file_path, sizeof(file_path), "%s/%s", log_directory, entry->d_name);
-
-      stat(file_path, &path_stat);
-      if (S_ISREG(path_stat.st_mode))
-      {
-         if (pgexporter_ext_ends_with(entry->d_name, ".gz"))
-         {
-            total_count += pgexporter_ext_process_gz_log_file(file_path, level);
-         }
-         else if (pgexporter_ext_ends_with(entry->d_name, ".bz2"))
-         {
-            total_count += pgexporter_ext_process_bz2_log_file(file_path, level);
-         }
-         else if (pgexporter_ext_ends_with(entry->d_name, ".lz4"))
-         {
-            total_count += pgexporter_ext_process_lz4_log_file(file_path, level);
-         }
-         else if (pgexporter_ext_ends_with(entry->d_name, ".zst"))
-         {
-            total_count += pgexporter_ext_process_zstd_log_file(file_path, level);
-         }
-         else
-         {
-            total_count += pgexporter_ext_process_log_file(file_path, level);
-         }
-      }
-   }
+   return 0;
+}
 
-   closedir(dp);
-   return total_count;
+void
+pgexporter_ext_log_scan_status_get(bool* stale, int64_t* bytes, int64_t* elapsed)
+{
+   *stale = log_state != NULL && log_state->stale;
+   *bytes = log_state != NULL ? log_state->scanned : 0;
+   *elapsed = log_state != NULL ? log_state->elapsed : 0;
 }
 
 static int
-pgexporter_ext_process_log_file(const char* file_path, const char* level)
+scan_log_files(struct log_counts* counts, bool labeled)
 {
-   FILE* log_file;
-   char line[MAXPGPATH];
-   char lower_line[MAXPGPATH];
-   int count = 0;
+   const char* log_directory = GetConfigOptionByName("log_directory", NULL, false);
 
-   log_file = fopen(file_path, "r");
-   if (!log_file)
+   if (!log_directory)
    {
-      elog(ERROR, "Failed to open log file: %s", file_path);
-      return 0;
+      elog(ERROR, "Failed to retrieve log directory from configuration");
+      return 1;
    }
 
-   while (fgets(line, sizeof(line), log_file))
+   if (log_state == NULL)
    {
-      strncpy(lower_line, line, sizeof(lower_line) - 1);
-      lower_line[sizeof(lower_line) - 1] = '\0';
-
-      if (strstr(lower_line, level) != NULL)
+      log_state = pgexporter_ext_log_state_create();
+      if (log_state == NULL)
       {
-         count++;
+         elog(ERROR, "Failed to allocate the log scan state");
+         return 1;
       }
+
+      snprintf(log_state->index, sizeof(log_state->index), "%s/%s", DataDir, LOG_INDEX_FILE);
    }
 
-   fclose(log_file);
-   return count;
-}
+   log_state->workers = pgexporter_ext_max_scan_workers;
+   log_state->max_time = pgexporter_ext_log_scan_max_time;
+   log_state->max_bytes = (int64_t)pgexporter_ext_log_scan_max_bytes * 1024 * 1024;
+   log_state->interrupted = scan_interrupted;
 
-static int
-pgexporter_ext_process_gz_log_file(const char* file_path, const char* level)
-{
-   gzFile gz_log_file;
-   char line[MAXPGPATH];
-   char lower_line[MAXPGPATH];
-   int count = 0;
+   /* Only the connections asking for labels pay for them, and once they did
+    * the files keep being counted by label so their counts stay complete */
+   if (labeled)
+   {
+      log_state->labeled = true;
+   }
 
-   gz_log_file = gzopen(file_path, "r");
-   if (!gz_log_file)
+   /* The prefix may change on reload, so it is compiled for every scan */
+   if (pgexporter_ext_log_prefix_compile(GetConfigOption("log_line_prefix", false, false), &log_state->prefix))
    {
-      elog(ERROR, "Failed to open compressed log file: %s", file_path);
-      return 0;
+      elog(DEBUG1, "pgexporter_ext: log_line_prefix has too many escapes to extract labels");
    }
 
-   while (gzgets(gz_log_file, line, sizeof(line)))
+   /* Only compiled again when the patterns change */
+   if (pgexporter_ext_log_state_patterns(log_state, pgexporter_ext_log_patterns))
    {
-      strncpy(lower_line, line, sizeof(lower_line) - 1);
-      lower_line[sizeof(lower_line) - 1] = '\0';
+      elog(WARNING, "pgexporter_ext: Failed to compile pgexporter.log_patterns");
+   }
 
-      if (strstr(lower_line, level) != NULL)
-      {
-         count++;
-      }
+   if (pgexporter_ext_log_state_scan(log_state, log_directory, counts))
+   {
+      elog(ERROR, "Failed to open log directory: %s", log_directory);
+      return 1;
+   }
+
+   /* The threads only stop on a cancel, which is raised here */
+   CHECK_FOR_INTERRUPTS();
+
+   if (log_state->stale)
+   {
+      elog(DEBUG1, "pgexporter_ext: log scan stopped after %lld bytes in %lld ms, the next scan continues it",
+           (long long)log_state->scanned, (long long)log_state->elapsed);
    }
 
-   gzclose(gz_log_file);
-   return count;
+   return 0;
 }
 
 static int
-pgexporter_ext_process_bz2_log_file(const char* file_path, const char* level)
+walk_missing(struct disk_root* roots, int number_of_roots)
 {
-   FILE* file;
-   BZFILE* bz_log_file;
-   char line[MAXPGPATH];
-   char lower_line[MAXPGPATH];
-   int count = 0;
-   int bzerror;
-
-      file = fopen(file_path, "rb");
-   if (!file)
+   struct disk_root* missing = NULL;
+   int* index = NULL;
+   int m = 0;
+   int ret = 0;
+
+   /* Only the roots the disk worker doesn't have are walked */
+   missing = (struct disk_root*)palloc0(number_of_roots * sizeof(struct disk_root));
+   index = (int*)palloc0(number_of_roots * sizeof(int));
+   for (int i = 0; i < number_of_roots; i++)
    {
-      elog(ERROR, "Failed to open compressed log file: %s", file_path);
-      return 0;
+      if (!cached_usage(roots[i].path, roots[i].skip, &roots[i].usage))
+      {
+         index[m] = i;
+         missing[m++] = roots[i];
+      }
    }
 
-   bz_log_file = BZ2_bzReadOpen(NULL, file, 0, 0, NULL, 0);
-   if (!bz_log_file)
+   if (m > 0)
    {
-      elog(ERROR, "Failed to open bz2 compressed file: %s", file_path);
-      fclose(file);
-      return 0;
+      ret = pgexporter_ext_disk_walk_roots(missing, m, pgexporter_ext_max_disk_workers, pgexporter_ext_disk_io_uring, scan_interrupted);
+
+      /* The threads only stop on a cancel, which is raised here */
+      CHECK_FOR_INTERRUPTS();
    }
 
-   while (BZ2_bzRead(&bzerror, bz_log_file, line, sizeof(line) - 1) > 0)
+   for (int j = 0; ret == 0 && j < m; j++)
    {
-      line[sizeof(line) - 1] = '\0';
-      strncpy(lower_line, line, sizeof(lower_line) - 1);
-      lower_line[sizeof(lower_line) - 1] = '\0';
-
-      if (strstr(lower_line, level) != NULL)
-      {
-         count++;
-      }
+      roots[index[j]] = missing[j];
    }
 
-   BZ2_bzReadClose(&bzerror, bz_log_file);
-   fclose(file);
-   return count;
+   pfree(index);
+   pfree(missing);
+
+   return ret;
 }
 
-static int
-pgexporter_ext_process_lz4_log_file(const char* file_path, const char* level)
+static struct disk_root*
+add_root(struct disk_root* roots, int* number_of_roots, int* capacity, const char* name,
+         unsigned int oid, unsigned int database, const char* path)
 {
-   FILE* file;
-   LZ4F_dctx* dctx;
-   char in_buffer[MAXPGPATH];
-   char out_buffer[MAXPGPATH];
-   char lower_line[MAXPGPATH];
-   size_t in_size, out_size;
-   int count = 0;
-
-   file = fopen(file_path, "rb");
-   if (!file)
-   {
-      elog(ERROR, "Failed to open compressed log file: %s", file_path);
-      return 0;
+   char target[PATH_MAX];
+   struct disk_root* root;
+
+   /* pgsql_tmp and pg_stat_tmp are only there once they are used */
+   if (realpath(path, target) == NULL)
+   {
+      return roots;
    }
 
-   if (LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION) != 0)
+   if (*number_of_roots == *capacity)
    {
-      elog(ERROR, "Failed to create LZ4 decompression context");
-      fclose(file);
-      return 0;
+      *capacity *= 2;
+      roots = (struct disk_root*)repalloc(roots, *capacity * sizeof(struct disk_root));
+      memset(roots + *number_of_roots, 0, (*capacity - *number_of_roots) * sizeof(struct disk_root));
    }
 
-   while ((in_size = fread(in_buffer, 1, sizeof(in_buffer), file)) > 0)
+   root = &roots[(*number_of_roots)++];
+   snprintf(root->name, sizeof(root->name), "%s", name);
+   snprintf(root->path, sizeof(root->path), "%s", target);
+   root->oid = oid;
+   root->database = database;
+
+   return roots;
+}
+
+static struct disk_root*
+add_databases(struct disk_root* roots, int* number_of_roots, int* capacity, unsigned int oid, const char* directory)
+{
+   char path[MAXPGPATH];
+   DIR* dir;
+   struct dirent* entry;
+   char* end;
+   unsigned long database;
+
+   dir = opendir(directory);
+   while (dir != NULL && (entry = readdir(dir)) != NULL)
    {
-      out_size = sizeof(out_buffer);
-      LZ4F_decompress(dctx, out_buffer, &out_size, in_buffer, &in_size, NULL);
+      snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
 
-      out_buffer[out_size] = '\0';
-      strncpy(lower_line, out_buffer, sizeof(lower_line) - 1);
-      lower_line[sizeof(lower_line) - 1] = '\0';
+      if (strcmp(entry->d_name, "pgsql_tmp") == 0)
+      {
+         roots = add_root(roots, number_of_roots, capacity, "pgsql_tmp", oid, 0, path);
+         continue;
+      }
 
-      if (strstr(lower_line, level) != NULL)
+      database = strtoul(entry->d_name, &end, 10);
+      if (entry->d_name[0] == '.' || *end != '\0' || database == 0)
       {
-         count++;
+         continue;
       }
+
+      roots = add_root(roots, number_of_roots, capacity, "database", oid, (unsigned int)database, path);
    }
 
-   LZ4F_freeDecompressionContext(dctx);
-   fclose(file);
-   return count;
+   if (dir != NULL)
+   {
+      closedir(dir);
+   }
+
+   return roots;
 }
 
-static int
-pgexporter_ext_process_zstd_log_file(const char* file_path, const char* level)
+static bool
+cached_usage(const char* path, const char* skip, struct disk_usage* usage)
 {
-   FILE* file;
-   ZSTD_DCtx* dctx;
-   char in_buffer[MAXPGPATH];
-   char out_buffer[MAXPGPATH];
-   char lower_line[MAXPGPATH];
-   size_t in_size, out_size;
-   int count = 0;
-
-   file = fopen(file_path, "rb");
-   if (!file)
-   {
-      elog(ERROR, "Failed to open compressed log file: %s", file_path);
-      return 0;
-   }
+   char resolved[PATH_MAX];
+   char entry[PATH_MAX];
+   struct disk_usage skipped;
 
-   dctx = ZSTD_createDCtx();
-   if (!dctx)
+   if (!pgexporter_ext_shmem_available() || realpath(path, resolved) == NULL)
    {
-      elog(ERROR, "Failed to create ZSTD decompression context");
-      fclose(file);
-      return 0;
+      return false;
    }
 
-   while ((in_size = fread(in_buffer, 1, sizeof(in_buffer), file)) > 0)
+   if (!pgexporter_ext_shmem_disk_usage(resolved, usage))
    {
-      out_size = ZSTD_decompressDCtx(dctx, out_buffer, sizeof(out_buffer), in_buffer, in_size);
+      return false;
+   }
 
-      if (ZSTD_isError(out_size))
+   if (skip != NULL && skip[0] != '\0')
+   {
+      snprintf(entry, sizeof(entry), "%s/%s", resolved, skip);
+      if (!pgexporter_ext_shmem_disk_usage(entry, &skipped))
       {
-         elog(ERROR, "ZSTD decompression error: %s", ZSTD_getErrorName(out_size));
-         break;
+         return false;
       }
 
-      out_buffer[out_size] = '\0';
-      strncpy(lower_line, out_buffer, sizeof(lower_line) - 1);
-      lower_line[sizeof(lower_line) - 1] = '\0';
-
-      if (strstr(lower_line, level) != NULL)
-      {
-         count++;
-      }
+      usage->bytes -= skipped.bytes;
+      usage->files -= skipped.files;
+      usage->directories -= skipped.directories;
    }
 
-   ZSTD_freeDCtx(dctx);
-   fclose(file);
-   return count;
+   return true;
+}
+
+static bool
+scan_interrupted(void)
+{
+   /* Called from the scanning threads, so only the flags set by the signal handlers are read */
+   return QueryCancelPending || ProcDiePending;
 }
@@ -0,0 +1,459 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgexporter */
+#include <pgexporter_ext.h>
+#include <disk.h>
+#include <logs.h>
+#include <shmem.h>
+#include <utils.h>
+#include <worker.h>
+
+/* PostgreSQL */
+#include "postgres.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "postmaster/bgworker.h"
+#include "postmaster/interrupt.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "tcop/tcopprot.h"
+#include "utils/guc.h"
+
+/* system */
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef HAVE_LINUX
+#include <sys/inotify.h>
+#endif
+
+/* Let a burst of writes settle before scanning */
+#define LOG_WORKER_DELAY 1000
+
+/* Publish the disk cache at most once per delay */
+#define DISK_WORKER_DELAY 1000
+
+PGDLLEXPORT void pgexporter_ext_log_worker_main(Datum main_arg);
+PGDLLEXPORT void pgexporter_ext_disk_worker_main(Datum main_arg);
+
+static void register_worker(const char* function, const char* name);
+static bool worker_interrupted(void);
+static int watch_log_directory(int fd, int wd, const char* log_directory);
+static bool drain_events(int fd);
+static void build_disk_cache(struct disk_cache* cache);
+static void publish_disk_cache(struct disk_cache* cache, struct disk_directory_usage* directories);
+
+void
+pgexporter_ext_worker_register(void)
+{
+   register_worker("pgexporter_ext_log_worker_main", "pgexporter_ext log worker");
+   register_worker("pgexporter_ext_disk_worker_main", "pgexporter_ext disk worker");
+}
+
+void
+pgexporter_ext_log_worker_main(Datum main_arg)
+{
+   struct log_state* state = NULL;
+   struct log_counts counts;
+   char log_directory[MAX_PATH];
+   int fd = -1;
+   int wd = -1;
+   bool dirty = true;
+   time_t last_scan = 0;
+   long timeout;
+   int rc;
+
+   pqsignal(SIGHUP, SignalHandlerForConfigReload);
+   pqsignal(SIGTERM, die);
+   BackgroundWorkerUnblockSignals();
+
+   state = pgexporter_ext_log_state_create();
+   if (state == NULL)
+   {
+      elog(ERROR, "Failed to allocate the log scan state");
+   }
+
+   snprintf(state->index, sizeof(state->index), "%s/%s", DataDir, LOG_INDEX_FILE);
+   state->interrupted = worker_interrupted;
+
+   memset(log_directory, 0, sizeof(log_directory));
+   snprintf(log_directory, sizeof(log_directory), "%s", GetConfigOption("log_directory", false, false));
+
+#ifdef HAVE_LINUX
+   fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+   if (fd == -1)
+   {
+      elog(LOG, "pgexporter_ext: inotify unavailable, polling %s", log_directory);
+   }
+#endif
+
+   wd = watch_log_directory(fd, wd, log_directory);
+
+   for (;;)
+   {
+      CHECK_FOR_INTERRUPTS();
+
+      if (ConfigReloadPending)
+      {
+         ConfigReloadPending = false;
+         ProcessConfigFile(PGC_SIGHUP);
+
+         if (strcmp(log_directory, GetConfigOption("log_directory", false, false)) != 0)
+         {
+            snprintf(log_directory, sizeof(log_directory), "%s", GetConfigOption("log_directory", false, false));
+            wd = watch_log_directory(fd, wd, log_directory);
+            dirty = true;
+         }
+      }
+
+      /* With the hook nothing reads the counts of the files */
+      if (pgexporter_ext_log_source != LOG_SOURCE_FILES)
+      {
+         if (last_scan != 0)
+         {
+            pgexporter_ext_shmem_log_cache_clear();
+            last_scan = 0;
+         }
+
+         WaitLatch(MyLatch, WL_LATCH_SET | WL_EXIT_ON_PM_DEATH, -1L, PG_WAIT_EXTENSION);
+         ResetLatch(MyLatch);
+
+         if (fd != -1)
+         {
+            drain_events(fd);
+         }
+         dirty = true;
+         continue;
+      }
+
+      /* A full pass every refresh interval catches anything inotify missed */
+      if (wd == -1 || time(NULL) - last_scan >= pgexporter_ext_cache_refresh_interval)
+      {
+         dirty = true;
+      }
+
+      if (dirty)
+      {
+         state->workers = pgexporter_ext_max_scan_workers;
+
+         /* The entries of the compressed files in the index keep their SQLSTATE,
+          * labels and pattern counts for the backends */
+         pgexporter_ext_log_prefix_compile(GetConfigOption("log_line_prefix", false, false), &state->prefix);
+         pgexporter_ext_log_state_patterns(state, pgexporter_ext_log_patterns);
+
+         if (pgexporter_ext_log_state_scan(state, log_directory, &counts) == 0)
+         {
+            /* A scan stopped by a shutdown doesn't publish its partial counts */
+            CHECK_FOR_INTERRUPTS();
+
+            pgexporter_ext_shmem_log_cache_update(&counts);
+         }
+
+         if (wd == -1)
+         {
+            wd = watch_log_directory(fd, wd, log_directory);
+         }
+
+         dirty = false;
+         last_scan = time(NULL);
+      }
+
+      timeout = pgexporter_ext_cache_refresh_interval * 1000L;
+
+      if (fd != -1)
+      {
+         rc = WaitLatchOrSocket(MyLatch, WL_LATCH_SET | WL_SOCKET_READABLE | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
+                                fd, timeout, PG_WAIT_EXTENSION);
+      }
+      else
+      {
+         rc = WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH, timeout, PG_WAIT_EXTENSION);
+      }
+
+      ResetLatch(MyLatch);
+
+      if ((rc & WL_SOCKET_READABLE) && drain_events(fd))
+      {
+         WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH, LOG_WORKER_DELAY, PG_WAIT_EXTENSION);
+         ResetLatch(MyLatch);
+
+         drain_events(fd);
+         dirty = true;
+      }
+   }
+}
+
+void
+pgexporter_ext_disk_worker_main(Datum main_arg)
+{
+   struct disk_cache* cache = NULL;
+   struct disk_directory_usage* directories = NULL;
+   time_t last_build = 0;
+   time_t last_publish = 0;
+   time_t retry = 1;
+   time_t now;
+   bool dirty = false;
+   bool stale;
+   long timeout;
+   int rc;
+
+   pqsignal(SIGHUP, SignalHandlerForConfigReload);
+   pqsignal(SIGTERM, die);
+   BackgroundWorkerUnblockSignals();
+
+   cache = pgexporter_ext_disk_cache_create();
+   directories = (struct disk_directory_usage*)malloc(DISK_CACHE_DIRECTORIES * sizeof(struct disk_directory_usage));
+   if (cache == NULL || directories == NULL)
+   {
+      elog(ERROR, "Failed to allocate the disk cache");
+   }
+
+   for (;;)
+   {
+      CHECK_FOR_INTERRUPTS();
+
+      if (ConfigReloadPending)
+      {
+         ConfigReloadPending = false;
+         ProcessConfigFile(PGC_SIGHUP);
+      }
+
+      if (pgexporter_ext_disk_cache_refresh_interval == 0)
+      {
+         /* The functions walk the directories themselves again */
+         if (last_build != 0)
+         {
+            pgexporter_ext_disk_cache_build(cache, NULL, 0, 1, false, NULL);
+            pgexporter_ext_shmem_disk_cache_update(directories, 0);
+            last_build = 0;
+         }
+
+         WaitLatch(MyLatch, WL_LATCH_SET | WL_EXIT_ON_PM_DEATH, -1L, PG_WAIT_EXTENSION);
+         ResetLatch(MyLatch);
+         continue;
+      }
+
+      /* A full walk every refresh interval corrects anything the events missed.
+       * When they were lost the walk is retried sooner, backing off while the
+       * trees change faster than a walk can follow */
+      now = time(NULL);
+      stale = cache->stale && now - last_build >= retry;
+      if (stale || last_build == 0 || now - last_build >= pgexporter_ext_disk_cache_refresh_interval)
+      {
+         build_disk_cache(cache);
+         last_build = time(NULL);
+         retry = stale ? 2 * retry : 1;
+         retry = retry > pgexporter_ext_disk_cache_refresh_interval ? pgexporter_ext_disk_cache_refresh_interval : retry;
+         dirty = true;
+         last_publish = 0;
+      }
+
+      if (dirty && time(NULL) != last_publish)
+      {
+         publish_disk_cache(cache, directories);
+         last_publish = time(NULL);
+         dirty = false;
+      }
+
+      if (dirty)
+      {
+         timeout = DISK_WORKER_DELAY;
+      }
+      else
+      {
+         timeout = (last_build + (cache->stale ? retry : pgexporter_ext_disk_cache_refresh_interval) - time(NULL)) * 1000L;
+         timeout = timeout < 0 ? 0 : timeout;
+      }
+
+      if (cache->fd != -1)
+      {
+         rc = WaitLatchOrSocket(MyLatch, WL_LATCH_SET | WL_SOCKET_READABLE | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
+                                cache->fd, timeout, PG_WAIT_EXTENSION);
+      }
+      else
+      {
+         rc = WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH, timeout, PG_WAIT_EXTENSION);
+      }
+
+      ResetLatch(MyLatch);
+
+      /* The events are applied as they come, so the queue doesn't overflow
+       * during a checkpoint, and only their publication is delayed */
+      if ((rc & WL_SOCKET_READABLE) && pgexporter_ext_disk_cache_process(cache) > 0)
+      {
+         dirty = true;
+      }
+   }
+}
+
+static void
+register_worker(const char* function, const char* name)
+{
+   BackgroundWorker worker;
+
+   memset(&worker, 0, sizeof(BackgroundWorker));
+
+   worker.bgw_flags = BGWORKER_SHMEM_ACCESS;
+   worker.bgw_start_time = BgWorkerStart_PostmasterStart;
+   worker.bgw_restart_time = 10;
+   snprintf(worker.bgw_library_name, BGW_MAXLEN, "pgexporter_ext");
+   snprintf(worker.bgw_function_name, BGW_MAXLEN, "%s", function);
+   snprintf(worker.bgw_name, BGW_MAXLEN, "%s", name);
+   snprintf(worker.bgw_type, BGW_MAXLEN, "%s", name);
+
+   RegisterBackgroundWorker(&worker);
+}
+
+static bool
+worker_interrupted(void)
+{
+   /* Called from the scanning threads, so only the flag set by die() is read */
+   return ProcDiePending;
+}
+
+static int
+watch_log_directory(int fd, int wd, const char* log_directory)
+{
+#ifdef HAVE_LINUX
+   if (fd == -1)
+   {
+      return -1;
+   }
+
+   if (wd != -1)
+   {
+      inotify_rm_watch(fd, wd);
+   }
+
+   wd = inotify_add_watch(fd, log_directory, IN_MODIFY | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                          IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF);
+   if (wd == -1)
+   {
+      elog(DEBUG1, "pgexporter_ext: can't watch %s: %m", log_directory);
+   }
+
+   return wd;
+#else
+   return -1;
+#endif
+}
+
+static bool
+drain_events(int fd)
+{
+#ifdef HAVE_LINUX
+   char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+   bool found = false;
+
+   while (read(fd, buffer, sizeof(buffer)) > 0)
+   {
+      found = true;
+   }
+
+   return found;
+#else
+   return false;
+#endif
+}
+
+static void
+build_disk_cache(struct disk_cache* cache)
+{
+   static bool warned = false;
+   struct disk_root* roots = NULL;
+   int number_of_roots = 0;
+   char data_directory[PATH_MAX];
+   char** paths;
+   size_t length;
+   int n = 0;
+
+   if (realpath(DataDir, data_directory) == NULL || pgexporter_ext_disk_roots(&roots, &number_of_roots))
+   {
+      pgexporter_ext_disk_cache_build(cache, NULL, 0, 1, false, NULL);
+      return;
+   }
+
+   length = strlen(data_directory);
+   paths = (char**)palloc0(number_of_roots * sizeof(char*));
+
+   /* pg_wal and the in-place tablespaces are already walked with the data directory */
+   for (int i = 0; i < number_of_roots; i++)
+   {
+      paths[n] = (char*)palloc(PATH_MAX);
+      if (realpath(roots[i].path, paths[n]) == NULL)
+      {
+         pfree(paths[n]);
+         continue;
+      }
+
+      if (i > 0 && strncmp(paths[n], data_directory, length) == 0 && paths[n][length] == '/')
+      {
+         pfree(paths[n]);
+         continue;
+      }
+
+      n++;
+   }
+
+   if (pgexporter_ext_disk_cache_build(cache, paths, n, pgexporter_ext_max_disk_workers, pgexporter_ext_disk_io_uring,
+                                       worker_interrupted))
+   {
+      /* A build stopped by a shutdown ends here */
+      CHECK_FOR_INTERRUPTS();
+
+      elog(LOG, "pgexporter_ext: failed to walk the data directory into the disk cache");
+   }
+   else if (!cache->complete && !warned)
+   {
+#ifdef HAVE_LINUX
+      elog(LOG, "pgexporter_ext: not every directory can be watched, see fs.inotify.max_user_watches");
+#endif
+      warned = true;
+   }
+
+   for (int i = 0; i < n; i++)
+   {
+      pfree(paths[i]);
+   }
+   pfree(paths);
+   pfree(roots);
+}
+
+static void
+publish_disk_cache(struct disk_cache* cache, struct disk_directory_usage* directories)
+{
+   int n;
+
+   n = pgexporter_ext_disk_cache_directories(cache, directories, DISK_CACHE_DIRECTORIES);
+   pgexporter_ext_shmem_disk_cache_update(directories, n);
+}